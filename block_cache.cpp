@@ -0,0 +1,230 @@
+#include <SD_MMC.h>
+#include "block_cache.h"
+
+
+BlockCacheStats block_cache_stats = {};
+
+struct CacheBlock {
+  char path[BLOCK_CACHE_PATH_LENGTH];           // "" when empty or being filled
+  uint32_t index;                               // Block number in the file
+  uint32_t file_size;
+  uint32_t last_used;
+  bool filling;                                 // Claimed by a reader that is on the card, never picked
+  uint8_t *data;
+};
+
+static CacheBlock blocks[BLOCK_CACHE_BLOCKS];
+static SemaphoreHandle_t cache_mutex = NULL;        // Guards the keys and the data, held while copying out
+static uint32_t use_clock = 0;
+static uint32_t generation = 0;                     // Bumped by every invalidation, fills that straddle one are dropped
+
+void initBlockCache(){
+  cache_mutex = xSemaphoreCreateMutex();
+  uint8_t *data = (uint8_t *)ps_malloc(BLOCK_CACHE_BLOCKS * BLOCK_CACHE_BLOCK);
+  if (!cache_mutex || !data){
+    Serial.println("Failed to allocate block cache");
+    while(1) {}
+  }
+  for (int i = 0; i < BLOCK_CACHE_BLOCKS; i++){
+    blocks[i] = {};
+    blocks[i].data = data + i * BLOCK_CACHE_BLOCK;
+  }
+  Serial.println("Block cache initialized, " + String(BLOCK_CACHE_KB) + " kB");
+}
+
+static CacheBlock *matchBlock(const char *path, uint32_t index){
+  // Call with the mutex held
+  for (int i = 0; i < BLOCK_CACHE_BLOCKS; i++){
+    if (blocks[i].index == index && blocks[i].path[0] && !strcmp(blocks[i].path, path)){
+      return &blocks[i];
+    }
+  }
+  return NULL;
+}
+
+static CacheBlock *claimBlock(){
+  // Call with the mutex held. An empty block if there is one, else the least recently used
+  CacheBlock *victim = NULL;
+  for (int i = 0; i < BLOCK_CACHE_BLOCKS; i++){
+    CacheBlock *b = &blocks[i];
+    if (b->filling){
+      continue;
+    }
+    if (!b->path[0]){
+      victim = b;
+      break;
+    }
+    if (!victim || b->last_used < victim->last_used){
+      victim = b;
+    }
+  }
+  if (victim){
+    victim->path[0] = '\0';
+    victim->filling = true;
+  }
+  return victim;
+}
+
+static void publishBlock(CacheBlock *b, const CachedFile *file, uint32_t index, uint32_t claimed_generation){
+  // Call with the mutex held. Keyed only if nothing invalidated meanwhile and nobody else cached it first
+  b->filling = false;
+  if (claimed_generation == generation && !matchBlock(file->path, index)){
+    strcpy(b->path, file->path);
+    b->index = index;
+    b->file_size = file->size;
+    b->last_used = ++use_clock;
+  }
+}
+
+static size_t readCard(CachedFile *file, uint32_t pos, uint8_t *dst, size_t len){
+  if (!file->file){
+    file->file = SD_MMC.open(file->path, FILE_READ);
+    if (!file->file){
+      return 0;
+    }
+  }
+  if (file->file.position() != pos && !file->file.seek(pos)){
+    return 0;
+  }
+  return file->file.read(dst, len);
+}
+
+bool openCachedFile(CachedFile *file, const char *path){
+  strncpy(file->path, path, BLOCK_CACHE_PATH_LENGTH - 1);
+  file->path[BLOCK_CACHE_PATH_LENGTH - 1] = '\0';
+  file->file = fs::File();
+  file->pos = 0;
+
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  const CacheBlock *first = matchBlock(file->path, 0);
+  if (first){
+    file->size = first->file_size;
+    block_cache_stats.opens_saved++;
+  }
+  xSemaphoreGive(cache_mutex);
+  if (first){
+    return true;
+  }
+
+  file->file = SD_MMC.open(file->path, FILE_READ);
+  if (!file->file){
+    return false;
+  }
+  file->size = file->file.size();
+  return true;
+}
+
+size_t readCachedFile(CachedFile *file, uint8_t *dst, size_t len){
+  len = min(len, (size_t)(file->size - min(file->pos, file->size)));
+  size_t done = 0;
+
+  while (done < len){
+    const uint32_t index = file->pos / BLOCK_CACHE_BLOCK;
+    const uint32_t offset = file->pos % BLOCK_CACHE_BLOCK;
+    const size_t n = min((size_t)(BLOCK_CACHE_BLOCK - offset), len - done);
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    CacheBlock *b = matchBlock(file->path, index);
+    if (b){
+      memcpy(dst + done, b->data + offset, n);
+      b->last_used = ++use_clock;
+      block_cache_stats.hits++;
+      block_cache_stats.bytes_saved += n;
+      xSemaphoreGive(cache_mutex);
+      file->pos += n;
+      done += n;
+      continue;
+    }
+
+    // Whole blocks up to the next cached one go to the card in one read, straight into dst
+    uint32_t whole = 0;
+    if (!offset){
+      while ((whole + 1) * BLOCK_CACHE_BLOCK <= len - done && !matchBlock(file->path, index + whole)){
+        whole++;
+      }
+    }
+    const uint32_t claimed_generation = generation;
+    CacheBlock *fill = whole ? NULL : claimBlock();
+    xSemaphoreGive(cache_mutex);
+
+    if (whole){
+      const size_t bytes = whole * BLOCK_CACHE_BLOCK;
+      const size_t got = readCard(file, file->pos, dst + done, bytes);
+      const uint32_t got_blocks = got / BLOCK_CACHE_BLOCK;
+
+      xSemaphoreTake(cache_mutex, portMAX_DELAY);
+      for (uint32_t i = 0; i < got_blocks; i++){
+        CacheBlock *copy = claimBlock();
+        if (copy){
+          memcpy(copy->data, dst + done + i * BLOCK_CACHE_BLOCK, BLOCK_CACHE_BLOCK);
+          publishBlock(copy, file, index + i, claimed_generation);
+        }
+      }
+      block_cache_stats.misses += whole;
+      xSemaphoreGive(cache_mutex);
+
+      file->pos += got;
+      done += got;
+      if (got < bytes){
+        break;
+      }
+      continue;
+    }
+
+    if (!fill){                                     // Every block is being filled by someone, read around the cache
+      const size_t got = readCard(file, file->pos, dst + done, n);
+      file->pos += got;
+      done += got;
+      if (got < n){
+        break;
+      }
+      continue;
+    }
+
+    // Block holding the start of the read, all of it up to the end of the file
+    const uint32_t block_start = index * BLOCK_CACHE_BLOCK;
+    const size_t want = min((size_t)BLOCK_CACHE_BLOCK, (size_t)(file->size - block_start));
+    const bool ok = readCard(file, block_start, fill->data, want) == want;
+
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    if (ok){
+      memcpy(dst + done, fill->data + offset, n);
+      publishBlock(fill, file, index, claimed_generation);
+    } else{
+      fill->filling = false;
+    }
+    block_cache_stats.misses++;
+    xSemaphoreGive(cache_mutex);
+
+    if (!ok){
+      break;
+    }
+    file->pos += n;
+    done += n;
+  }
+  return done;
+}
+
+void closeCachedFile(CachedFile *file){
+  if (file->file){
+    file->file.close();
+  }
+}
+
+bool isFileCached(const char *path){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  const bool cached = matchBlock(path, 0) != NULL;
+  xSemaphoreGive(cache_mutex);
+  return cached;
+}
+
+void invalidateCachedFile(const char *path){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  generation++;
+  for (int i = 0; i < BLOCK_CACHE_BLOCKS; i++){
+    if (!strcmp(blocks[i].path, path)){
+      blocks[i].path[0] = '\0';
+    }
+  }
+  xSemaphoreGive(cache_mutex);
+}
@@ -0,0 +1,55 @@
+/*
+
+Read through block cache for SD files
+
+Reads go through BLOCK_CACHE_BLOCK byte blocks kept in PSRAM, the least recently used block is the one
+overwritten. The gallery rereads the same sidecars every time it comes back from the viewer or pages back,
+and the viewer rereads photos that fell out of its decoded slots, both come out of memory the second time.
+A file whose first block is cached opens without touching the card, its size is kept with the block
+
+Blocks are keyed by path, so whatever writes, appends or removes a file calls invalidateCachedFile() on it.
+A read covering whole blocks nobody has cached goes to the card in one call, straight into the caller's
+buffer, and is copied into the cache afterwards
+
+Size it with -DBLOCK_CACHE_KB=..., the default suits 4 MB PSRAM boards, 8 MB boards can take a few MB
+
+*/
+
+#pragma once
+#include <FS.h>
+#include "globals.h"
+
+#ifndef BLOCK_CACHE_KB
+#define BLOCK_CACHE_KB 512
+#endif
+#define BLOCK_CACHE_BLOCK 4096                  // Matches the decoder's refill, one SD read call per block
+#define BLOCK_CACHE_BLOCKS (BLOCK_CACHE_KB * 1024 / BLOCK_CACHE_BLOCK)
+#define BLOCK_CACHE_PATH_LENGTH (MAX_FILENAME_LENGTH + 16)     // Photo names under THUMB_DIR fit
+
+struct CachedFile {
+  char path[BLOCK_CACHE_PATH_LENGTH];
+  fs::File file;                                // Opened on the first block that isn't cached
+  uint32_t size;
+  uint32_t pos;
+};
+
+struct BlockCacheStats {
+  uint32_t hits;                                // Blocks found in memory
+  uint32_t misses;                              // Blocks read from the card
+  uint32_t opens_saved;                         // Files opened from a cached first block
+  uint64_t bytes_saved;                         // Bytes served from memory instead of the card
+};
+
+extern BlockCacheStats block_cache_stats;
+
+void initBlockCache();                                      // Allocates the blocks, hangs if PSRAM is missing
+
+bool openCachedFile(CachedFile *file, const char *path);    // false if the file is missing
+
+size_t readCachedFile(CachedFile *file, uint8_t *dst, size_t len);   // Bytes read, short only at the end of the file or on an SD error
+
+void closeCachedFile(CachedFile *file);
+
+bool isFileCached(const char *path);                        // First block is in memory, so the file exists
+
+void invalidateCachedFile(const char *path);                // After writing to or removing path, drops its blocks
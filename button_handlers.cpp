@@ -1,4 +1,16 @@
 #include "button_handlers.h"
+#include "compositor.h"
+#include "display.h"
+#include "timeseries.h"
+#include "frame_handle.h"
+#include "file_index.h"
+#include "name_table.h"
+#include "frame_ring.h"
+#include "image_filters.h"
+#include "motion_detect.h"
+#include "night_capture.h"
+#include "sd_bench.h"
+#include "tasks.h"
 
 
 void handleButtonMenu(MenuItem* menu, int n_buttons){
@@ -56,28 +68,121 @@ void handleButtonCamera(){
     return;
   }
 
-  if (button_state == SELECT){          // Save frame flag
-    save_next_frame = true;
-    Serial.println("Will save next frame");
+  if (button_state == UP){              // Cycle capture modes, leaving one stops its timelapse or motion watch
+    stopTimelapse();
+    stopMotionWatch();
+    capture_mode = (CaptureMode)((capture_mode + 1) % NUM_CAPTURE_MODES);
+  }
+  else if (button_state == DOWN){       // Cycle preview filters, photos are saved unfiltered
+    camera_filter = (camera_filter + 1) % NUM_FILTER_CHAINS;
+    Serial.printf("Preview filter: %s\n", filter_chains[camera_filter].name);
+  }
+  else if (button_state == SELECT){     // Queue frames for the frame ring, saveFrameToSDTask drains it
+    if (capture_mode == CAPTURE_SINGLE){
+      requestRingStill();
+      flashCameraFeed();
+      Serial.printf("Will save a %dx%d still\n", STILL_WIDTH, STILL_HEIGHT);
+    }
+    else if (capture_mode == CAPTURE_BURST){
+      requestRingFrames(BURST_FRAMES);
+      flashCameraFeed();
+      Serial.printf("Will save the next %d frames\n", BURST_FRAMES);
+    }
+    else if (capture_mode == CAPTURE_NIGHT){
+      if (requestNightCapture()){
+        flashCameraFeed();
+        Serial.printf("Will average the next %d frames into one photo\n", NIGHT_FRAMES);
+      }
+    }
+    else if (capture_mode == CAPTURE_MOTION && motionWatching()){
+      stopMotionWatch();
+      Serial.printf("Motion watch stopped, %lu saves\n", (unsigned long)motion_stats.triggers);
+    }
+    else if (capture_mode == CAPTURE_MOTION){   // No flash either, the flash would be the first motion seen
+      startMotionWatch();
+      Serial.printf("Motion watch started, saves %d frames when %d%% of the preview changes\n", MOTION_SAVE_FRAMES, MOTION_TRIGGER_PERCENT);
+    }
+    else if (timelapseRunning()){       // No flash, a timelapse shouldn't blank the preview every frame
+      stopTimelapse();
+      Serial.println("Timelapse stopped");
+    }
+    else{
+      startTimelapse(TIMELAPSE_INTERVAL_MS);
+      Serial.printf("Timelapse started, one frame every %d s\n", TIMELAPSE_INTERVAL_MS / 1000);
+    }
   }
   else if (button_state == BACK){       // Return to menu
     display_state = MENU;
 
-    vTaskDelete(frameCaptureTask_handle);           // Delete tasks
+    lockFrameRing();                                // Not while the capture task is copying a frame in
+    vTaskDelete(frameCaptureTask_handle);           // Delete task, saveFrameToSDTask keeps draining the frame ring
     frameCaptureTask_handle = NULL;
-    vTaskDelete(saveFrameToSDTask_handle);
-    saveFrameToSDTask_handle = NULL;
+    unlockFrameRing();
+    stopMotionWatch();
+    endNightCapture();                              // Frames already summed are dropped, the task holding them is gone
+    cancelRingFrames();                             // Frames already in the ring are still saved
 
-    camera_fb_t *fb;
-    while (xQueueReceive(frame_display_queue, &fb, 0) == pdTRUE && xQueueReceive(frame_save_queue, &fb, 0) == pdTRUE){
-      // Pass through and drain every item in the queue
-    }
+    stopCameraFeed();                               // DMA may still be reading the last frame
+    drainFrames(frame_display_queue);               // Release every frame nobody picked up
 
-    esp_camera_return_all();
+    esp_camera_return_all();                        // Covers references the deleted tasks were holding
+    resetFrameHandles();
     esp_camera_deinit();                            // Deinit camera drivers to free up PSRAM
     camera_init = false;                            // Reset camera init flag
     menu_init = false;                              // Reset menu init flag
-    save_next_frame = false;                        // reset SD save flag
+    button_index = 0;
+  }
+}
+
+void handleButtonSystemData(){
+  // Up/ down cycle through the graphed series (redraws the screen), back returns to menu
+
+  button_state = NONE;
+  if(!xQueueReceive(button_queue, &button_state, 0)){
+    return;
+  }
+
+  if (button_state == DOWN){
+    button_index = (button_index + 1) % NUM_SERIES;
+    menu_init = false;
+  }
+  else if (button_state == UP){
+    button_index = (button_index + NUM_SERIES - 1) % NUM_SERIES;
+    menu_init = false;
+  }
+  else if (button_state == BACK){
+    display_state = MENU;
+    menu_init = false;
+    button_index = 0;
+  }
+}
+
+void handleButtonSdBench(){
+  // Select starts a benchmark unless one is running, back returns to menu and leaves a running one to finish and save
+
+  button_state = NONE;
+  if(!xQueueReceive(button_queue, &button_state, 0)){
+    return;
+  }
+
+  if (button_state == SELECT && !sdBenchTask_handle){
+    for (int i = 0; i < SD_BENCH_STEPS; i++){
+      sd_bench_results[i] = {};
+    }
+    sd_bench_steps_done = 0;
+    xTaskCreatePinnedToCore(
+      sdBenchTask,                  // Task function
+      "sdBenchTask",                // Task name
+      5000,                         // Stack size (bytes)
+      NULL,                         // Task parameters
+      0,                            // Priority (below everything, like the thumbnail backfill, the app's own SD work goes first)
+      &sdBenchTask_handle,          // Task handle
+      1                             // Core ID
+    );
+  }
+  else if (button_state == BACK){
+    display_state = MENU;
+    menu_init = false;
     button_index = 0;
   }
 }
@@ -110,8 +215,39 @@ char handleButtonGame(){
   return game_input;
 }
 
+static void toggleMark(int index){
+  // Marks the photo at index for the batch delete, or unmarks it
+  char name[MAX_FILENAME_LENGTH];
+  lockFileIndex();
+  snprintf(name, sizeof(name), "%s", getName(&filenames, index));
+  unlockFileIndex();
+  if (!name[0]){
+    return;
+  }
+  const int i = findName(&marked_files, name);
+  if (i >= 0){
+    removeName(&marked_files, i);
+  } else if (!insertName(&marked_files, name)){
+    Serial.println("Batch delete full, delete the marked photos first");
+  }
+}
+
+static void deleteMarkedFiles(){
+  // Hands every marked photo to deleteFromSDTask in one go, any the queue had no room for stay marked
+  while (marked_files.count){
+    char name[MAX_FILENAME_LENGTH];
+    snprintf(name, sizeof(name), "%s", getName(&marked_files, 0));
+    if (xQueueSend(file_delete_queue, &name, 0) != pdTRUE){
+      break;
+    }
+    deletes_queued++;
+    removeName(&marked_files, 0);
+  }
+  gallery_marking = marked_files.count > 0;
+}
+
 void handleButtonFiles(){
-  // Handles button presses for the file viewing system
+  // Handles button presses for the file viewing system: the day list, the gallery and the image viewer
 
   button_state = NONE;
   if (!xQueueReceive(button_queue, &button_state, 0)){
@@ -119,19 +255,52 @@ void handleButtonFiles(){
     return;
   }
 
-  if (!image_view){
-    if (button_state == DOWN){
-      file_index++;
-    }
-    else if (button_state == UP){
-      file_index--;
+  // A press is followed across samples (DEBOUNCE_INTERVAL apart). UP/ DOWN step on every sample and also jump
+  // a page or a day every LONG_PRESS_SAMPLES. SELECT in the gallery and the image viewer acts when it's let go
+  // (open/ mark, zoom), or once it has been held LONG_PRESS_SAMPLES (start marking/ delete the marked, delete).
+  // The rest of a SELECT press that already did something is ignored, so a hold that closed the viewer doesn't
+  // reopen it
+  static ButtonState press_button = NONE;
+  static int press_samples = 0;                       // Samples of the current press, -1 once a SELECT press has been used
+  bool select_tap = false, select_hold = false;
+  if (button_state != press_button){
+    select_tap = press_button == SELECT && press_samples > 0;
+    press_button = button_state;
+    press_samples = 0;
+  }
+  if (button_state != NONE && press_samples >= 0){
+    press_samples++;
+  }
+  if (button_state == SELECT && press_samples == LONG_PRESS_SAMPLES){
+    select_hold = true;
+    press_samples = -1;
+  }
+  const bool select_press = button_state == SELECT && press_samples == 1;
+  const bool long_step = (button_state == UP || button_state == DOWN) && press_samples % LONG_PRESS_SAMPLES == 0;
+  const int step = button_state == DOWN ? 1 : button_state == UP ? -1 : 0;
+
+  if (!image_view && !gallery_view){        // Day list
+    if (step){
+      lockFileIndex();
+      const int days = numDays();
+      unlockFileIndex();
+      day_index = constrain(day_index + step * (long_step ? DAY_LIST_ROWS : 1), 0, max(days - 1, 0));   // Held, pages
     }
-    else if (button_state == SELECT){
-      image_view = true;
+    else if (select_press){                 // Gallery from the first photo of the day
+      lockFileIndex();
+      file_index = min(dayStart(day_index), max(num_files - 1, 0));
+      unlockFileIndex();
+      gallery_view = true;
+      press_samples = -1;
+      prev_file_index = -1;
+      clearContent(TFT_BLACK);
     }
     else if (button_state == BACK){       // Return to menu
+      lockIndexWrites();                  // Not while the delete task is halfway through a file
       vTaskDelete(deleteFromSDTask_handle);
       deleteFromSDTask_handle = NULL;
+      flushIndexRemovals(false);          // A batch cut short still gets its removals onto the card, the rest stay queued
+      unlockIndexWrites();
       display_state = MENU;
       prev_state = MENU;
       menu_init = false;
@@ -140,15 +309,66 @@ void handleButtonFiles(){
       prev_file_index = -1;
     }
 
+  } else if (!image_view){                  // Gallery
+    if (step && long_step){                 // Held, jumps to the start of the next day, or of this one/ the one before
+      lockFileIndex();
+      const int day = dayOfFile(file_index);
+      file_index = step > 0 ? dayStart(day + 1) : dayStart(dayStart(day) < file_index ? day : max(day - 1, 0));
+      unlockFileIndex();
+    }
+    else if (step){
+      file_index += step;
+    }
+    else if (select_hold && !gallery_marking){   // Held, starts picking photos for a batch delete with this one
+      gallery_marking = true;
+      toggleMark(file_index);
+    }
+    else if (select_hold){                  // Held again, deletes everything marked
+      deleteMarkedFiles();
+    }
+    else if (select_tap && gallery_marking){
+      toggleMark(file_index);
+    }
+    else if (select_tap){                   // Let go, so a hold can start marking instead
+      image_view = true;
+      viewer_zoom = 1;
+      viewer_tile = 0;
+    }
+    else if (button_state == BACK && gallery_marking){   // Drops the marks
+      clearNames(&marked_files);
+      gallery_marking = false;
+    }
+    else if (button_state == BACK){         // Gallery steps back to the day list, on the day it was showing
+      lockFileIndex();
+      day_index = dayOfFile(file_index);
+      unlockFileIndex();
+      gallery_view = false;
+      prev_file_index = -1;
+      clearContent(TFT_BLACK);
+    }
+
     if (file_index < 0){                    // Clamp to 0 
     file_index = 0;   
     }
     else if (file_index >= num_files){      // Clamp to index of last file
-      file_index = num_files - 1;
+      file_index = max(num_files - 1, 0);
     }
 
   } else{
-    if (button_state == SELECT){                      // Delete file
+    if (viewer_zoom > 1 && (button_state == UP || button_state == DOWN)){
+      viewer_tile = constrain(viewer_tile + step, 0, viewer_zoom * viewer_zoom - 1);   // Pan to the neighbouring part
+    }
+    else if ((button_state == UP && file_index > 0) || (button_state == DOWN && file_index < num_files - 1)){
+      file_index += step;                             // Next/ previous photo, usually already in the viewer cache
+      image_shown = false;
+    }
+    else if (select_tap){                             // Zoom in, keeping the top left of the view, back to 1x after the last step
+      int row, col;
+      viewerTileCell(viewer_zoom, viewer_tile, &row, &col);
+      viewer_zoom = viewer_zoom < VIEWER_MAX_ZOOM ? viewer_zoom * 2 : 1;
+      viewer_tile = viewer_zoom > 1 ? viewerTile(viewer_zoom, row * 2, col * 2) : 0;
+    }
+    else if (select_hold){                            // Delete file
 
       //Serial.println(filenames[file_index]);
       //String filename = filenames[file_index];
@@ -157,20 +377,30 @@ void handleButtonFiles(){
       // cannot use char* or strings in queues, must pass char arrays to prevent dangling pointers
       char filename[MAX_FILENAME_LENGTH] = {0};
 
-      strncpy(filename, filenames[file_index].c_str(), MAX_FILENAME_LENGTH - 1);
+      lockFileIndex();
+      strncpy(filename, getName(&filenames, file_index), MAX_FILENAME_LENGTH - 1);
+      unlockFileIndex();
       filename[MAX_FILENAME_LENGTH - 1] = '\0';
 
-      xQueueSend(file_delete_queue, &filename, 0);    // Send filename to delete queue
+      if (xQueueSend(file_delete_queue, &filename, 0) == pdTRUE){    // Send filename to delete queue
+        deletes_queued++;
+      }
       image_view = false;                             // Return to the file viewer state
       image_shown = false;
+      viewer_zoom = 1;
+      viewer_tile = 0;
       prev_file_index = -1;                           // Allow redraw of file viewer
-      tft.fillRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+      clearContent(TFT_BLACK);
+    }
+    else if (button_state == BACK && viewer_zoom > 1){   // Whole photo again
+      viewer_zoom = 1;
+      viewer_tile = 0;
     }
     else if (button_state == BACK){       
-      image_view = false;                             // Return to the file viewer state
+      image_view = false;                             // Return to the gallery
       image_shown = false;
-      menu_init = false;
       prev_file_index = -1;
+      clearContent(TFT_BLACK);                        // Not menu_init, that would start a second delete task
     }
   }
 }
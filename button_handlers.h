@@ -11,6 +11,10 @@ void handleButtonMenu(MenuItem *menu, int num_items);
 
 void handleButtonSimple();
 
+void handleButtonSystemData();
+
+void handleButtonSdBench();
+
 void handleButtonCamera();
 
 char handleButtonGame();
@@ -0,0 +1,175 @@
+#include "compositor.h"
+
+
+struct DirtyRect {
+  int x0, y0;         // Inclusive
+  int x1, y1;         // Exclusive
+};
+
+static DirtyRect dirty[MAX_DIRTY_RECTS];
+static int num_dirty = 0;
+static uint16_t *panel_copy = NULL;             // What the panel currently shows, same byte order as the canvas
+static bool row_trusted[SCREEN_HEIGHT];         // False once something bypassed the compositor on that row
+
+static bool touches(const DirtyRect &a, const DirtyRect &b){
+  // Overlapping or sharing an edge
+  return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+static DirtyRect unite(const DirtyRect &a, const DirtyRect &b){
+  return {min(a.x0, b.x0), min(a.y0, b.y0), max(a.x1, b.x1), max(a.y1, b.y1)};
+}
+
+static int area(const DirtyRect &r){
+  return (r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+void initCompositor(){
+  // Full screen canvas so screens keep their screen coordinates (2 x 150 kB, both in PSRAM)
+
+  canvas.setColorDepth(16);
+  bool ok = canvas.createSprite(SCREEN_WIDTH, SCREEN_HEIGHT) != NULL;
+  panel_copy = (uint16_t *)ps_malloc(SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t));
+
+  if (!ok || !panel_copy){
+    Serial.println("Compositor allocation failed!");
+    while(1) {}   // hang
+  }
+
+  canvas.fillSprite(TFT_BLACK);                   // initTFT() already cleared the panel, so the copy starts in sync
+  memcpy(panel_copy, canvas.getPointer(), SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t));
+  for (int y = 0; y < SCREEN_HEIGHT; y++){
+    row_trusted[y] = true;
+  }
+  num_dirty = 0;
+  Serial.println("Compositor initialized");
+}
+
+void invalidateRect(int x, int y, int w, int h){
+
+  DirtyRect r = {max(x, 0), max(y, 0), min(x + w, SCREEN_WIDTH), min(y + h, SCREEN_HEIGHT)};
+  if (r.x0 >= r.x1 || r.y0 >= r.y1){
+    return;
+  }
+
+  // Absorb every rectangle the new one touches, starting over since the union can grow into others
+  for (int i = 0; i < num_dirty; ){
+    if (touches(dirty[i], r)){
+      r = unite(dirty[i], r);
+      dirty[i] = dirty[--num_dirty];
+      i = 0;
+    } else{
+      i++;
+    }
+  }
+
+  // Out of slots, merge with whichever rectangle grows the least
+  if (num_dirty == MAX_DIRTY_RECTS){
+    int best = 0;
+    int best_growth = area(unite(dirty[0], r)) - area(dirty[0]);
+    for (int i = 1; i < num_dirty; i++){
+      int growth = area(unite(dirty[i], r)) - area(dirty[i]);
+      if (growth < best_growth){
+        best = i;
+        best_growth = growth;
+      }
+    }
+    r = unite(dirty[best], r);
+    dirty[best] = dirty[--num_dirty];
+  }
+
+  dirty[num_dirty++] = r;
+}
+
+void clearContent(uint32_t color){
+  canvas.fillRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, color);
+  invalidateRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT);
+}
+
+void detachContent(){
+  // Flush what is pending, then hand everything below the status bar over to direct drawing
+
+  pushDirtyRects();
+  for (int y = STATUS_BAR_HEIGHT; y < SCREEN_HEIGHT; y++){
+    row_trusted[y] = false;
+  }
+}
+
+static void pushBand(int x0, int x1, int y0, int y1){
+  // Push one window covering columns x0..x1 (inclusive) of rows y0..y1 (exclusive) and record it as shown
+
+  const uint16_t *src = canvas.getPointer();
+  const int w = x1 - x0 + 1;
+
+  canvas.pushSprite(x0, y0, x0, y0, w, y1 - y0);
+  for (int y = y0; y < y1; y++){
+    memcpy(panel_copy + y * SCREEN_WIDTH + x0, src + y * SCREEN_WIDTH + x0, w * sizeof(uint16_t));
+  }
+  frame_bytes_pushed += w * (y1 - y0) * sizeof(uint16_t);
+}
+
+void pushDirtyRects(){
+
+  if (num_dirty == 0){
+    return;                       // Keep the stats of the last frame that actually drew something
+  }
+
+  tft.dmaWait();                  // The last camera strip may still be going out, blocking writes can't share the bus with it
+
+  const uint16_t *src = canvas.getPointer();
+  frame_bytes_pushed = 0;
+
+  for (int i = 0; i < num_dirty; i++){
+    const DirtyRect &r = dirty[i];
+    total_bytes_damaged += area(r) * sizeof(uint16_t);
+
+    // Consecutive rows that changed are grouped into one band, pushed as a single window over the union of their spans
+    int band_y = -1, band_x0 = 0, band_x1 = 0;
+
+    for (int y = r.y0; y <= r.y1; y++){       // y == r.y1 only flushes the last band
+      int x0 = -1, x1 = -1;
+
+      if (y < r.y1){
+        if (!row_trusted[y]){
+          x0 = r.x0;
+          x1 = r.x1 - 1;
+        } else{
+          const uint16_t *a = src + y * SCREEN_WIDTH;
+          const uint16_t *b = panel_copy + y * SCREEN_WIDTH;
+          for (int x = r.x0; x < r.x1; x++){
+            if (a[x] != b[x]){
+              x0 = x;
+              break;
+            }
+          }
+          if (x0 >= 0){
+            for (x1 = r.x1 - 1; a[x1] == b[x1]; x1--){}
+          }
+        }
+      }
+
+      if (x0 >= 0){
+        if (band_y < 0){
+          band_y = y;
+          band_x0 = x0;
+          band_x1 = x1;
+        } else{
+          band_x0 = min(band_x0, x0);
+          band_x1 = max(band_x1, x1);
+        }
+      } else if (band_y >= 0){
+        pushBand(band_x0, band_x1, band_y, y);
+        band_y = -1;
+      }
+    }
+
+    if (r.x0 == 0 && r.x1 == SCREEN_WIDTH){   // Rows are back in sync only when the whole width went through us
+      for (int y = r.y0; y < r.y1; y++){
+        row_trusted[y] = true;
+      }
+    }
+  }
+
+  total_bytes_pushed += frame_bytes_pushed;
+  num_dirty = 0;
+}
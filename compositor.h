@@ -0,0 +1,24 @@
+/*
+
+Dirty rectangle compositor
+
+Screens draw into an off screen canvas in PSRAM instead of straight to the tft, and mark what they touched
+Once per frame the damaged rectangles are pushed, but only the spans that differ from what the panel already shows
+
+Screens that push directly to the tft (camera feed, image viewer, games) detach the content area first,
+which flushes pending damage and stops the compositor trusting its copy of those rows
+
+*/
+
+#pragma once
+#include "globals.h"
+
+void initCompositor();                                  // Allocates canvas and panel copy, hangs if PSRAM is missing
+
+void invalidateRect(int x, int y, int w, int h);        // Mark a canvas area as changed this frame
+
+void clearContent(uint32_t color);                      // Fill everything below the status bar (state transitions)
+
+void detachContent();                                   // Flush, then hand the area below the status bar to direct drawing
+
+void pushDirtyRects();                                  // Push changed spans of all damaged rectangles, call once per frame
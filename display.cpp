@@ -2,6 +2,22 @@
 #include "display.h"
 #include "globals.h"
 #include "helpers.h"
+#include "compositor.h"
+#include "timeseries.h"
+#include "frame_handle.h"
+#include "image_codec.h"
+#include "file_index.h"
+#include "name_table.h"
+#include "block_cache.h"
+#include "sd_bench.h"
+#include "sd_writer.h"
+#include "frame_ring.h"
+#include "image_ops.h"
+#include "image_filters.h"
+#include "motion_detect.h"
+#include "night_capture.h"
+#include "thumbnail.h"
+#include "viewer_cache.h"
 
 
 void drawBoot(){
@@ -10,6 +26,7 @@ void drawBoot(){
 
 void drawStatusBar(){
   // Draws status bar with black background, battery level, cpu percentage, fps
+  // In the camera the battery makes room for the capture to glass latency and the frames dropped
 
   static int w = SCREEN_WIDTH, h = STATUS_BAR_HEIGHT;
   static int battery_x = 2, battery_y = 2;
@@ -22,40 +39,59 @@ void drawStatusBar(){
   static uint32_t battery_fill = TFT_GREEN;
 
   static int prev_min = -1;                         // Used to update screen only when time changes
-
-  if((int)prev_fps != (int)fps){
-    tft.fillRect(0, 0, w/3, h, bg_color);   // Clear first and last third to refresh values
-    tft.fillRect(2*w/3, 0, w/3, h, bg_color);
-
-    // Battery symbol with percentage
-    tft.fillRect(battery_x, battery_y, battery_w, battery_h, battery_fill);
-    tft.drawRect(battery_x, battery_y, battery_w, battery_h, battery_outline);
-    tft.setTextColor(text_color, battery_fill);
-    tft.setTextDatum(MC_DATUM);
-    tft.drawString("100%", battery_x + battery_w/2, battery_y + battery_h/2);       // Just for show
+  static bool prev_camera = false;
+  static int prev_latency_ms = -1;
+  static uint32_t prev_dropped = 0;
+
+  const bool camera = display_state == CAMERA_FEED;
+  const int latency_ms = camera ? (int)(preview_latency_ms + 0.5f) : -1;
+  const uint32_t dropped = camera ? preview_dropped : 0;
+
+  if((int)prev_fps != (int)fps || camera != prev_camera || latency_ms != prev_latency_ms || dropped != prev_dropped){
+    canvas.fillRect(0, 0, w/3, h, bg_color);   // Clear first and last third to refresh values
+    canvas.fillRect(2*w/3, 0, w/3, h, bg_color);
+
+    if (camera){
+      // Preview latency and frames the display never showed
+      canvas.setTextDatum(ML_DATUM);
+      canvas.setTextColor(text_color, bg_color);
+      canvas.drawString(String(latency_ms) + "ms " + String((unsigned long)dropped) + " drop", battery_x, STATUS_BAR_HEIGHT / 2);
+    } else{
+      // Battery symbol with percentage
+      canvas.fillRect(battery_x, battery_y, battery_w, battery_h, battery_fill);
+      canvas.drawRect(battery_x, battery_y, battery_w, battery_h, battery_outline);
+      canvas.setTextColor(text_color, battery_fill);
+      canvas.setTextDatum(MC_DATUM);
+      canvas.drawString("100%", battery_x + battery_w/2, battery_y + battery_h/2);       // Just for show
+    }
 
     // FPS data 
-    tft.setTextDatum(MR_DATUM);
-    tft.setTextColor(text_color, bg_color);
-    tft.drawString("FPS: " + String((int)fps), fps_text_x, STATUS_BAR_HEIGHT / 2);
-    tft.setTextDatum(MC_DATUM);
+    canvas.setTextDatum(MR_DATUM);
+    canvas.setTextColor(text_color, bg_color);
+    canvas.drawString("FPS: " + String((int)fps), fps_text_x, STATUS_BAR_HEIGHT / 2);
+    canvas.setTextDatum(MC_DATUM);
 
-    tft.drawFastHLine(0, STATUS_BAR_HEIGHT-1, SCREEN_WIDTH, TFT_WHITE);
+    canvas.drawFastHLine(0, STATUS_BAR_HEIGHT-1, SCREEN_WIDTH, TFT_WHITE);
+    invalidateRect(0, 0, w, h);
     prev_fps = fps;
+    prev_camera = camera;
+    prev_latency_ms = latency_ms;
+    prev_dropped = dropped;
   }
 
   // NTP time
   if (prev_min != t.tm_min){
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextColor(text_color, bg_color);
-    tft.fillRect(w/3, 0, w/3, STATUS_BAR_HEIGHT, TFT_BLACK);       // Clear 2nd third of screen to refresh
+    canvas.setTextDatum(MC_DATUM);
+    canvas.setTextColor(text_color, bg_color);
+    canvas.fillRect(w/3, 0, w/3, STATUS_BAR_HEIGHT, TFT_BLACK);       // Clear 2nd third of screen to refresh
     
     char time_str[6]; // "HH:MM" + null terminator
     sprintf(time_str, "%02d:%02d", t.tm_hour, t.tm_min);
-    tft.drawString(time_str, SCREEN_WIDTH / 2, STATUS_BAR_HEIGHT / 2);    // Draw time
+    canvas.drawString(time_str, SCREEN_WIDTH / 2, STATUS_BAR_HEIGHT / 2);    // Draw time
     prev_min = t.tm_min;
 
-    tft.drawFastHLine(0, STATUS_BAR_HEIGHT-1, SCREEN_WIDTH, TFT_WHITE);
+    canvas.drawFastHLine(0, STATUS_BAR_HEIGHT-1, SCREEN_WIDTH, TFT_WHITE);
+    invalidateRect(w/3, 0, w/3, h);
   }
 }
 
@@ -71,19 +107,20 @@ void drawMenu(MenuItem *menu, int num_items){
 
   for (int i = 0; i < num_items; i++){
 
-    tft.fillRect(0, STATUS_BAR_HEIGHT + h * i, w, h, bg_color);
-    tft.setTextSize(2);
-    tft.setTextColor(TFT_WHITE, bg_color);              // background of text same as rectangle
-    tft.setTextDatum(MC_DATUM);                         // middle-center alignment
-    tft.drawString(menu[i].label, 120, STATUS_BAR_HEIGHT + h * i + h / 2);        // centered in the button
-    tft.drawRect(0, STATUS_BAR_HEIGHT + h * i, w, h, outline_color);
+    canvas.fillRect(0, STATUS_BAR_HEIGHT + h * i, w, h, bg_color);
+    canvas.setTextSize(2);
+    canvas.setTextColor(TFT_WHITE, bg_color);              // background of text same as rectangle
+    canvas.setTextDatum(MC_DATUM);                         // middle-center alignment
+    canvas.drawString(menu[i].label, 120, STATUS_BAR_HEIGHT + h * i + h / 2);        // centered in the button
+    canvas.drawRect(0, STATUS_BAR_HEIGHT + h * i, w, h, outline_color);
     
   }
 
-  tft.setTextSize(1);
+  canvas.setTextSize(1);
 
   // Draw initial highlight
-  tft.drawRect(0, STATUS_BAR_HEIGHT + button_index * h, w, h, highlight_color);
+  canvas.drawRect(0, STATUS_BAR_HEIGHT + button_index * h, w, h, highlight_color);
+  invalidateRect(0, STATUS_BAR_HEIGHT, w, h * num_items);
 
   last_button_index = button_index; // Track previous highlight
     
@@ -100,50 +137,184 @@ void updateMenuHighlight(MenuItem* menu, int num_items){
     int y_new = STATUS_BAR_HEIGHT + button_index * MENU_ITEM_HEIGHT;
 
     // Remove highlight from old button
-    tft.drawRect(0, y_old, SCREEN_WIDTH, MENU_ITEM_HEIGHT, outline_color);
+    canvas.drawRect(0, y_old, SCREEN_WIDTH, MENU_ITEM_HEIGHT, outline_color);
 
     // Draw highlight on new button
-    tft.drawRect(0, y_new, SCREEN_WIDTH, MENU_ITEM_HEIGHT, highlight_color);
+    canvas.drawRect(0, y_new, SCREEN_WIDTH, MENU_ITEM_HEIGHT, highlight_color);
+
+    invalidateRect(0, y_old, SCREEN_WIDTH, MENU_ITEM_HEIGHT);
+    invalidateRect(0, y_new, SCREEN_WIDTH, MENU_ITEM_HEIGHT);
 
     last_button_index = button_index; // Update tracker
   }
 }
 
+// System Data layout, shared by the one time draw and the updates
+static const int sys_text_x = 10;
+static const int sys_text_y = STATUS_BAR_HEIGHT + 30;      // First line under the title
+static const int sys_line_height = 16;
+static const int sys_num_lines = 6;
+static const int sys_range_step = 10;                      // Graph range snaps to multiples of this so it rarely rescales
+static StripChart sys_chart;
+static uint32_t sys_chart_cursor = 0;                      // Next sample of the charted series to plot
+
+static void seriesRange(const TimeSeries *series, int *y_min, int *y_max){
+  // Window min/max rounded outwards to the step
+
+  int low, high;
+  seriesMinMax(series, &low, &high);
+  *y_min = low / sys_range_step * sys_range_step;
+  *y_max = (high + sys_range_step - 1) / sys_range_step * sys_range_step;
+  if (*y_max <= *y_min){
+    *y_max = *y_min + sys_range_step;
+  }
+}
+
+static void drawSystemDataLine(int line, const String &text){
+  // Redraws one text line, the compositor only sends the characters that changed
+  int y = sys_text_y + line * sys_line_height;
+  canvas.fillRect(sys_text_x, y, SCREEN_WIDTH - 2 * sys_text_x, 8, TFT_BLACK);
+  canvas.drawString(text, sys_text_x, y);
+  invalidateRect(sys_text_x, y, SCREEN_WIDTH - 2 * sys_text_x, 8);
+}
+
 void drawSystemData() {
-  // Draws all the system data from the queue (live information)
-  // Will update to instead show a graph of useful stats like:
-  // Graph of PSRAM, Heap, CPU% data over time
+  // Draws the title and the graph of the selected series with its history, call once when entering the screen
+  // updateSystemData() then fills in the live values as they arrive. Up/ down pick the series (button_index)
+
+  canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+  canvas.setTextDatum(MC_DATUM);
+  canvas.setTextSize(2);
+  canvas.drawString("System Data", SCREEN_WIDTH/2, STATUS_BAR_HEIGHT + 10);
+  canvas.setTextSize(1);
+  invalidateRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, 20);
+
+  const int graph_width = 220;
+  const int graph_height = 164;
+  const uint32_t graph_color = TFT_BLUE;
+
+  const TimeSeries *series = &sys_series[button_index % NUM_SERIES];
+  int y_min, y_max;
+  seriesRange(series, &y_min, &y_max);
+  initStripChart(&sys_chart, sys_text_x, sys_text_y + sys_num_lines * sys_line_height, graph_width, graph_height,
+                 SERIES_CAPACITY, y_min, y_max, "Time (s)", (char *)series->unit, (char *)series->name, graph_color);
+
+  // Plot the history straight out of the ring, then follow the series from where the view ended
+  SeriesView view;
+  getSeriesView(series, &view);
+  for (int i = 0; i < view.count; i++){
+    pushStripChart(&sys_chart, seriesViewAt(&view, i));
+  }
+  sys_chart_cursor = view.start + view.count;
+}
+
+void updateSystemData() {
+  // Updates the text lines and appends the newest heap sample when new system data is in the queue
 
   SystemInfo info;
 
   if (!xQueueReceive(sys_info_queue, &info, 0)) {
     return;
   }
-    
-  tft.fillRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
-  tft.setTextColor(TFT_WHITE, TFT_BLACK);
 
-  int x = 10;
-  int y = STATUS_BAR_HEIGHT + 10;
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextSize(2);
-  tft.drawString("System Data", SCREEN_WIDTH/2, y); y += 20;
-  tft.setTextSize(1);
-  tft.setTextDatum(TL_DATUM);
-  tft.drawString("Min Heap: " + String(info.min_free_heap) + " B", x, y); y += 20;
-  tft.drawString("CPU Freq: " + String(info.cpu_freq) + " MHz", x, y); y += 20;
-  tft.drawString("Uptime: " + String(info.uptime) + " s", x, y); y += 20;
+  canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+  canvas.setTextDatum(TL_DATUM);
+  drawSystemDataLine(0, "Min Heap: " + String(info.min_free_heap) + " B");
+  drawSystemDataLine(1, "CPU Freq: " + String(info.cpu_freq) + " MHz");
+  drawSystemDataLine(2, "Uptime: " + String(info.uptime) + " s");
+  drawSystemDataLine(3, "Pushed " + String((int)(total_bytes_pushed / 1000)) + " kB of " +
+                        String((int)(total_bytes_damaged / 1000)) + " kB damaged");
+  drawSystemDataLine(4, "File names: " + String(filenames.count) + " in " + String((int)(nameTableUsedBytes(&filenames) / 1024)) +
+                        " of " + String((int)(nameTableBytes(&filenames) / 1024)) + " kB PSRAM");
+  const uint32_t lookups = block_cache_stats.hits + block_cache_stats.misses;
+  drawSystemDataLine(5, "SD cache: " + String(lookups ? (int)((uint64_t)block_cache_stats.hits * 100 / lookups) : 0) + "% hits, " +
+                        String((int)(block_cache_stats.bytes_saved / 1024)) + " kB saved of " + String(BLOCK_CACHE_KB) + " kB");
+
+  const TimeSeries *series = &sys_series[button_index % NUM_SERIES];
+  int y_min, y_max, value;
+  seriesRange(series, &y_min, &y_max);
+  setStripChartRange(&sys_chart, y_min, y_max);            // Redraws the whole chart only if the range changed
+  while (readSeries(series, &sys_chart_cursor, &value)){
+    pushStripChart(&sys_chart, value);
+  }
+}
 
-  const int graph_width = 220;
-  const int graph_height = 200;
-  const uint32_t graph_color = TFT_BLUE;
+// SD Bench layout, one row per step under the headings
+static const int bench_text_x = 6;
+static const int bench_head_y = STATUS_BAR_HEIGHT + 46;
+static const int bench_row_y = bench_head_y + 16;
+static const int bench_line_height = 16;
+static const int bench_status_y = bench_row_y + SD_BENCH_STEPS * bench_line_height + 8;
+static int bench_shown_steps = -1;                        // Rows drawn for, -1 until the first update after entering
+static bool bench_shown_running = false;
+
+static void drawSdBenchLine(int y, const String &text, uint32_t color){
+  canvas.fillRect(0, y, SCREEN_WIDTH, 8, TFT_BLACK);
+  canvas.setTextColor(color, TFT_BLACK);
+  canvas.drawString(text, bench_text_x, y);
+  invalidateRect(0, y, SCREEN_WIDTH, 8);
+}
+
+void drawSdBench(){
+  // Results of the last run stay up until SELECT starts the next one
+
+  canvas.setTextColor(TFT_WHITE, TFT_BLACK);
+  canvas.setTextDatum(MC_DATUM);
+  canvas.setTextSize(2);
+  canvas.drawString("SD Benchmark", SCREEN_WIDTH/2, STATUS_BAR_HEIGHT + 10);
+  canvas.setTextSize(1);
+  canvas.drawString("1-bit bus, " + String(SD_BENCH_FILE_BYTES / 1024) + " kB file, " + String(SD_BENCH_RANDOM_OPS) + " random ops",
+                    SCREEN_WIDTH/2, STATUS_BAR_HEIGHT + 30);
+  invalidateRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, 36);
+
+  canvas.setTextDatum(TL_DATUM);
+  drawSdBenchLine(bench_head_y, "Block Test         MB/s p50 us p99 us", TFT_YELLOW);
+  bench_shown_steps = -1;
+}
+
+void updateSdBench(){
+  // Only the rows between what was shown and what is done now change, a new run clears them back to empty
+  const int done = sd_bench_steps_done;
+  const bool running = sdBenchTask_handle != NULL;
+  if (done == bench_shown_steps && running == bench_shown_running){
+    return;
+  }
+
+  const int first = bench_shown_steps < 0 ? 0 : min(bench_shown_steps, done);
+  const int last = bench_shown_steps < 0 ? SD_BENCH_STEPS : max(bench_shown_steps, done);
+  canvas.setTextDatum(TL_DATUM);
+  for (int i = first; i < last; i++){
+    const int y = bench_row_y + i * bench_line_height;
+    const SdBenchResult *r = &sd_bench_results[i];
+    if (i >= done || !r->block_size){
+      drawSdBenchLine(y, "", TFT_WHITE);
+      continue;
+    }
+    char line[48];
+    const uint32_t kb = r->block_size / 1024;
+    snprintf(line, sizeof(line), "%3lu%-2s %-10s", (unsigned long)(kb ? kb : r->block_size), kb ? "kB" : "B", sdBenchTestName(r->test));
+    String text = line;
+    if (r->ok){
+      snprintf(line, sizeof(line), " %6.2f %6lu %6lu", r->mb_per_s, (unsigned long)r->p50_us, (unsigned long)r->p99_us);
+      text += line;
+    } else{
+      text += "  failed";
+    }
+    drawSdBenchLine(y, text, r->ok ? TFT_WHITE : TFT_RED);
+  }
 
-  // Create buffers for x and y points
-  int x_c[NUM_SYS_DATA_POINTS] = {0};
-  int y_c[NUM_SYS_DATA_POINTS] = {0};
-  generateXYArrays(x_c, y_c);
-  drawGraph(x_c, y_c, NUM_SYS_DATA_POINTS, min_heap, max_heap, x, y,
-            graph_width, graph_height, "Time (s)", "kB", "Heap Usage Within Last Minute", graph_color);
+  String status;
+  if (running){
+    status = "Running, step " + String(min(done + 1, SD_BENCH_STEPS)) + " of " + String(SD_BENCH_STEPS);
+  } else if (done == SD_BENCH_STEPS){
+    status = "Saved to " + String(SD_BENCH_RESULTS_FILE + 1) + ", SELECT to rerun";
+  } else{
+    status = "SELECT to run, writes a " + String(SD_BENCH_FILE_BYTES / 1024) + " kB scratch file";
+  }
+  drawSdBenchLine(bench_status_y, status, TFT_WHITE);
+
+  bench_shown_steps = done;
+  bench_shown_running = running;
 }
 
 void drawWifi(){
@@ -159,254 +330,791 @@ void drawWifi(){
   if (!xQueueReceive(wifi_queue, &info, 0)){
     return;
   } else{
-    tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+    canvas.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
 
     // Main WiFi info section
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextColor(text_color, bg_color);
-    tft.drawString("WiFi Info", SCREEN_WIDTH / 2, y);
+    canvas.setTextDatum(MC_DATUM);
+    canvas.setTextColor(text_color, bg_color);
+    canvas.drawString("WiFi Info", SCREEN_WIDTH / 2, y);
     y += sectionHeight;
 
-    tft.setTextDatum(ML_DATUM);
-    tft.drawString(String("SSID: ") + String(info.ssid), 0, y);
+    canvas.setTextDatum(ML_DATUM);
+    canvas.drawString(String("SSID: ") + String(info.ssid), 0, y);
     y += sectionHeight;
-    tft.drawString(String("IP: ")   + String(info.ip),   0, y);
+    canvas.drawString(String("IP: ")   + String(info.ip),   0, y);
     y += sectionHeight;
-    tft.drawString("RSSI: " + String(info.rssi) + " dBm", 0, y);
+    canvas.drawString("RSSI: " + String(info.rssi) + " dBm", 0, y);
     y += sectionHeight;
-    tft.drawString(String("MAC: ")  + String(info.mac),  0, y);
+    canvas.drawString(String("MAC: ")  + String(info.mac),  0, y);
     y += sectionHeight + 10;
 
     // Divider line
-    tft.drawLine(0, y, SCREEN_WIDTH, y, TFT_WHITE);
+    canvas.drawLine(0, y, SCREEN_WIDTH, y, TFT_WHITE);
     y += 10;
 
     // Scan nearby networks
     int n = info.nearbyCount;
-    tft.setTextDatum(MC_DATUM);
-    tft.drawString("Nearby WiFi", SCREEN_WIDTH / 2, y);
+    canvas.setTextDatum(MC_DATUM);
+    canvas.drawString("Nearby WiFi", SCREEN_WIDTH / 2, y);
     y += sectionHeight;
 
-    tft.setTextDatum(ML_DATUM);
+    canvas.setTextDatum(ML_DATUM);
     if (n == 0) {
-      tft.drawString("No networks found", 0, y);
+      canvas.drawString("No networks found", 0, y);
     } else {
       for (int i = 0; i < n && i < MAX_WIFI; i++) { 
-        tft.drawString(info.nearby[i], 0, y);
+        canvas.drawString(info.nearby[i], 0, y);
         y += sectionHeight;
       }
     }
-    tft.setTextDatum(MC_DATUM);
+    canvas.setTextDatum(MC_DATUM);
+
+    invalidateRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT);
   }
 
   
 }
 
+static FrameHandle *frame_in_flight = NULL;   // Frame whose last strip the DMA may still be sending
+static int next_dma_buffer = 0;               // dma_buffers[] entry the next strip is copied into, shared with the image viewer
+static uint32_t flash_until = 0;              // Preview stays white until then after a photo is taken
+
+static void retireCameraFrame(){
+  // Ends the transaction once the DMA is done (endWrite waits for it), then drops the display's reference
+  // The frame is on the glass now, its age since the sensor stamped it is the capture to display latency
+  tft.endWrite();
+  const struct timeval *captured = &frame_in_flight->fb->timestamp;     // esp_timer time, the clock micros() reads
+  preview_latency_us += (uint32_t)micros() - (uint32_t)(captured->tv_sec * 1000000ULL + captured->tv_usec);
+  preview_latency_frames++;
+  releaseFrame(frame_in_flight);
+  frame_in_flight = NULL;
+}
+
 void drawCameraFeed(){
+  // Pushes the frame in strips over DMA. Each strip is copied into one of two internal buffers while the
+  // previous strip transfers, and the last strip is left in flight so the next frame is dequeued meanwhile
 
-  camera_fb_t *fb;
-  if (!xQueueReceive(frame_display_queue, &fb, 0)){
+
+  if (frame_in_flight && !tft.dmaBusy()){
+    retireCameraFrame();
+  }
+
+  FrameHandle *frame;
+  if (!xQueueReceive(frame_display_queue, &frame, 0)){
     //Serial.println("Camera frame was not recieved from the queue!");
     return;
   }
+  const uint8_t taken = 1;
+  xQueueOverwrite(frame_taken_queue, &taken);     // frameCaptureTask grabs the next one while this one is pushed
 
+  if (frame_in_flight){
+    retireCameraFrame();
+  }
 
-  // Push image to the screen
-  tft.pushImage(0, STATUS_BAR_HEIGHT, fb->width, fb->height, (uint16_t *)fb->buf);
+  if ((int32_t)(millis() - flash_until) < 0){    // Still flashing, the frame is blanked on purpose and not counted as dropped
+    releaseFrame(frame);
+    return;
+  }
 
-  if (save_next_frame){
-    tft.fillRect(0, STATUS_BAR_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_WHITE);     // Flash white screen before taking photo (visual signal of photo being taken)
+  camera_fb_t *fb = frame->fb;
 
+  tft.startWrite();
+  for (int row = 0; row < (int)fb->height; row += DMA_STRIP_ROWS){
+    int rows = min(DMA_STRIP_ROWS, (int)fb->height - row);
+    tft.pushImageDMA(0, STATUS_BAR_HEIGHT + row, fb->width, rows, (uint16_t *)fb->buf + row * fb->width, dma_buffers[next_dma_buffer]);
+    next_dma_buffer ^= 1;                               // Alternates across frames too, the buffer just sent is never overwritten
   }
-  else{
-    esp_camera_fb_return(fb);       // Return the fb if a save was not requested
+  preview_frames++;
+  frame_in_flight = frame;          // Released once the DMA is done with it, the save task holds its own reference
+}
+
+void flashCameraFeed(){
+  // Flash white screen when taking a photo (visual signal of photo being taken)
+  // The save no longer holds the preview up, so the flash is held for CAMERA_FLASH_MS instead
+
+  if (frame_in_flight){
+    retireCameraFrame();            // Let the last strip land before the flash
   }
+  tft.fillRect(0, STATUS_BAR_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_WHITE);
+  flash_until = millis() + CAMERA_FLASH_MS;
 }
 
-void drawCameraButton(){
-  // Draw option to save
+void stopCameraFeed(){
+  // Waits for the last transfer and releases the frame it was reading, call before the camera is deinitialized
+
+  if (frame_in_flight){
+    retireCameraFrame();
+  }
+}
+
+void drawCameraButton(bool force){
+  // Draw the capture mode (UP changes it, SELECT takes the photo), how the saves are doing and the preview
+  // filter (DOWN changes it) with what each of its stages costs per frame
   static int option_w = SCREEN_WIDTH, option_h = SCREEN_HEIGHT - (STATUS_BAR_HEIGHT + IMAGE_HEIGHT);
   static uint32_t bg_color = TFT_BLUE;
   static uint32_t outline_color = TFT_BLUE;
   static uint32_t highlight_color = TFT_WHITE;
   static uint32_t text_color = TFT_WHITE;
+  static char shown_mode[40] = "";
+  static char shown_counts[64] = "";
+  static char shown_filter[64] = "";
+
+  char mode[40], counts[64], filter[64];
+  if (capture_mode == CAPTURE_SINGLE && still_switch_ms){     // How long the last still held the preview up
+    snprintf(mode, sizeof(mode), "< Still %dx%d, last %lu ms >", STILL_WIDTH, STILL_HEIGHT, (unsigned long)still_switch_ms);
+  } else if (capture_mode == CAPTURE_SINGLE){
+    snprintf(mode, sizeof(mode), "< Still %dx%d >", STILL_WIDTH, STILL_HEIGHT);
+  } else if (capture_mode == CAPTURE_BURST){
+    snprintf(mode, sizeof(mode), "< Burst of %d >", BURST_FRAMES);
+  } else if (capture_mode == CAPTURE_NIGHT && nightCapturePending()){
+    snprintf(mode, sizeof(mode), "< Night of %d: taking >", NIGHT_FRAMES);
+  } else if (capture_mode == CAPTURE_NIGHT && night_stats.captures){
+    snprintf(mode, sizeof(mode), "< Night of %d, last %lu ms >", NIGHT_FRAMES, (unsigned long)night_stats.last_ms);
+  } else if (capture_mode == CAPTURE_NIGHT){
+    snprintf(mode, sizeof(mode), "< Night of %d frames >", NIGHT_FRAMES);
+  } else if (capture_mode == CAPTURE_MOTION && motionWatching()){
+    snprintf(mode, sizeof(mode), "< Motion over %d%%: on, %.1f%% now >", MOTION_TRIGGER_PERCENT, motion_stats.changed_percent);
+  } else if (capture_mode == CAPTURE_MOTION){
+    snprintf(mode, sizeof(mode), "< Motion over %d%%: off >", MOTION_TRIGGER_PERCENT);
+  } else{
+    snprintf(mode, sizeof(mode), "< Timelapse every %d s: %s >", TIMELAPSE_INTERVAL_MS / 1000, timelapseRunning() ? "on" : "off");
+  }
+  snprintf(counts, sizeof(counts), "Captured %lu  Pending %d  Dropped %lu", (unsigned long)frame_ring_stats.captured,
+           ringFramesHeld() + sdWritesPending(), (unsigned long)frame_ring_stats.dropped);
+  const FilterChain *chain = &filter_chains[camera_filter];
+  int len = snprintf(filter, sizeof(filter), "Filter: %s ", chain->name);
+  for (int i = 0; i < chain->stages; i++){
+    len += snprintf(filter + len, sizeof(filter) - len, "%s%.1f", i ? " + " : " ", filter_stage_ms[i]);
+  }
+  if (chain->stages){
+    snprintf(filter + len, sizeof(filter) - len, " ms");
+  }
 
-  tft.fillRect(0, STATUS_BAR_HEIGHT + 240, option_w, option_h, bg_color);
-  tft.drawRect(0, STATUS_BAR_HEIGHT + 240, option_w, option_h, highlight_color);
-
-  tft.setTextDatum(MC_DATUM);
-  tft.setTextColor(text_color, bg_color);
-  tft.drawString("Save to SD card", option_w / 2, STATUS_BAR_HEIGHT + 240 + option_h/2);
+  if (!force && !strcmp(mode, shown_mode) && !strcmp(counts, shown_counts) && !strcmp(filter, shown_filter)){
+    return;
+  }
+  strcpy(shown_mode, mode);
+  strcpy(shown_counts, counts);
+  strcpy(shown_filter, filter);
+
+  canvas.fillRect(0, STATUS_BAR_HEIGHT + 240, option_w, option_h, bg_color);
+  canvas.drawRect(0, STATUS_BAR_HEIGHT + 240, option_w, option_h, highlight_color);
+
+  canvas.setTextDatum(MC_DATUM);
+  canvas.setTextColor(text_color, bg_color);
+  canvas.drawString(mode, option_w / 2, STATUS_BAR_HEIGHT + 240 + option_h/4);
+  canvas.drawString(counts, option_w / 2, STATUS_BAR_HEIGHT + 240 + option_h*2/4);
+  canvas.drawString(filter, option_w / 2, STATUS_BAR_HEIGHT + 240 + option_h*3/4);
+  invalidateRect(0, STATUS_BAR_HEIGHT + 240, option_w, option_h);
 }
 
 void drawFiles(){
+  // Day list of the SD app, one row per day with its photo count, newest at the bottom
+  // Reads only the day index, so it costs the same with ten photos or thousands
 
-  static int max_files = 10;                               // 10 files shown at a time
-  static int start = 0, end = max_files-1;                 // Indexes for file boxes
+  static int max_days = DAY_LIST_ROWS;                     // 10 days shown at a time
+  static int start = 0;                                    // Day in the top row
 
-  static int w = SCREEN_WIDTH, h = (SCREEN_HEIGHT - STATUS_BAR_HEIGHT) / max_files;  
+  static int w = SCREEN_WIDTH, h = (SCREEN_HEIGHT - STATUS_BAR_HEIGHT) / max_days;  
   static uint32_t bg_color = TFT_DARKGREY;
   static uint32_t outline_color = TFT_BLUE;
   static uint32_t highlight_color = TFT_WHITE;
   static uint32_t text_color = TFT_WHITE;
+  static int shown_day = -1, shown_files = -1;
 
-  if (file_index != prev_file_index){         // Only update if something changed
+  if (day_index != shown_day || num_files != shown_files || prev_file_index == -1){   // Only update if something changed
 
-    if (file_index > end){                    // Increment start and end index for viewport
-      start++;
-      end++;
+    lockFileIndex();                          // The save and delete tasks change the list
+    const int days = numDays();
+    day_index = constrain(day_index, 0, max(days - 1, 0));    // A delete may have emptied the last day
+
+    if (day_index >= start + max_days){       // Move the viewport just far enough to show the day
+      start = day_index - max_days + 1;
     }
-    else if (file_index < start){          // De-increment start and end index for viewport
-      start--;
-      end--;
+    else if (day_index < start){
+      start = day_index;
     }
+    start = constrain(start, 0, max(days - max_days, 0));
 
-    if (start < 0){                         // Clamp start to 0
-      start = 0;
+    for (int i = start; i < start + max_days; i++){
+      const int y = STATUS_BAR_HEIGHT + h * (i - start);
+      if (i >= days){                         // Fewer days than rows, clear what a deleted day left behind
+        canvas.fillRect(0, y, w, h, TFT_BLACK);
+        continue;
+      }
+      char day[DAY_NAME_LENGTH];
+      dayName(i, day);
+      const int photos = dayStart(i + 1) - dayStart(i);
+
+      canvas.fillRect(0, y, w, h, bg_color);
+      canvas.setTextColor(text_color, bg_color);                                            // background of text same as rectangle
+      canvas.setTextDatum(MC_DATUM);                                                       // middle-center alignment
+      canvas.drawString(String(day) + "    " + String(photos) + (photos == 1 ? " photo" : " photos"), 120, y + h / 2);
+      canvas.drawRect(0, y, w, h, day_index == i ? highlight_color : outline_color);      // Draw outline, highlighted if selected
     }
-
-    if (end > num_files){                   // Clamp end to index of last file + 1
-      end = num_files-1;
+    if (days == 0){
+      canvas.setTextDatum(MC_DATUM);
+      canvas.setTextColor(text_color, TFT_BLACK);
+      canvas.drawString("No photos", 120, STATUS_BAR_HEIGHT + h / 2);
     }
+    unlockFileIndex();
+    invalidateRect(0, STATUS_BAR_HEIGHT, w, h * max_days);
+    shown_day = day_index;
+    shown_files = num_files;
+    prev_file_index = file_index;
+  }
+}
 
-    if (end != start + max_files - 1){      // Temporary fix to the end variable shrinking unexpectedly when files are deleted in certain indexes
-                                            // I think the error is due to num_files changing after deletion but i dont know how to fix it
-      end = start + max_files - 1;
+static bool drawGalleryCell(int cell, int index, bool highlight, bool requested){
+  // Draws one thumbnail from its sidecar, or a placeholder and a backfill request (once). true if the thumbnail was drawn
+  static ImageReader reader;                    // Decoder state and its SD chunk, too big for the task stack
+  const int x = (cell % GALLERY_COLS) * THUMB_SIZE;
+  const int y = STATUS_BAR_HEIGHT + (cell / GALLERY_COLS) * THUMB_SIZE;
+  bool drawn = false;
+
+  if (index < num_files){
+    char filename[MAX_FILENAME_LENGTH];
+    lockFileIndex();
+    strncpy(filename, getName(&filenames, index), MAX_FILENAME_LENGTH - 1);
+    unlockFileIndex();
+    filename[MAX_FILENAME_LENGTH - 1] = '\0';
+
+    const bool marked = findName(&marked_files, filename) >= 0;
+    if (openThumbnail(&reader, filename)){
+      uint16_t row[THUMB_SIZE];
+      int y_row = 0;
+      for (; y_row < THUMB_SIZE && readImageRow(&reader, row); y_row++){
+        canvas.pushImage(x, y + y_row, THUMB_SIZE, 1, row);
+      }
+      closeImage(&reader);
+      drawn = y_row == THUMB_SIZE;
+    }
+    if (!drawn){
+      canvas.fillRect(x, y, THUMB_SIZE, THUMB_SIZE, TFT_DARKGREY);
+      canvas.setTextDatum(MC_DATUM);
+      canvas.setTextColor(TFT_WHITE, TFT_DARKGREY);
+      canvas.drawString("...", x + THUMB_SIZE / 2, y + THUMB_SIZE / 2);
+      if (!requested){
+        requestThumbnail(filename);
+      }
+    }
+    if (marked){
+      canvas.fillCircle(x + THUMB_SIZE - 10, y + 10, 6, TFT_RED);
+      canvas.drawCircle(x + THUMB_SIZE - 10, y + 10, 6, TFT_WHITE);
     }
+  } else{
+    canvas.fillRect(x, y, THUMB_SIZE, THUMB_SIZE, TFT_BLACK);
+    drawn = true;                               // Nothing to wait for
+  }
 
-    for (int i = start; i <= end; i++){
+  if (highlight){
+    canvas.drawRect(x, y, THUMB_SIZE, THUMB_SIZE, TFT_WHITE);
+    canvas.drawRect(x + 1, y + 1, THUMB_SIZE - 2, THUMB_SIZE - 2, TFT_WHITE);
+  }
+  invalidateRect(x, y, THUMB_SIZE, THUMB_SIZE);
+  return drawn;
+}
 
-      //Serial.printf("Start: %i\ti: %i\tfile_index: %i\tEnd: %i\n", start, i, file_index, end);
+void drawGallery(){
+  // Thumbnail grid of the photos with the selected one outlined, its name in the bar below
+  // Only sidecars are read, a few cells per call with the selected cell first, so moving never waits on a page of reads
+  // Photos marked for a batch delete get a red dot. While a batch is being deleted the cells are left alone and
+  // the bar counts down, the grid is redrawn once it's done
+
+  static const int cells = GALLERY_COLS * GALLERY_ROWS;
+  static int start = 0;                         // File in the top left cell, a multiple of GALLERY_COLS
+  static int cell_index[GALLERY_COLS * GALLERY_ROWS];     // File drawn in each cell, -1 when it needs drawing
+  static bool cell_waiting[GALLERY_COLS * GALLERY_ROWS];  // Placeholder up, sidecar being backfilled
+  static int highlighted = -1;
+  static uint32_t seen_backfills = 0;
+  static int bar_h = SCREEN_HEIGHT - (STATUS_BAR_HEIGHT + GALLERY_ROWS * THUMB_SIZE);
+  static uint32_t bg_color = TFT_DARKGREY;
+  static uint32_t highlight_color = TFT_WHITE;
+  static uint32_t text_color = TFT_WHITE;
 
-      String filename = filenames[i];
+  bool redraw = prev_file_index == -1;          // Entered, back from the viewer, or a file was deleted
+  static int shown_files = -1;
+  const uint32_t deletes_left = deletes_queued - deletes_done;
+  if (num_files != shown_files && !deletes_left){   // Photos saved in the background shift nothing, but fill cells
+    shown_files = num_files;
+    redraw = true;
+  }
 
-      tft.fillRect(0, STATUS_BAR_HEIGHT + h * (i - start), w, h, bg_color);
-      tft.setTextColor(text_color, bg_color);                                            // background of text same as rectangle
-      tft.setTextDatum(MC_DATUM);                                                       // middle-center alignment
-      tft.drawString(String(i) + ":  " + filename, 120, STATUS_BAR_HEIGHT + h * (i - start) + h / 2);    
+  const int selected = constrain(file_index, 0, max(num_files - 1, 0));   // A delete may leave file_index one past the end
+  int new_start = start;
+  if (selected < start){
+    new_start = selected / GALLERY_COLS * GALLERY_COLS;
+  } else if (selected >= start + cells){
+    new_start = (selected / GALLERY_COLS - GALLERY_ROWS + 1) * GALLERY_COLS;
+  }
+  static bool page_filling = false;
+  static uint32_t page_start_ms = 0;
+  if (new_start != start || redraw){
+    start = new_start;
+    for (int i = 0; i < cells; i++){
+      cell_index[i] = -1;
+      cell_waiting[i] = false;
+    }
+    highlighted = -1;
+    page_filling = true;
+    page_start_ms = millis();
+  }
 
-      if (file_index == i){
-        tft.drawRect(0, STATUS_BAR_HEIGHT + h * (i - start), w, h, highlight_color);    // Draw outline highlighted
+  static int shown_marks = 0;
+  if (marked_files.count != shown_marks){       // One mark toggled on the selected photo, or all of them dropped/ deleted
+    for (int i = 0; i < cells; i++){
+      if (abs(marked_files.count - shown_marks) > 1 || i == selected - start){
+        cell_index[i] = -1;
       }
-      else{
-        tft.drawRect(0, STATUS_BAR_HEIGHT + h * (i - start), w, h, outline_color);      // Draw outline
+    }
+    shown_marks = marked_files.count;
+  }
+
+  if (thumbnailsBackfilled() != seen_backfills){  // Try the placeholders again
+    seen_backfills = thumbnailsBackfilled();
+    for (int i = 0; i < cells; i++){
+      if (cell_waiting[i]){
+        cell_index[i] = -1;
       }
     }
-    prev_file_index = file_index;
   }
-}
 
-void drawImageViewer(){
-  //
+  static uint32_t shown_bar = 0;                // What the second line of the bar was drawn for
+  const uint32_t bar_state = deletes_left ? deletes_left : gallery_marking ? 0x10000 | marked_files.count : 0x20000;
+  const bool bar_changed = bar_state != shown_bar;
+  shown_bar = bar_state;
 
-  if (!image_shown){
-  Serial.printf("Opening file at index: %i\tWith name: %s\n", file_index, filenames[file_index].c_str());
-  
-  fs::File file = SD_MMC.open(filenames[file_index], FILE_READ);
+  const bool moved = highlighted != selected;
+  if (moved){
+    if (highlighted >= start && highlighted < start + cells){
+      cell_index[highlighted - start] = -1;     // Redrawn from its sidecar without the outline
+    }
+    const int cell = selected - start;
+    if (cell_index[cell] >= 0){
+      const int x = (cell % GALLERY_COLS) * THUMB_SIZE;
+      const int y = STATUS_BAR_HEIGHT + (cell / GALLERY_COLS) * THUMB_SIZE;
+      canvas.drawRect(x, y, THUMB_SIZE, THUMB_SIZE, highlight_color);
+      canvas.drawRect(x + 1, y + 1, THUMB_SIZE - 2, THUMB_SIZE - 2, highlight_color);
+      invalidateRect(x, y, THUMB_SIZE, THUMB_SIZE);
+    }
+    highlighted = selected;
+  }
 
-  uint16_t row[IMAGE_WIDTH]; // 480 bytes on stack (better than holding 115 kB or allocating from heap)
+  if (moved || bar_changed){
+    // Name of the selected photo and where it is in the list, or how the batch delete is going
+    char filename[MAX_FILENAME_LENGTH];
+    lockFileIndex();
+    strncpy(filename, getName(&filenames, selected), MAX_FILENAME_LENGTH - 1);
+    unlockFileIndex();
+    filename[MAX_FILENAME_LENGTH - 1] = '\0';
+
+    const int bar_y = STATUS_BAR_HEIGHT + GALLERY_ROWS * THUMB_SIZE;
+    canvas.fillRect(0, bar_y, SCREEN_WIDTH, bar_h, bg_color);
+    canvas.setTextDatum(MC_DATUM);
+    canvas.setTextColor(text_color, bg_color);
+    if (deletes_left){
+      canvas.drawString("Deleting, " + String(deletes_left) + " left", SCREEN_WIDTH / 2, bar_y + bar_h / 2);
+    } else if (num_files > 0){
+      canvas.drawString(filename + 1, SCREEN_WIDTH / 2, bar_y + bar_h / 3);
+      canvas.drawString(gallery_marking ? String(marked_files.count) + " marked, hold SELECT to delete" :
+                        String(selected + 1) + " / " + String(num_files), SCREEN_WIDTH / 2, bar_y + bar_h * 2 / 3);
+    } else{
+      canvas.drawString("No photos", SCREEN_WIDTH / 2, bar_y + bar_h / 2);
+    }
+    invalidateRect(0, bar_y, SCREEN_WIDTH, bar_h);
+  }
 
-  for (int y = 0; y < IMAGE_HEIGHT; y++) {           // Display row by row
-      file.read((uint8_t*)row, IMAGE_WIDTH * 2);
-      tft.pushImage(0, STATUS_BAR_HEIGHT + y, IMAGE_WIDTH, 1, row);
+  // Cells for up to GALLERY_FILL_MS per call, the selected one before the rest
+  const uint32_t fill_start = millis();
+  while (!deletes_left) {
+    int cell = selected - start;
+    if (cell_index[cell] >= 0){
+      for (cell = 0; cell < cells && cell_index[cell] >= 0; cell++){}
+    }
+    if (cell == cells){
+      if (page_filling){
+        Serial.printf("Gallery page drawn in %lu ms\n", millis() - page_start_ms);
+        page_filling = false;
+      }
+      break;
+    }
+    cell_waiting[cell] = !drawGalleryCell(cell, start + cell, start + cell == selected, cell_waiting[cell]);
+    cell_index[cell] = start + cell;
+    if (millis() - fill_start >= GALLERY_FILL_MS){
+      break;
+    }
   }
-  file.close();
 
-  // Draw option to delete from SD
+  prev_file_index = file_index;
+}
+
+int viewerTile(int zoom, int row, int col){
+  return row * zoom + (row % 2 ? zoom - 1 - col : col);
+}
+
+void viewerTileCell(int zoom, int tile, int *row, int *col){
+  *row = tile / zoom;
+  *col = *row % 2 ? zoom - 1 - tile % zoom : tile % zoom;
+}
+
+static void drawViewerBar(){
+  // Draw option to delete from SD, with the position in the list and the zoom under it
   static int option_w = SCREEN_WIDTH, option_h = SCREEN_HEIGHT - IMAGE_HEIGHT - STATUS_BAR_HEIGHT;
   static uint32_t bg_color = TFT_RED;
-  static uint32_t outline_color = TFT_BLUE;
   static uint32_t highlight_color = TFT_WHITE;
   static uint32_t text_color = TFT_WHITE;
 
   tft.fillRect(0, STATUS_BAR_HEIGHT + IMAGE_HEIGHT, option_w, option_h, bg_color);
   tft.drawRect(0, STATUS_BAR_HEIGHT + IMAGE_HEIGHT, option_w, option_h, highlight_color);
 
+  String position = String(file_index + 1) + " / " + String(num_files) + "   ";
+  if (viewer_zoom > 1){
+    position += "Zoom " + String(viewer_zoom) + "x  part " + String(viewer_tile + 1) + " / " + String(viewer_zoom * viewer_zoom);
+  } else{
+    position += "Cache hits " + String(viewer_cache_stats.hits) + "  misses " + String(viewer_cache_stats.misses);
+  }
+
   tft.setTextDatum(MC_DATUM);
   tft.setTextColor(text_color, bg_color);
-  tft.drawString("DELETE FROM SD CARD", option_w / 2, STATUS_BAR_HEIGHT + IMAGE_HEIGHT + option_h/2);
+  tft.drawString("HOLD SELECT TO DELETE FROM SD", option_w / 2, STATUS_BAR_HEIGHT + IMAGE_HEIGHT + option_h/3);
+  tft.drawString(position, option_w / 2, STATUS_BAR_HEIGHT + IMAGE_HEIGHT + option_h*2/3);
+}
+
+static ImageReader viewer_reader;               // Decoder state and its SD chunk, too big for the task stack
+
+static void sampleRow565(const uint16_t *src, uint16_t *dst, int width, uint32_t step){
+  // Nearest neighbour, step is source pixels per output pixel in 16.16
+  uint32_t pos = step / 2;
+  for (int x = 0; x < width; x++, pos += step){
+    dst[x] = src[pos >> 16];
+  }
+}
+
+static void drawZoomedImage(const CachedImage *image, int zoom, int tile){
+  // The photo is cut into zoom x zoom parts and the chosen one is scaled to fit the screen, DMA_STRIP_ROWS output
+  // rows at a time. Each strip is scaled straight into a DMA buffer while the one before it is being sent
+  // Stills the cache holds shrunk are streamed from the file instead, so zooming shows their full resolution:
+  // rows above the part are decoded and thrown away, the part's rows go through one row buffer
+
+  static uint16_t source_row[STILL_WIDTH];
+  const uint32_t start = millis();
+  ImageReader *reader = NULL;
+  int img_w = image->width, img_h = image->height;
+  if (zoom > 1 && image->shrink > 1 && image->name[0]){
+    if (openImage(&viewer_reader, image->name) && viewer_reader.header.width <= STILL_WIDTH){
+      reader = &viewer_reader;
+      img_w = reader->header.width;
+      img_h = reader->header.height;
+    } else{
+      closeImage(&viewer_reader);
+      Serial.println("Full size photo unreadable, zooming the shrunk copy");
+    }
+  }
+
+  int row, col;
+  viewerTileCell(zoom, tile, &row, &col);
+  const int src_w = max(img_w / zoom, 1), src_h = max(img_h / zoom, 1);     // Photo pixels of the part
+  const int x0 = min(col * src_w, img_w - src_w), y0 = min(row * src_h, img_h - src_h);
+  int out_w = IMAGE_WIDTH, out_h = IMAGE_HEIGHT;                            // Fitted, keeping its shape
+  if (zoom == 1){                                                           // Back to the whole photo as it was first shown
+    out_w = min(src_w, IMAGE_WIDTH);
+    out_h = min(src_h, IMAGE_HEIGHT);
+  } else if (src_w * IMAGE_HEIGHT > src_h * IMAGE_WIDTH){
+    out_h = src_h * IMAGE_WIDTH / src_w;
+  } else{
+    out_w = src_w * IMAGE_HEIGHT / src_h;
+  }
+  tft.fillRect(out_w, STATUS_BAR_HEIGHT, IMAGE_WIDTH - out_w, out_h, TFT_BLACK);
+  tft.fillRect(0, STATUS_BAR_HEIGHT + out_h, IMAGE_WIDTH, IMAGE_HEIGHT - out_h, TFT_BLACK);
+
+  const int factor = out_w / src_w;
+  const bool whole_factor = !reader && out_w == src_w * factor && out_h == src_h * factor && factor <= DMA_STRIP_ROWS;
+  const uint32_t step = ((uint32_t)src_w << 16) / out_w;
+  bool ok = true;
+
+  tft.startWrite();
+  if (whole_factor){                            // The usual 240x240 frame, upscaled a block of rows at a time
+    const int strip_src_rows = DMA_STRIP_ROWS / factor;
+    for (int y = 0; y < src_h; y += strip_src_rows){
+      const int rows = min(strip_src_rows, src_h - y);
+      uint16_t *strip = dma_buffers[next_dma_buffer];
+      upscale565(image->pixels + (y0 + y) * image->width + x0, image->width, strip, src_w, rows, factor);
+      tft.pushImageDMA(0, STATUS_BAR_HEIGHT + y * factor, out_w, rows * factor, strip);
+      next_dma_buffer ^= 1;                     // Written only after the strip sent from it two pushes ago is done
+    }
+  } else{
+    for (int y = 0; y < out_h && ok; y += DMA_STRIP_ROWS){
+      const int rows = min(DMA_STRIP_ROWS, out_h - y);
+      uint16_t *strip = dma_buffers[next_dma_buffer];
+      int done = 0;
+      for (; done < rows; done++){
+        const int sy = y0 + (y + done) * src_h / out_h;
+        const uint16_t *src = image->pixels + sy * image->width;
+        if (reader){
+          while (ok && reader->rows_read <= sy){
+            ok = readImageRows(reader, source_row, 1) == 1;
+          }
+          if (!ok){
+            break;
+          }
+          src = source_row;
+        }
+        sampleRow565(src + x0, strip + done * out_w, out_w, step);
+      }
+      if (done){
+        tft.pushImageDMA(0, STATUS_BAR_HEIGHT + y, out_w, done, strip);
+      }
+      next_dma_buffer ^= 1;
+    }
+  }
+  tft.endWrite();
+  if (reader){
+    closeImage(reader);
+  }
+  if (!ok){
+    Serial.println("Image unreadable");
+  }
+  Serial.printf("Zoom %ix part %i of %ix%i drawn in %lu ms%s\n", zoom, tile + 1, img_w, img_h,
+                (unsigned long)(millis() - start), reader ? " from the file" : "");
+}
+
+void drawImageViewer(){
+  // Shows the photo at file_index from the viewer cache, or decodes it into the cache strip by strip. Each strip
+  // goes out by DMA from one of the two internal strip buffers while the next is read and decoded, so the SD
+  // and the SPI bus work at the same time. Its neighbours are then handed to prefetchTask, so UP/ DOWN usually hit.
+  // Zoomed views are cut from the pinned cache slot, so panning never goes back to the SD, except for stills
+  // the cache holds shrunk, which are zoomed from the file
+
+  static CachedImage *shown = NULL;             // Pinned while on screen
+  static int drawn_zoom = 1, drawn_tile = 0;
+
+  if (image_shown && shown && (viewer_zoom != drawn_zoom || viewer_tile != drawn_tile)){
+    drawZoomedImage(shown, viewer_zoom, viewer_tile);
+    drawn_zoom = viewer_zoom;
+    drawn_tile = viewer_tile;
+    drawViewerBar();
+  }
+
+  if (!image_shown){
+  detachContent();                              // Frames are pushed straight to the tft
+  char filename[MAX_FILENAME_LENGTH], prev_name[MAX_FILENAME_LENGTH], next_name[MAX_FILENAME_LENGTH];
+  lockFileIndex();
+  snprintf(filename, sizeof(filename), "%s", getName(&filenames, file_index));
+  snprintf(prev_name, sizeof(prev_name), "%s", getName(&filenames, file_index - 1));    // "" past either end
+  snprintf(next_name, sizeof(next_name), "%s", getName(&filenames, file_index + 1));
+  unlockFileIndex();
+  Serial.printf("Opening file at index: %i\tWith name: %s\n", file_index, filename);
+
+  if (shown){
+    unpinCachedImage(shown);
+  }
+  const uint32_t show_start = millis();
+  const uint32_t hits_before = viewer_cache_stats.hits;
+  shown = findCachedImage(filename);
+  const char *source = viewer_cache_stats.hits != hits_before ? "cache hit" : shown ? "waited on prefetch" : "read from SD";
+
+  if (shown){
+    if (shown->width < IMAGE_WIDTH || shown->height < IMAGE_HEIGHT){
+      tft.fillRect(0, STATUS_BAR_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_BLACK);     // Shrunk still, or smaller than the screen
+    }
+    tft.pushImage(0, STATUS_BAR_HEIGHT, shown->width, shown->height, shown->pixels);     // Memory to SPI, no SD
+  } else{
+    ImageReader &reader = viewer_reader;
+    shown = claimCachedImage(filename);
+    bool ok = shown && openImage(&reader, filename);
+
+    if (!ok){
+      Serial.println("Failed to open image");
+    } else{
+      const int rows = cachedImageRows(&reader.header);
+      if (reader.header.width < IMAGE_WIDTH || rows < IMAGE_HEIGHT){
+        tft.fillRect(0, STATUS_BAR_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_BLACK);
+      }
+      uint32_t read_ms = 0;
+      tft.startWrite();
+      while (ok && shown->height < rows){       // Display strip by strip as it decodes
+        const int y = shown->height;
+        const uint32_t read_start = millis();
+        ok = decodeCachedImage(shown, &reader, DMA_STRIP_ROWS);
+        read_ms += millis() - read_start;
+        if (shown->height > y){
+          tft.pushImageDMA(0, STATUS_BAR_HEIGHT + y, shown->width, shown->height - y, shown->pixels + y * shown->width, dma_buffers[next_dma_buffer]);
+          next_dma_buffer ^= 1;                 // The strip just queued keeps its buffer until the next one is copied
+        }
+      }
+      tft.endWrite();                           // Waits for the last strip
+      Serial.printf("Read and decoded in %lu ms, %i strips\n", (unsigned long)read_ms, (rows + DMA_STRIP_ROWS - 1) / DMA_STRIP_ROWS);
+      if (!ok){
+        Serial.println("Image unreadable");
+      }
+      closeImage(&reader);
+    }
+    if (shown){
+      finishCachedImage(shown, ok);
+    }
+    if (!ok){
+      tft.fillRect(0, STATUS_BAR_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT, TFT_BLACK);    // Not the last photo under this one's name
+      shown = NULL;
+    }
+  }
+  Serial.printf("Shown in %lu ms (%s)\n", (unsigned long)(millis() - show_start), source);
+  setPrefetchTargets(prev_name, next_name);
+  drawn_zoom = 1;
+  drawn_tile = 0;
+  drawViewerBar();
 
   image_shown = true;
   }
 }
 
-void drawGraph(int x_c[], int y_c[], int len, int y_min, int y_max, int x, int y, int w, int h, char* x_label, char* y_label, char* title, uint32_t color){
-  // Draws a graph on screen given start x, y, width, height, points, labels, line color
+// Strip chart geometry, the plot sits inside the outline with room for the axis labels
+static const int chart_offset = 20;                 // Offset from outline and x,y axis lines
+
+static int chartAxisX(const StripChart *c){ return c->x + chart_offset; }
+static int chartAxisEndX(const StripChart *c){ return c->x + c->w - chart_offset; }
+static int chartTopY(const StripChart *c){ return c->y + chart_offset / 2; }
+static int chartAxisY(const StripChart *c){ return c->y + c->h - chart_offset; }
+
+static int chartColumnX(const StripChart *c, int col){
+  return chartAxisX(c) + (col + 1) * c->spacing;    // Column 0 sits one step right of the y axis
+}
+
+static int chartValueY(const StripChart *c, int value){
+  // Integer mapping onto the plot rows, which stop one pixel above the x axis
+  const int range = max(c->y_max - c->y_min, 1);
+  const int rows = chartAxisY(c) - chartTopY(c) - 1;
+  value = constrain(value, c->y_min, c->y_max);
+  return chartAxisY(c) - 1 - (value - c->y_min) * rows / range;
+}
+
+static void eraseChartColumns(const StripChart *c, int x0, int x1){
+  // Clears plot columns x0..x1 (inclusive) without touching the axes
+  x1 = min(x1, chartAxisEndX(c));
+  canvas.fillRect(x0, chartTopY(c), x1 - x0 + 1, chartAxisY(c) - chartTopY(c), TFT_BLACK);
+}
+
+static void drawChartChrome(const StripChart *c){
+  // Outline, axes, title, labels and ticks. Only drawn on init and when the range changes
 
-  // ==================== Constants ====================
   const uint32_t bg_color = TFT_BLACK;
   const uint32_t graph_color = TFT_WHITE;
   const uint32_t text_color = TFT_WHITE;
-  const uint32_t line_color = color;  
 
-  const int graph_offset = 20;                    // Offset from outline and x,y axis lines
-  const int x_axis_start = x + graph_offset;
-  const int x_axis_end = x + w - graph_offset;
-  const int y_axis_start = y + graph_offset / 2;
-  const int y_axis_end = y + h - graph_offset;
+  const int x_axis_start = chartAxisX(c);
+  const int x_axis_end = chartAxisEndX(c);
+  const int y_axis_start = chartTopY(c);
+  const int y_axis_end = chartAxisY(c);
 
   const int num_x_ticks = 10;
   const int num_y_ticks = 4;
 
   // ==================== General Structure ====================
-  tft.fillRect(x, y, w, h, bg_color);
-  tft.drawRect(x, y, w, h, graph_color);          // Outline of graph
-  tft.drawLine(x_axis_start, y_axis_start, x_axis_start, y_axis_end, graph_color);  // x and y axis lines
-  tft.drawLine(x_axis_start, y_axis_end, x_axis_end, y_axis_end, graph_color);
+  canvas.fillRect(c->x, c->y, c->w, c->h, bg_color);
+  canvas.drawRect(c->x, c->y, c->w, c->h, graph_color);          // Outline of graph
+  canvas.drawLine(x_axis_start, y_axis_start, x_axis_start, y_axis_end, graph_color);  // x and y axis lines
+  canvas.drawLine(x_axis_start, y_axis_end, x_axis_end, y_axis_end, graph_color);
 
-  tft.setTextColor(text_color, bg_color);
-  tft.setTextDatum(MC_DATUM);
-  tft.drawString(title, x + w / 2, y);            // Title in top middle of graph area
-  tft.drawString(x_label, x + w / 2, y + h);      // x label in bottom middle of graph area
-  tft.drawString(y_label, x, y + h / 2);          // y label in left center of graph area
+  canvas.setTextColor(text_color, bg_color);
+  canvas.setTextDatum(MC_DATUM);
+  canvas.drawString(c->title, c->x + c->w / 2, c->y);            // Title in top middle of graph area
+  canvas.drawString(c->x_label, c->x + c->w / 2, c->y + c->h);   // x label in bottom middle of graph area
+  canvas.drawString(c->y_label, c->x, c->y + c->h / 2);          // y label in left center of graph area
 
   // ==================== x tick values ====================
-  // Assumes that input x are increasing values ex: 1,2,3,4,5,6....
-  const int num_pixels_x_axis = x_axis_end - x_axis_start;           // Number of pixels in x-axis
-  const int spacing_x = num_pixels_x_axis / (num_x_ticks - 1);
+  // Sample position along the sweep, 1 to len
+  const int spacing_x = (x_axis_end - x_axis_start) / (num_x_ticks - 1);
 
   for (int i = 1; i <= num_x_ticks; i++){
-
-    int index = (i - 1) * len / num_x_ticks;
     int _x = x_axis_start + (i - 1) * spacing_x;
-    int _y = y_axis_end + graph_offset / 3;
-    tft.drawNumber(x_c[index], _x, _y);         
-    //Serial.printf("Index: %i\tNum: %i\tx: %i\ty: %i\n", index, x_c[index], _x, _y);
+    int _y = y_axis_end + chart_offset / 3;
+    canvas.drawNumber((i - 1) * c->len / num_x_ticks + 1, _x, _y);
   }
 
   // ==================== y tick values ====================
-  const int num_pixels_y_axis = y_axis_end - y_axis_start;                  // Number of pixels in y axis
-  const int spacing_y = num_pixels_y_axis / (num_y_ticks - 1);
-  const int y_coord_range = y_max - y_min;                          // Range of y coordinate points
-  const int tick_val_spacing = y_coord_range / (num_y_ticks - 1);
+  const int spacing_y = (y_axis_end - y_axis_start) / (num_y_ticks - 1);
+  const int tick_val_spacing = (c->y_max - c->y_min) / (num_y_ticks - 1);
 
   for (int i = 1; i <= num_y_ticks; i++){
-
-    int _x = x_axis_start - graph_offset / 3;
+    int _x = x_axis_start - chart_offset / 3;
     int _y = y_axis_end - (i - 1) * spacing_y;
-    int tick_val = y_min + (i - 1) * tick_val_spacing;
-    tft.drawNumber(tick_val, _x, _y);
-    //Serial.printf("Tick value: %i\tx: %i\ty: %i\n", tick_val, _x, _y);
+    canvas.drawNumber(c->y_min + (i - 1) * tick_val_spacing, _x, _y);
   }
+}
 
-  // ==================== Point mapping ====================
-  const int x_point_spacing = num_pixels_x_axis / len;       // How far apart in pixels each point will be
+static void drawChartSegment(const StripChart *c, int col){
+  // Wipes the old trace from this column up to the next one (the gap ahead of the sweep),
+  // then joins the previous sample to this one. Nothing joins across the wrap
+  eraseChartColumns(c, chartColumnX(c, col), chartColumnX(c, col + 1));
+  if (col > 0){
+    canvas.drawLine(chartColumnX(c, col - 1), chartValueY(c, c->values[col - 1]),
+                    chartColumnX(c, col), chartValueY(c, c->values[col]), c->color);
+  }
+}
 
-  // Start at first one
-  int prev_x = x_axis_start;
-  int prev_y = y_axis_end - ((y_c[0] - y_min) / (float)y_coord_range * num_pixels_y_axis);
+void initStripChart(StripChart *chart, int x, int y, int w, int h, int len, int y_min, int y_max, char *x_label, char *y_label, char *title, uint32_t color){
+  // Sweep style chart: samples are written left to right at a moving column and wrap at len,
+  // so each new sample only redraws a few columns instead of shifting the whole plot
+  // len can't exceed NUM_SYS_DATA_POINTS
+
+  chart->x = x;
+  chart->y = y;
+  chart->w = w;
+  chart->h = h;
+  chart->len = min(len, NUM_SYS_DATA_POINTS);
+  chart->spacing = (w - 2 * chart_offset) / chart->len;
+  chart->y_min = y_min;
+  chart->y_max = y_max;
+  chart->count = 0;
+  chart->newest = -1;
+  chart->x_label = x_label;
+  chart->y_label = y_label;
+  chart->title = title;
+  chart->color = color;
+
+  drawChartChrome(chart);
+  invalidateRect(x - chart_offset / 2, y - 4, w + chart_offset, h + 8);    // Labels centred on the outline stick out of it
+}
 
-  for (int i = 1; i < len; i++){
+void pushStripChart(StripChart *chart, int value){
+  // Appends one sample at the sweep position, touching only the columns around it
 
-    int _x = x_axis_start + i * x_point_spacing;
-    int _y = y_axis_end - ((y_c[i] - y_min) / (float)y_coord_range * num_pixels_y_axis);
+  const int col = (chart->newest + 1) % chart->len;
+  chart->values[col] = value;
+  chart->newest = col;
+  if (chart->count < chart->len){
+    chart->count++;
+  }
 
-    tft.drawLine(prev_x, prev_y, _x, _y, line_color);     // Draw line from prev point to current
-    //Serial.printf("x: %i\ty: %i\t\n", _x, _y);
+  drawChartSegment(chart, col);
 
-    prev_x = _x;
-    prev_y = _y;
+  int x0 = chartColumnX(chart, max(col - 1, 0));
+  int x1 = min(chartColumnX(chart, col + 1), chartAxisEndX(chart));
+  invalidateRect(x0, chartTopY(chart), x1 - x0 + 1, chartAxisY(chart) - chartTopY(chart));
+}
+
+void setStripChartRange(StripChart *chart, int y_min, int y_max){
+  // Rescales the chart, the chrome and every sample are redrawn only when the range actually changed
+
+  if (chart->y_min == y_min && chart->y_max == y_max){
+    return;
+  }
+  chart->y_min = y_min;
+  chart->y_max = y_max;
+
+  drawChartChrome(chart);
+
+  // Replot the same picture the sweep would have left: every segment except the one after the newest sample
+  for (int col = 1; col < chart->count; col++){
+    if (col - 1 != chart->newest){
+      canvas.drawLine(chartColumnX(chart, col - 1), chartValueY(chart, chart->values[col - 1]),
+                      chartColumnX(chart, col), chartValueY(chart, chart->values[col]), chart->color);
+    }
   }
+  if (chart->newest + 1 < chart->count){
+    eraseChartColumns(chart, chartColumnX(chart, chart->newest + 1), chartColumnX(chart, chart->newest + 1));
+  }
+
+  invalidateRect(chart->x - chart_offset / 2, chart->y - 4, chart->w + chart_offset, chart->h + 8);
 }
 
 void initGame1(TFT_eSprite* paddle, TFT_eSprite* ball, TFT_eSprite bricks[]){
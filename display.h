@@ -17,17 +17,37 @@ void drawStatusBar();
 
 void drawSystemData();
 
+void updateSystemData();
+
+void drawSdBench();                         // Title and column headings, call once when entering the screen
+
+void updateSdBench();                       // Rows for the steps finished since the last call, and the status line
+
 void drawWifi();
 
 void drawCameraFeed();
 
-void drawCameraButton();
+void stopCameraFeed();
+
+void flashCameraFeed();
+
+void drawCameraButton(bool force);          // Mode and captured/ pending/ dropped counts, redrawn only on change unless forced
+
+void drawFiles();                           // Day list with photo counts, from the day index in file_index.h
+
+void drawGallery();                         // Thumbnail grid, fills in a few cells per call
+
+void drawImageViewer();                     // Loads the photo when image_shown is cleared, redraws when the zoom or tile changes
+
+int viewerTile(int zoom, int row, int col);                 // Tiles run left to right, then right to left on the next row, so UP/ DOWN pan to a neighbour
+
+void viewerTileCell(int zoom, int tile, int *row, int *col);
 
-void drawFiles();
+void initStripChart(StripChart *chart, int x, int y, int w, int h, int len, int y_min, int y_max, char *x_label, char *y_label, char *title, uint32_t color);
 
-void drawImageViewer();
+void pushStripChart(StripChart *chart, int value);
 
-void drawGraph(int x_c[], int y_c[], int len, int y_min, int y_max, int x, int y, int w, int h, char *x_label, char *y_label, char *title, uint32_t color);
+void setStripChartRange(StripChart *chart, int y_min, int y_max);
 
 void initGame1(TFT_eSprite *paddle, TFT_eSprite *ball, TFT_eSprite bricks[]);
 
@@ -0,0 +1,300 @@
+#include <SD_MMC.h>
+#include "file_index.h"
+#include "helpers.h"
+#include "name_table.h"
+#include "block_cache.h"
+
+
+static const char index_header[] = "MBINDEX 1\n";
+static const size_t index_header_len = sizeof(index_header) - 1;
+
+static SemaphoreHandle_t index_mutex = NULL;        // Guards filenames/ num_files and the days, never held across card I/O
+static SemaphoreHandle_t writes_mutex = NULL;       // Held across every change to the list, the photos and the index file
+static int index_removed = 0;                       // Removal lines in the log since it was last rewritten
+static uint16_t *day_starts = NULL;                 // First file of each day, NAME_TABLE_ENTRIES + 1 entries in PSRAM
+static int num_days = 0;
+static char *pending_removals = NULL;               // "-/name\n" lines not in the index file yet, PSRAM
+static size_t pending_len = 0;
+static int pending_count = 0;
+
+void lockFileIndex(){
+  xSemaphoreTake(index_mutex, portMAX_DELAY);
+}
+
+void unlockFileIndex(){
+  xSemaphoreGive(index_mutex);
+}
+
+void lockIndexWrites(){
+  xSemaphoreTake(writes_mutex, portMAX_DELAY);
+}
+
+void unlockIndexWrites(){
+  xSemaphoreGive(writes_mutex);
+}
+
+// ============================= Days =============================
+static int nextDayStart(int index){
+  // Names of one day share their first 11 characters, "/YYYY-MM-DD", whether in a day directory or the root
+  char key[DAY_NAME_LENGTH + 2];
+  snprintf(key, sizeof(key), "%.11s\xff", getName(&filenames, index));
+  return max(lowerBoundName(&filenames, key), index + 1);
+}
+
+static void rebuildDays(){
+  // Call with both mutexes held, after any change to filenames. One binary search per day
+  num_days = 0;
+  for (int i = 0; i < filenames.count; i = nextDayStart(i)){
+    day_starts[num_days++] = i;
+  }
+  day_starts[num_days] = filenames.count;
+}
+
+int numDays(){
+  return num_days;
+}
+
+int dayStart(int day){
+  return day >= 0 && day < num_days ? day_starts[day] : num_files;
+}
+
+int dayOfFile(int index){
+  int lo = 0, hi = num_days - 1;                    // Last day starting at or before index
+  while (lo < hi){
+    const int mid = (lo + hi + 1) / 2;
+    if (day_starts[mid] <= index){
+      lo = mid;
+    } else{
+      hi = mid - 1;
+    }
+  }
+  return max(lo, 0);
+}
+
+void dayName(int day, char *name){
+  snprintf(name, DAY_NAME_LENGTH, "%s", day >= 0 && day < num_days ? getName(&filenames, day_starts[day]) + 1 : "");
+}
+
+static void removeEmptyDayDir(const char *name){
+  // Call with writes_mutex held, after name left the list. Its directory goes once no listed file is in it,
+  // only the names of that day are looked at (root photos of the same day sort in between)
+  const char *slash = strrchr(name, '/');
+  if (!slash || slash == name){
+    return;                                         // In the root
+  }
+  char dir[MAX_FILENAME_LENGTH], key[DAY_NAME_LENGTH + 2];
+  snprintf(dir, sizeof(dir), "%.*s/", (int)(slash - name), name);
+  snprintf(key, sizeof(key), "%.11s\xff", name);
+  const int end = lowerBoundName(&filenames, key);
+  key[DAY_NAME_LENGTH] = '\0';
+
+  for (int i = lowerBoundName(&filenames, key); i < end; i++){
+    if (!strncmp(getName(&filenames, i), dir, strlen(dir))){
+      return;
+    }
+  }
+  dir[strlen(dir) - 1] = '\0';
+  SD_MMC.rmdir(dir);
+}
+
+// ============================= Index file =============================
+static bool writeIndex(){
+  // Rewrites the log as one + line per file. Goes through a temporary file, so a reset leaves the old
+  // index or none (and a rescan), never half of one. Lines go out in chunks straight from the name table,
+  // which only changes under writes_mutex, so the display keeps reading it meanwhile
+  bool ok = false;
+  fs::File file = SD_MMC.open(FILE_INDEX_TMP_PATH, FILE_WRITE);
+  if (file){
+    char chunk[512];
+    size_t len = snprintf(chunk, sizeof(chunk), "%s", index_header);
+    ok = true;
+    for (int i = 0; i < filenames.count && ok; i++){
+      if (len + MAX_FILENAME_LENGTH + 2 > sizeof(chunk)){
+        ok = file.write((const uint8_t *)chunk, len) == len;
+        len = 0;
+      }
+      len += snprintf(chunk + len, sizeof(chunk) - len, "+%s\n", getName(&filenames, i));
+    }
+    ok = ok && file.write((const uint8_t *)chunk, len) == len;
+    file.close();
+    SD_MMC.remove(FILE_INDEX_PATH);
+    ok = ok && SD_MMC.rename(FILE_INDEX_TMP_PATH, FILE_INDEX_PATH);
+  }
+  if (ok){
+    index_removed = 0;
+    pending_len = 0;                                // Already left out
+    pending_count = 0;
+  }
+  return ok;
+}
+
+static bool appendLines(const char *lines, size_t len){
+  // An index that can't be updated is removed so the next boot rescans
+  bool ok = false;
+  fs::File file = SD_MMC.open(FILE_INDEX_PATH, FILE_APPEND);
+  if (file){
+    ok = file.write((const uint8_t *)lines, len) == len;
+    file.close();
+  }
+  if (!ok){
+    SD_MMC.remove(FILE_INDEX_PATH);
+  }
+  return ok;
+}
+
+static bool appendIndex(char op, const char *name){
+  // One short append per added file
+  char line[MAX_FILENAME_LENGTH + 2];
+  const int len = snprintf(line, sizeof(line), "%c%s\n", op, name);
+  if (len >= (int)sizeof(line)){
+    SD_MMC.remove(FILE_INDEX_PATH);
+    return false;
+  }
+  return appendLines(line, len);
+}
+
+static void flushRemovals(bool compact){
+  // Call with writes_mutex held. Mostly removals by now, start the log over instead if allowed to, a rewrite
+  // is a line per file, so saves and a batch still going only ever append
+  if (!pending_count){
+    return;
+  }
+  if (compact && index_removed > num_files){
+    writeIndex();
+  } else{
+    appendLines(pending_removals, pending_len);
+  }
+  pending_len = 0;
+  pending_count = 0;
+}
+
+void flushIndexRemovals(bool compact){
+  flushRemovals(compact);
+}
+
+static bool replayIndex(){
+  // Rebuilds filenames from the log, false if the log doesn't hold up
+  fs::File file = SD_MMC.open(FILE_INDEX_PATH, FILE_READ);
+  if (!file){
+    return false;
+  }
+  const size_t size = file.size();
+  char *text = (char *)ps_malloc(size + 1);
+  bool ok = text && file.read((uint8_t *)text, size) == size;
+  file.close();
+
+  // A reset mid append leaves the last line without its newline
+  ok = ok && size >= index_header_len && !memcmp(text, index_header, index_header_len) && text[size - 1] == '\n';
+
+  clearNames(&filenames);
+  int removed = 0;
+  for (size_t pos = index_header_len; ok && pos < size;){
+    char *line = text + pos;
+    char *eol = (char *)memchr(line, '\n', size - pos);
+    *eol = '\0';
+    pos = eol - text + 1;
+
+    const char *name = line + 1;
+    const size_t len = strlen(name);
+    if (line[0] == '+' && len > 1 && len < MAX_FILENAME_LENGTH){
+      ok = insertName(&filenames, name);
+    } else if (line[0] == '-'){
+      const int i = findName(&filenames, name);
+      ok = i >= 0;
+      if (ok){
+        removeName(&filenames, i);
+        removed++;
+      }
+    } else{
+      ok = false;
+    }
+  }
+  free(text);
+
+  num_files = filenames.count;
+  index_removed = removed;
+  return ok;
+}
+
+void loadFileIndex(){
+  if (!index_mutex){
+    index_mutex = xSemaphoreCreateMutex();
+    writes_mutex = xSemaphoreCreateMutex();
+    day_starts = (uint16_t *)ps_malloc((NAME_TABLE_ENTRIES + 1) * sizeof(uint16_t));   // Worst case a day per file
+    pending_removals = (char *)ps_malloc(INDEX_PENDING_REMOVALS * (MAX_FILENAME_LENGTH + 2));
+    if (!day_starts || !pending_removals || !initNameTable(&filenames, NAME_TABLE_ENTRIES, NAME_TABLE_ARENA_BYTES) ||
+        !initNameTable(&marked_files, FILE_DELETE_QUEUE_SIZE, FILE_DELETE_QUEUE_SIZE * MAX_FILENAME_LENGTH)){
+      Serial.println("Failed to allocate file name table");
+      while(1) {}
+    }
+  }
+
+  if (replayIndex()){
+    rebuildDays();
+    Serial.printf("Loaded %i filenames in %i days from index\n", num_files, num_days);
+    if (index_removed > num_files){
+      writeIndex();
+    }
+    return;
+  }
+
+  Serial.println("File index missing or stale, rescanning SD");
+  loadFileNames();
+  rebuildDays();
+  if (!writeIndex()){
+    Serial.println("Failed to write file index");
+  }
+}
+
+bool addIndexedFile(const char *name){
+  // The list changes under index_mutex, the card only under writes_mutex, so the display never waits on the card
+  if (findName(&filenames, name) >= 0){             // A file written over keeps its one entry
+    return true;
+  }
+  lockFileIndex();
+  const bool ok = insertName(&filenames, name);
+  if (ok){
+    num_files = filenames.count;
+    rebuildDays();
+  }
+  unlockFileIndex();
+
+  if (ok){
+    flushRemovals(false);                           // The log stays in order when a deleted name is saved again
+    appendIndex('+', name);
+  } else{
+    Serial.println("File name table full, file left out of the list");
+    SD_MMC.remove(FILE_INDEX_PATH);                 // Out of step now, the next boot rescans
+  }
+  return ok;
+}
+
+bool isIndexedFile(const char *name){
+  lockFileIndex();
+  const bool found = findName(&filenames, name) >= 0;
+  unlockFileIndex();
+  return found;
+}
+
+bool removeIndexedFile(const char *name){
+  const bool ok = SD_MMC.remove(name);
+  invalidateCachedFile(name);
+  const int i = findName(&filenames, name);
+
+  if (ok && i >= 0){
+    lockFileIndex();
+    removeName(&filenames, i);
+    num_files = filenames.count;
+    rebuildDays();
+    unlockFileIndex();
+
+    removeEmptyDayDir(name);
+    index_removed++;
+    if (pending_count == INDEX_PENDING_REMOVALS){
+      flushRemovals(false);
+    }
+    pending_len += snprintf(pending_removals + pending_len, MAX_FILENAME_LENGTH + 2, "-%s\n", name);
+    pending_count++;
+  }
+  return ok;
+}
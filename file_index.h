@@ -0,0 +1,62 @@
+/*
+
+Persistent index of the photos on the SD card
+
+filenames/ num_files are loaded once at boot and then kept in step with the card by the SD writer and
+delete tasks, so the SD app opens without walking the directory. The list is mirrored to FILE_INDEX_PATH as an
+append only log, one line per change:
+
+  MBINDEX 1          header
+  +/name             file added
+  -/name             file removed
+
+loadFileIndex() replays the log, and only falls back to a full rescan (loadFileNames) when the index is
+missing or stale: bad header, a line cut short by a reset, or a removal of a file the log never added.
+Once removals outnumber the files the log is rewritten with just the files, by the delete task at the end of a
+batch (or at boot), never on the way to saving a photo
+
+Photos copied onto the card from a PC don't show up until the index file is deleted
+
+Photos are saved one directory per day, /YYYY-MM-DD/hh-mm-ss.mbi, so no directory holds more than a day of
+photos (FAT finds a name by walking its directory, every save and open used to walk the whole root). Photos
+from before that stay in the root as /YYYY-MM-DD_hh-mm-ss.mbi and still sort and group with their day.
+filenames is kept sorted, and a day index over it holds where each day starts, so the SD app lists days
+and jumps between them with binary searches instead of walking the names
+
+*/
+
+#pragma once
+#include "globals.h"
+
+#define FILE_INDEX_PATH "/.mbindex"
+#define FILE_INDEX_TMP_PATH "/.mbindex.tmp"
+#define DAY_NAME_LENGTH 11                     // "YYYY-MM-DD" and its NUL
+#define INDEX_PENDING_REMOVALS 64              // Removal lines held back for one append, flushed early if more come
+
+void loadFileIndex();                          // At boot, before any task touches the card
+
+// addIndexedFile(), removeIndexedFile() and flushIndexRemovals() change the card, call them with lockIndexWrites() held
+
+bool addIndexedFile(const char *name);         // After a file was written and closed, false if the list is full
+
+bool removeIndexedFile(const char *name);      // Removes the file from the card and the list, the index file catches up in flushIndexRemovals()
+
+void flushIndexRemovals(bool compact);         // One append for every removal since the last flush, compact rewrites a log that's mostly removals
+
+bool isIndexedFile(const char *name);          // Whether the list already holds name
+
+void lockFileIndex();                          // Hold while reading filenames or the days, only ever held for a change in memory
+
+void unlockFileIndex();
+
+void lockIndexWrites();                        // Held across every card change to the photos and the index file, hold it before deleting a task that makes them
+
+void unlockIndexWrites();
+
+int numDays();
+
+int dayStart(int day);                         // Index of the day's first file, num_files past the last day
+
+int dayOfFile(int index);                      // Day the file at index belongs to
+
+void dayName(int day, char *name);             // "YYYY-MM-DD" into DAY_NAME_LENGTH chars, "" out of range
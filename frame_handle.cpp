@@ -0,0 +1,78 @@
+#include "frame_handle.h"
+
+
+static FrameHandle handles[CAMERA_FB_COUNT];
+static std::atomic<int> in_flight(0);
+static std::atomic<int> max_in_flight(0);
+
+FrameHandle *wrapFrame(camera_fb_t *fb){
+  // Only frameCaptureTask wraps frames, so a free slot can't be taken by anyone else meanwhile
+
+  for (int i = 0; i < CAMERA_FB_COUNT; i++){
+    if (handles[i].refs.load(std::memory_order_acquire) == 0){
+      handles[i].fb = fb;
+      handles[i].refs.store(1, std::memory_order_release);
+
+      int now_in_flight = ++in_flight;
+      int prev_max = max_in_flight.load();
+      while (now_in_flight > prev_max && !max_in_flight.compare_exchange_weak(prev_max, now_in_flight)){
+      }
+      return &handles[i];
+    }
+  }
+  return NULL;
+}
+
+void retainFrame(FrameHandle *frame){
+  frame->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void releaseFrame(FrameHandle *frame){
+  // Read the fb before letting go, once refs hits 0 the capture task may reuse the slot
+
+  camera_fb_t *fb = frame->fb;
+  if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+    esp_camera_fb_return(fb);
+    in_flight--;
+  }
+}
+
+bool sendFrame(QueueHandle_t queue, FrameHandle *frame, bool keep_latest){
+  // keep_latest replaces a frame nobody picked up yet instead of dropping the new one
+
+  FrameHandle *stale;
+  if (keep_latest && !uxQueueSpacesAvailable(queue) && xQueueReceive(queue, &stale, 0) == pdTRUE){
+    releaseFrame(stale);
+  }
+
+  retainFrame(frame);
+  if (xQueueSend(queue, &frame, 0) != pdTRUE){
+    releaseFrame(frame);
+    return false;
+  }
+  return true;
+}
+
+void drainFrames(QueueHandle_t queue){
+  FrameHandle *frame;
+  while (xQueueReceive(queue, &frame, 0) == pdTRUE){
+    releaseFrame(frame);
+  }
+}
+
+void resetFrameHandles(){
+  for (int i = 0; i < CAMERA_FB_COUNT; i++){
+    handles[i].refs.store(0);
+    handles[i].fb = NULL;
+  }
+  in_flight = 0;
+  max_in_flight = 0;
+}
+
+int framesInFlight(){
+  return in_flight.load();
+}
+
+int maxFramesInFlight(){
+  return max_in_flight.load();
+}
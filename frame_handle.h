@@ -0,0 +1,36 @@
+/*
+
+Reference counted camera frames
+
+frameCaptureTask wraps each fb from the driver in a handle, and every consumer (display, SD save) holds its own
+reference to the same buffer, nothing is copied. The fb goes back to the driver exactly once, when the last
+reference is released, whichever task that happens on
+
+Handles live in a fixed table with one slot per driver buffer, so a handle never outlives its fb
+
+*/
+
+#pragma once
+#include <atomic>
+#include "globals.h"
+
+struct FrameHandle {
+  camera_fb_t *fb;
+  std::atomic<int> refs;          // 0 means the slot is free
+};
+
+FrameHandle *wrapFrame(camera_fb_t *fb);       // Handle with one reference owned by the caller, NULL if the table is full
+
+void retainFrame(FrameHandle *frame);          // Take another reference before handing the frame to another consumer
+
+void releaseFrame(FrameHandle *frame);         // Drop a reference, the last one returns the fb to the driver
+
+bool sendFrame(QueueHandle_t queue, FrameHandle *frame, bool keep_latest);     // Queue a new reference, dropped (false) if it can't be queued
+
+void drainFrames(QueueHandle_t queue);         // Release every frame still waiting in a queue
+
+void resetFrameHandles();                      // Forget all handles after esp_camera_return_all()
+
+int framesInFlight();                          // Driver buffers currently held by the app
+
+int maxFramesInFlight();                       // High water mark since the camera was started
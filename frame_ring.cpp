@@ -0,0 +1,173 @@
+#include <atomic>
+#include "frame_ring.h"
+
+
+FrameRingStats frame_ring_stats = {};
+
+static RingFrame slots[FRAME_RING_SLOTS];
+static QueueHandle_t free_slots = NULL;             // RingFrame * of every slot nobody holds
+static QueueHandle_t filled_slots = NULL;           // RingFrame * waiting for the save task, in capture order
+static SemaphoreHandle_t push_mutex = NULL;
+static std::atomic<int> frames_requested(0);        // Added to by the button handler, taken by the capture task
+static std::atomic<bool> still_requested(false);
+static RingFrame still = {};                        // pixels only while a still is held, NULL when the slot is free
+static volatile uint32_t timelapse_interval_ms = 0; // 0 when no timelapse is running
+static volatile uint32_t next_timelapse_ms = 0;
+
+void initFrameRing(){
+  free_slots = xQueueCreate(FRAME_RING_SLOTS, sizeof(RingFrame *));
+  filled_slots = xQueueCreate(FRAME_RING_SLOTS + 1, sizeof(RingFrame *));   // Every slot and the still
+  push_mutex = xSemaphoreCreateMutex();
+
+  bool ok = free_slots && filled_slots && push_mutex;
+  for (int i = 0; i < FRAME_RING_SLOTS && ok; i++){
+    RingFrame *frame = &slots[i];
+    frame->pixels = (uint8_t *)ps_malloc(FRAME_RING_SLOT_BYTES);
+    ok = frame->pixels && xQueueSend(free_slots, &frame, 0) == pdTRUE;
+  }
+  if (!ok){
+    Serial.println("Failed to allocate frame ring");
+    while(1) {}
+  }
+  Serial.println("Frame ring initialized");
+}
+
+void requestRingFrames(int count){
+  frames_requested += count;
+}
+
+void startTimelapse(uint32_t interval_ms){
+  next_timelapse_ms = millis();
+  timelapse_interval_ms = interval_ms;
+}
+
+void stopTimelapse(){
+  timelapse_interval_ms = 0;
+}
+
+bool timelapseRunning(){
+  return timelapse_interval_ms != 0;
+}
+
+void requestRingStill(){
+  still_requested = true;
+}
+
+void cancelRingFrames(){
+  frames_requested = 0;
+  still_requested = false;
+  stopTimelapse();
+}
+
+bool ringFrameDue(){
+  int requested = frames_requested.load();
+  while (requested > 0 && !frames_requested.compare_exchange_weak(requested, requested - 1)){
+  }
+  if (requested > 0){
+    return true;
+  }
+
+  const uint32_t interval = timelapse_interval_ms;
+  const uint32_t now_ms = millis();
+  if (interval && (int32_t)(now_ms - next_timelapse_ms) >= 0){
+    // Keep to the schedule, but don't catch up with a run of frames after a stall
+    next_timelapse_ms += interval;
+    if ((int32_t)(now_ms - next_timelapse_ms) >= 0){
+      next_timelapse_ms = now_ms + interval;
+    }
+    return true;
+  }
+  return false;
+}
+
+bool ringStillDue(){
+  return still_requested.exchange(false);
+}
+
+bool ringFramePending(){
+  const uint32_t interval = timelapse_interval_ms;
+  return frames_requested.load() > 0 || still_requested.load() || (interval && (int32_t)(millis() - next_timelapse_ms) >= 0);
+}
+
+bool pushRingFrame(const camera_fb_t *fb, uint32_t timestamp){
+  RingFrame *frame = NULL;
+  const size_t len = fb->width * fb->height * 2;
+
+  if (fb->format != PIXFORMAT_RGB565 || fb->len < len || len > FRAME_RING_SLOT_BYTES){
+    frame_ring_stats.dropped++;
+    return false;
+  }
+  lockFrameRing();
+  if (xQueueReceive(free_slots, &frame, 0) != pdTRUE){
+    unlockFrameRing();
+    frame_ring_stats.dropped++;                     // Every slot is still waiting to be saved
+    return false;
+  }
+
+  memcpy(frame->pixels, fb->buf, len);
+  frame->width = fb->width;
+  frame->height = fb->height;
+  frame->timestamp = timestamp;
+  frame->captured_ms = millis();
+  xQueueSend(filled_slots, &frame, 0);              // Never full, it holds at most every slot
+  frame_ring_stats.captured++;
+  unlockFrameRing();
+  return true;
+}
+
+bool pushRingStill(const camera_fb_t *fb, uint32_t timestamp){
+  const size_t len = fb->width * fb->height * 2;
+
+  if (fb->format != PIXFORMAT_RGB565 || fb->len < len){
+    frame_ring_stats.dropped++;
+    return false;
+  }
+  lockFrameRing();
+  uint8_t *pixels = still.pixels ? NULL : (uint8_t *)ps_malloc(len);   // The last still is saved before the next one is taken
+  if (!pixels){
+    unlockFrameRing();
+    frame_ring_stats.dropped++;
+    return false;
+  }
+
+  memcpy(pixels, fb->buf, len);
+  still.pixels = pixels;
+  still.width = fb->width;
+  still.height = fb->height;
+  still.timestamp = timestamp;
+  still.captured_ms = millis();
+  RingFrame *frame = &still;
+  xQueueSend(filled_slots, &frame, 0);              // Has room for one more than the slots
+  frame_ring_stats.captured++;
+  unlockFrameRing();
+  return true;
+}
+
+RingFrame *takeRingFrame(TickType_t ticks_to_wait){
+  RingFrame *frame = NULL;
+  xQueueReceive(filled_slots, &frame, ticks_to_wait);
+  return frame;
+}
+
+void releaseRingFrame(RingFrame *frame){
+  if (frame == &still){
+    lockFrameRing();
+    free(still.pixels);
+    still.pixels = NULL;
+    unlockFrameRing();
+    return;
+  }
+  xQueueSend(free_slots, &frame, 0);
+}
+
+int ringFramesHeld(){
+  return FRAME_RING_SLOTS - uxQueueMessagesWaiting(free_slots) + (still.pixels != NULL);
+}
+
+void lockFrameRing(){
+  xSemaphoreTake(push_mutex, portMAX_DELAY);
+}
+
+void unlockFrameRing(){
+  xSemaphoreGive(push_mutex);
+}
@@ -0,0 +1,71 @@
+/*
+
+PSRAM frame ring for burst and timelapse capture
+
+frameCaptureTask copies each frame that is due into one of FRAME_RING_SLOTS preallocated PSRAM slots and
+gives the fb straight back to the driver, so a burst never holds up the preview or runs the driver's pool dry.
+saveFrameToSDTask takes filled slots oldest first, packs them into SD writer buffers and frees them again
+
+A frame that is due while every slot is still waiting to be saved is dropped and counted, never waited for
+
+Single photos are stills at STILL_FRAME_SIZE, too big for a slot. Each gets its own slot with pixels allocated
+when it's pushed and freed once it's saved, so the PSRAM is only taken while a still is on its way to the card
+
+*/
+
+#pragma once
+#include "globals.h"
+
+#define FRAME_RING_SLOTS 8              // 8 x 115 kB, a third of a second of burst at sensor rate
+#define FRAME_RING_SLOT_BYTES (IMAGE_WIDTH * IMAGE_HEIGHT * 2)
+#define BURST_FRAMES 10                 // Frames per SELECT in burst mode
+#define TIMELAPSE_INTERVAL_MS 5000      // One frame this often while a timelapse runs
+
+struct RingFrame {
+  uint8_t *pixels;                      // RGB565 as the camera delivered it
+  uint16_t width;
+  uint16_t height;
+  uint32_t timestamp;                   // Capture time, names the file
+  uint32_t captured_ms;                 // For the save latency
+};
+
+struct FrameRingStats {
+  uint32_t captured;                    // Frames copied into the ring
+  uint32_t dropped;                     // Frames that were due while the ring was full
+};
+
+extern FrameRingStats frame_ring_stats;
+
+void initFrameRing();                                   // Allocates the slots, hangs if PSRAM is missing
+
+void requestRingFrames(int count);                      // The next count frames go to the ring
+
+void startTimelapse(uint32_t interval_ms);              // One frame now, then one every interval_ms
+
+void stopTimelapse();
+
+bool timelapseRunning();
+
+void requestRingStill();                                // frameCaptureTask switches the sensor for one still
+
+void cancelRingFrames();                                // Drop outstanding requests and stop a timelapse (camera closing)
+
+bool ringFrameDue();                                    // frameCaptureTask only, once per frame, consumes the request
+
+bool ringStillDue();                                    // frameCaptureTask only, consumes the still request
+
+bool ringFramePending();                                // A frame or a still would be due now, without consuming anything
+
+bool pushRingFrame(const camera_fb_t *fb, uint32_t timestamp);   // frameCaptureTask only, false (and counted) if the ring is full
+
+bool pushRingStill(const camera_fb_t *fb, uint32_t timestamp);   // frameCaptureTask only, false (and counted) if the last still isn't saved yet or PSRAM is short
+
+RingFrame *takeRingFrame(TickType_t ticks_to_wait);     // Oldest filled slot, NULL if none came in time
+
+void releaseRingFrame(RingFrame *frame);                // Slot is free for the next capture
+
+int ringFramesHeld();                                   // Slots filled or being saved
+
+void lockFrameRing();                                   // Hold before deleting frameCaptureTask, so a slot is never lost half filled
+
+void unlockFrameRing();
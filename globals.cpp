@@ -7,6 +7,7 @@ MenuItem main_menu[] = {                    // Main menu items
   {"Wifi", WIFI},
   {"Camera Feed", CAMERA_FEED},
   {"SD Card", SD_CARD},
+  {"SD Bench", SD_BENCH},
   {"Games", GAMES}
 };
 
@@ -24,30 +25,35 @@ int button_index = 0;               // Keeps track of what menu item is currentl
 char game_input = 'N';              // Init to N for none
 int last_button_index = 0;          
 bool camera_init = false;           // Flag for whether camera is initialized
-bool save_next_frame = false;       // Flag for whether the next frame should be saved
+CaptureMode capture_mode = CAPTURE_SINGLE;   // What SELECT does in the camera app, UP cycles it
+int camera_filter = 0;                       // Chain in filter_chains the preview runs, DOWN cycles it
 bool menu_init = false;             // Flag for initializing a menu
 bool image_view = false;            // Flag for whether in file menu view or image view
 bool image_shown = false;           // Flag to draw image viewer only once
+bool gallery_view = false;          // Flag for whether the SD app shows thumbnails or the day list
+bool gallery_marking = false;       // Gallery is picking photos for a batch delete, SELECT marks them
 int file_index = 0;                 // Index of current chosen file in SD root directory
 int prev_file_index = -1;
-std::vector<String> filenames(2);   // Contains all the filenames in the SD card (initialize to size 2)
+int day_index = 0;                  // Highlighted day in the SD app's day list
+int viewer_zoom = 1;                // 1, 2 or 4, SELECT steps it in the image viewer
+int viewer_tile = 0;                // Which of the zoom x zoom parts of the photo is on screen, UP/ DOWN step through them
 int num_files = 0;
-std::queue<int> heap_usage;         // Holds psram usage for graph
-int min_heap = 100;                 // magic number, to a little lower than the lowest I have observed
-int max_heap = 0;                   // Gets updated dynamically
+volatile uint32_t deletes_queued = 0;   // Files sent to deleteFromSDTask, the display task is the only writer
+volatile uint32_t deletes_done = 0;     // Of those, handled (deleted or failed), deleteFromSDTask is the only writer
 
 // Queue handles for data
 QueueHandle_t frame_display_queue = NULL;
-QueueHandle_t frame_save_queue = NULL;
 QueueHandle_t button_queue = NULL;
 QueueHandle_t sys_info_queue = NULL;
 QueueHandle_t file_delete_queue = NULL;
 QueueHandle_t wifi_queue = NULL;
+QueueHandle_t frame_taken_queue = NULL;      // One slot, overwritten by the display when it empties frame_display_queue
 
 // Task Handles for suspending/ resuming tasks
 TaskHandle_t frameCaptureTask_handle;
 TaskHandle_t saveFrameToSDTask_handle;
 TaskHandle_t deleteFromSDTask_handle;
+TaskHandle_t sdBenchTask_handle = NULL;          // Only while a benchmark runs, it deletes itself
 
 // Used to determine fps
 int frames = 0;
@@ -55,6 +61,15 @@ float prev_fps = 0;
 float fps = 0;
 unsigned long now = millis();
 unsigned long before = 0;
+int preview_frames = 0;
+float preview_fps = 0;
+uint32_t preview_latency_us = 0;
+int preview_latency_frames = 0;
+float preview_latency_ms = 0;
+volatile uint32_t preview_dropped = 0;
+volatile uint32_t still_switch_ms = 0;
+volatile uint32_t still_back_ms = 0;
+uint32_t preview_pool_kb = 0;
 
 // WiFi credentials
 const char *SSID = "YOURSSID";
@@ -67,4 +82,11 @@ const int daylight_offset_sec = 0 * 60 * 60;  // DST offset
 tm t = {};                                    // Holds current data and time from NTP server
 
 // TFT display
-TFT_eSPI tft = TFT_eSPI();    
\ No newline at end of file
+TFT_eSPI tft = TFT_eSPI();
+TFT_eSprite canvas = TFT_eSprite(&tft);
+uint16_t *dma_buffers[2] = {NULL, NULL};
+
+// Compositor stats
+uint32_t frame_bytes_pushed = 0;
+uint64_t total_bytes_pushed = 0;
+uint64_t total_bytes_damaged = 0;    
\ No newline at end of file
@@ -9,7 +9,6 @@ Global defines, structs, data types, variables, etc.
 #include <esp_camera.h>
 #include <TFT_eSPI.h>
 #include <vector>
-#include <queue>
 #include "config.h"
 #include "time.h"
 
@@ -29,7 +28,7 @@ TFT_CS                  Connected to GND to always be on
 #define SCREEN_HEIGHT 320
 #define SCREEN_WIDTH 240
 #define STATUS_BAR_HEIGHT 20
-#define MENU_ITEM_HEIGHT 60
+#define MENU_ITEM_HEIGHT 50
 #define IMAGE_WIDTH 240
 #define IMAGE_HEIGHT 240
 #define SWAP_BYTES false          // For little/ big endian byte swaps (Instead of RRRRRGGG GGGBBBBB, LSB first: GGGBBBBB RRRRRGGG )
@@ -68,9 +67,8 @@ TFT_CS                  Connected to GND to always be on
 // Queue sizes
 #define BUTTON_QUEUE_SIZE 3          // small to prevent buffering
 #define FRAME_DISPLAY_QUEUE_SIZE 1    // Experiment with this
-#define FRAME_SAVE_QUEUE_SIZE 1       // Experiment with this
 #define SYS_INFO_QUEUE_SIZE 1         // will change for graph mode
-#define FILE_DELETE_QUEUE_SIZE 5      // Buffer a few delete requests
+#define FILE_DELETE_QUEUE_SIZE 64     // A whole batch of photos marked in the gallery fits, see deleteFromSDTask
 #define WIFI_QUEUE_SIZE 1
 #define NTP_QUEUE_SIZE 1
 
@@ -79,8 +77,25 @@ TFT_CS                  Connected to GND to always be on
 #define NUM_SYS_DATA_POINTS 60        // How many seconds to record system data
 #define MAX_WIFI 8                    // How many nearby wifi signals to display
 #define MAX_FILENAME_LENGTH 32
-#define MAIN_MENU_SIZE 5
+#define MAIN_MENU_SIZE 6
 #define GAMES_MENU_SIZE 3
+#define MAX_DIRTY_RECTS 16            // Damaged rectangles tracked per frame before they get merged
+#define CAMERA_FB_COUNT 3             // Frame buffers in the preview pool (in PSRAM), one filling, one on screen, one queued
+#define STILL_FRAME_SIZE FRAMESIZE_VGA  // Sensor mode a single photo is taken in, the preview pool is freed meanwhile
+#define STILL_WIDTH 640
+#define STILL_HEIGHT 480
+#define STILL_SKIP_FRAMES 2           // Frames thrown away after switching to the still mode while the exposure settles
+#define DMA_STRIP_ROWS 20             // Camera rows per DMA transfer, two strips of this size live in internal RAM
+#define CAMERA_FLASH_MS 150           // Preview stays white this long after a photo is taken
+#define CAPTURE_WAIT_MS 50            // Longest frameCaptureTask waits for the display before checking the frame ring again
+#define NUM_CAPTURE_MODES 5
+//#define CAMERA_DEBUG_LOG            // Print preview fps, frames in flight, latency, drops and filter cost every second the camera is open
+#define GALLERY_COLS 4                // Thumbnail grid of the SD app
+#define GALLERY_ROWS 4
+#define DAY_LIST_ROWS 10              // Days on one page of the SD app's day list
+#define GALLERY_FILL_MS 16            // Time per display frame spent reading thumbnails before the buttons get a look
+#define VIEWER_MAX_ZOOM 4             // Image viewer zooms 1x, 2x, 4x
+#define LONG_PRESS_SAMPLES 8          // Button samples (DEBOUNCE_INTERVAL apart) before a press counts as held
 
 #define NUM_BRICKS 8
 
@@ -94,11 +109,20 @@ enum ButtonState {
   BACK
 };
 
+enum CaptureMode {
+  CAPTURE_SINGLE,
+  CAPTURE_BURST,
+  CAPTURE_TIMELAPSE,
+  CAPTURE_MOTION,
+  CAPTURE_NIGHT
+};
+
 enum DisplayState {
   BOOT,
   MENU,
   CAMERA_FEED,
   SD_CARD,
+  SD_BENCH,
   SYSTEM_DATA,
   WIFI,
   GAMES,
@@ -120,6 +144,18 @@ struct SystemInfo {
   unsigned long uptime;
 };
 
+struct StripChart {
+  int x, y, w, h;                         // Outline of the whole chart
+  int len;                                // Samples across the plot, the sweep wraps after this many
+  int spacing;                            // Pixels between samples
+  int y_min, y_max;                       // Range the axis labels and plot are scaled to
+  int values[NUM_SYS_DATA_POINTS];        // Sample shown in each column
+  int count;                              // Columns that hold a sample
+  int newest;                             // Column of the newest sample, -1 when empty
+  char *x_label, *y_label, *title;
+  uint32_t color;
+};
+
 struct WiFiInfo {
   char ssid[32];
   char ip[20];
@@ -159,7 +195,7 @@ static camera_config_t camera_config = {
     .frame_size = FRAMESIZE_240X240,    // 240x240 square for now, leaves room for button options below
 
     .jpeg_quality = 12, //0-63, for OV series camera sensors, lower number means higher quality
-    .fb_count = 5,       //When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
+    .fb_count = CAMERA_FB_COUNT,       //When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
     .fb_location = CAMERA_FB_IN_PSRAM,
     .grab_mode = CAMERA_GRAB_WHEN_EMPTY,
 };
@@ -181,36 +217,39 @@ extern int last_button_index;
 
 // Camera flags
 extern bool camera_init;
-extern bool save_next_frame;
+extern CaptureMode capture_mode;
+extern int camera_filter;
 
 // Menu flags
 extern bool menu_init;
 extern bool image_view;
 extern bool image_shown;
+extern bool gallery_view;
+extern bool gallery_marking;
 
 // File system
 extern int file_index;
+extern int day_index;
+extern int viewer_zoom;
+extern int viewer_tile;
 extern int prev_file_index;
-extern std::vector<String> filenames;
 extern int num_files;
-
-// System data
-extern std::queue<int> heap_usage;
-extern int min_heap;
-extern int max_heap;
+extern volatile uint32_t deletes_queued;
+extern volatile uint32_t deletes_done;
 
 // Queue handles
 extern QueueHandle_t frame_display_queue;
-extern QueueHandle_t frame_save_queue;
 extern QueueHandle_t button_queue;
 extern QueueHandle_t sys_info_queue;
 extern QueueHandle_t file_delete_queue;
 extern QueueHandle_t wifi_queue;
+extern QueueHandle_t frame_taken_queue;
 
 // Task handles
 extern TaskHandle_t frameCaptureTask_handle;
 extern TaskHandle_t saveFrameToSDTask_handle;
 extern TaskHandle_t deleteFromSDTask_handle;
+extern TaskHandle_t sdBenchTask_handle;
 
 // FPS tracking
 extern int frames;
@@ -218,6 +257,15 @@ extern float prev_fps;
 extern float fps;
 extern unsigned long now;
 extern unsigned long before;
+extern int preview_frames;                // Camera frames pushed since the last fps update
+extern float preview_fps;
+extern uint32_t preview_latency_us;         // Capture to glass, summed over preview_latency_frames since the last fps update
+extern int preview_latency_frames;
+extern float preview_latency_ms;           // Mean over the last second
+extern volatile uint32_t preview_dropped;  // Frames grabbed for the preview that never reached the screen, since the camera opened
+extern volatile uint32_t still_switch_ms;  // Last still: SELECT to the still frame in hand, 0 before the first one
+extern volatile uint32_t still_back_ms;    // Last still: still frame returned to the preview driver running again
+extern uint32_t preview_pool_kb;           // PSRAM the preview pool took when the camera opened
 
 // WiFi credentials
 extern const char *SSID;
@@ -231,3 +279,10 @@ extern tm t;                           // Holds current data and time from NTP s
 
 // TFT Display
 extern TFT_eSPI tft;
+extern TFT_eSprite canvas;                // Off screen copy of the display that screens draw into (see compositor.h)
+extern uint16_t *dma_buffers[2];          // Ping-pong strips for the camera preview, the SPI DMA cannot read PSRAM
+
+// Compositor stats
+extern uint32_t frame_bytes_pushed;       // Bytes sent by the last frame that had any damage
+extern uint64_t total_bytes_pushed;       // Since boot
+extern uint64_t total_bytes_damaged;      // Since boot, what pushing every damaged rectangle whole would have cost
@@ -2,67 +2,72 @@
 #include "globals.h"
 #include <SD_MMC.h>
 #include <WiFi.h>
-
-
-void loadFileNames(){
-  // Counts the number of files in the root directory of SD card and updates filenames array
-  num_files = 0;                                        
-  filenames.clear();                                      // Clear all elements from vector
-  fs::File root = SD_MMC.open("/");                       // Root directory
-  if (!root || !root.isDirectory()) {
-    Serial.println("Failed to open root directory of SD");
-    return;
+#include "image_ops.h"
+#include "frame_handle.h"
+#include "name_table.h"
+
+
+static bool loadDirectoryNames(const char *path, bool descend){
+  // Adds the files in path to filenames, and those of its subdirectories (the day directories) if descend.
+  // false once the table is full
+  fs::File dir = SD_MMC.open(path);
+  if (!dir || !dir.isDirectory()) {
+    Serial.printf("Failed to open directory %s of SD\n", path);
+    return true;
   }
 
-  Serial.println("Loading filenames...");
-
-  fs::File file = root.openNextFile();
+  bool ok = true;
+  fs::File file = dir.openNextFile();
 
-  while (file){
+  while (file && ok){
     
     // Using strings here to pushback in the vector seems to work
-    String name = "/" + String(file.name());  // Make safe copy, prepend "/" here to remove need to do it later (when deleting or reopening)
+    String name = String(path) + (path[1] ? "/" : "") + String(file.name());  // Full path, so it can be deleted or reopened as it is
     //Serial.println(name);
-    if (name != "" && name != "/System Volume Information") {  // Skip empty names and the hidden folder
-        filenames.push_back(name);      // Add to vector
-        num_files++;                    
+    const bool hidden = name.endsWith("/System Volume Information") || String(file.name()).startsWith(".");   // The hidden folder, the file index and the thumbnails
+    if (file.isDirectory()){
+      if (descend && !hidden){
+        ok = loadDirectoryNames(name.c_str(), false);
+      }
+    }
+    else if (!hidden && name.length() < MAX_FILENAME_LENGTH) {
+        if (!insertName(&filenames, name.c_str())){      // Add to table
+          Serial.println("File name table full, skipping the rest");
+          ok = false;
+        }
     }
     file.close();
-    file = root.openNextFile();
+    file = dir.openNextFile();
   }
   file.close();
-  root.close();
-}
-
-void printFileNames(){
-  // Debugging
-  for (int i = 0; i < filenames.size(); i++){
-    Serial.println(filenames[i]);
-  }
+  dir.close();
+  return ok;
 }
 
-void generateXYArrays(int x_c[], int y_c[]){
-  // Generates x and y arrays for use in drawGraph()
-
-  std::queue<int> q = heap_usage;
+void loadFileNames(){
+  // Finds the photos in the root directory of SD card and its day directories and updates filenames array
+  clearNames(&filenames);                                 // Names are copied into the table's arena, nothing to free
 
-  for (int i = 0; i < NUM_SYS_DATA_POINTS; i++){
-    x_c[i] = i + 1;
-    y_c[i] = q.front();
-    q.pop();
+  Serial.println("Loading filenames...");
+  loadDirectoryNames("/", true);
+  num_files = filenames.count;
+}
 
-    if (q.empty()){
-      break;
-    }
+bool makeParentDir(const char *path){
+  // One level only, the day directories live in the root or in THUMB_DIR which exist already
+  const char *slash = strrchr(path, '/');
+  if (!slash || slash == path){
+    return true;
   }
+  char dir[64];
+  snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+  return SD_MMC.exists(dir) || SD_MMC.mkdir(dir);
 }
 
-void initHeapQueue(){
-  // Initializes the heap queue to be full of minimum amount
-  // This makes it so that the points on graph start at x axis and go up
-
-  for (int i = 0; i < NUM_SYS_DATA_POINTS; i++){
-    heap_usage.push(min_heap);
+void printFileNames(){
+  // Debugging
+  for (int i = 0; i < filenames.count; i++){
+    Serial.println(getName(&filenames, i));
   }
 }
 
@@ -106,6 +111,15 @@ void initTFT(){
   tft.setRotation(2);               // Orientation dependent
   tft.setSwapBytes(SWAP_BYTES);     // Correct for endianess
   tft.fillScreen(TFT_BLACK);
+
+  // Camera preview goes out over DMA in strips, copied from PSRAM into these while the previous strip transfers
+  for (int i = 0; i < 2; i++){
+    dma_buffers[i] = (uint16_t *)heap_caps_malloc(IMAGE_WIDTH * DMA_STRIP_ROWS * sizeof(uint16_t), MALLOC_CAP_DMA);
+  }
+  if (!dma_buffers[0] || !dma_buffers[1] || !tft.initDMA()){
+    Serial.println("TFT DMA initialization failed!");
+    while(1) {}   // hang
+  }
   Serial.println("TFT initialized");
 }
 
@@ -114,12 +128,12 @@ void initQueues(){
   // Hangs if queues fail
 
   button_queue = xQueueCreate(BUTTON_QUEUE_SIZE, sizeof(ButtonState));
-  frame_display_queue = xQueueCreate(FRAME_DISPLAY_QUEUE_SIZE, sizeof(camera_fb_t *));
-  frame_save_queue = xQueueCreate(FRAME_SAVE_QUEUE_SIZE, sizeof(camera_fb_t *));
+  frame_display_queue = xQueueCreate(FRAME_DISPLAY_QUEUE_SIZE, sizeof(FrameHandle *));      // Frames are passed as refcounted handles
   sys_info_queue = xQueueCreate(SYS_INFO_QUEUE_SIZE, sizeof(SystemInfo));
   file_delete_queue = xQueueCreate(FILE_DELETE_QUEUE_SIZE, MAX_FILENAME_LENGTH*sizeof(char));   // DO NOT PASS STRINGS IN QUEUE AS THEY PASS AROUND JUNK
   wifi_queue = xQueueCreate(WIFI_QUEUE_SIZE, sizeof(WiFiInfo));
-  if (!button_queue || !frame_display_queue || !frame_save_queue || !sys_info_queue || !file_delete_queue || !wifi_queue) {
+  frame_taken_queue = xQueueCreate(1, sizeof(uint8_t));
+  if (!button_queue || !frame_display_queue || !sys_info_queue || !file_delete_queue || !wifi_queue || !frame_taken_queue) {
     Serial.println("Queue creation failed!");
     while(1) {}   // hang
   }
@@ -147,64 +161,41 @@ bool checkCollision(int x1, int y1, int w1, int h1, int x2, int y2, int w2, int
 }
 
 void transposeImage(camera_fb_t *fb, int bytes_per_pixel){
-  // Swap rows of x pixels and cols of y pixels
-  // Only for images of equal width and height
-  // bytes_per_pixel is 2 for RGB565
-
-  const int size = fb->width;                         // Assume width and height are equal
-  const int length = fb->len;                         // Bytes in fb
+  // Swap rows of x pixels and cols of y pixels, width and height swap too
+  // bytes_per_pixel is 2 for RGB565, the only format supported
+  // Square frames are done in place, others go through a temporary in PSRAM
 
-  // Allocate buffer for transposed img
-  uint8_t *img_buf = new uint8_t[length];
-
-  int counter = 0;
-  int start_index = 0;
-  int index = 0;
-
-  for (int i = 0; i < length; i++){
-
-    index = start_index + (counter * size) + (i % bytes_per_pixel);      // Index to copy from fb
-
-    img_buf[i] = fb->buf[index];
+  if (bytes_per_pixel != 2){
+    Serial.println("Error: Only RGB565 images can be transposed.");
+    return;
+  }
 
-    if ((i != 0) && (i % bytes_per_pixel == 0)){    // Accounts for multiple bytes per pixel 
-      counter++;
-    }
+  if (fb->width == fb->height){
+    transposeInPlace565((uint16_t *)fb->buf, fb->width);
+    return;
+  }
 
-    if (counter == size){     // After each "row and col swap", reset counter and increment start_index
-      counter = 0;
-      start_index++;
-    }
+  uint16_t *img_buf = (uint16_t *)ps_malloc(fb->len);
+  if (!img_buf){
+    Serial.println("Error: No memory to transpose image.");
+    return;
   }
+  transpose565((uint16_t *)fb->buf, img_buf, fb->width, fb->height);
+  memcpy(fb->buf, img_buf, fb->len);   // Copy transpose into fb
+  free(img_buf);
 
-  memcpy(fb->buf, img_buf, length);   // Copy transpose into fb
-  delete[] img_buf;
+  const size_t width = fb->width;
+  fb->width = fb->height;
+  fb->height = width;
 }
 
 void transposeImageInPlace(camera_fb_t *fb) {
-  const int bpp = 2;
-  const int width = fb->width;
-  const int height = fb->height;
+  // Tiled swap across the diagonal (see image_ops.h), RGB565 only
 
-  if (width != height) {
+  if (fb->width != fb->height) {
       printf("Error: Image must be square to transpose.\n");
       return;
   }
 
-  uint8_t *buf = fb->buf;
-
-  for (int y = 0; y < height; y++) {
-    for (int x = y + 1; x < width; x++) {
-    int idx1 = (y * width + x) * bpp;
-    int idx2 = (x * width + y) * bpp;
-
-    // Swap 2 bytes (one pixel)
-    uint8_t tmp0 = buf[idx1];
-    uint8_t tmp1 = buf[idx1 + 1];
-    buf[idx1]     = buf[idx2];
-    buf[idx1 + 1] = buf[idx2 + 1];
-    buf[idx2]     = tmp0;
-    buf[idx2 + 1] = tmp1;
-    }
-  }
+  transposeInPlace565((uint16_t *)fb->buf, fb->width);
 }
@@ -10,11 +10,9 @@ Helper functions
 
 void loadFileNames();
 
-void printFileNames();
-
-void generateXYArrays(int x_c[], int y_c[]);    // Generates arrays to be passed to drawGraph()
+bool makeParentDir(const char *path);      // Creates the (day) directory a file is about to be written to, if it's missing
 
-void initHeapQueue();                           // Sets all values in heap_queue to min
+void printFileNames();
 
 void initWiFi();
 
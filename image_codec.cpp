@@ -0,0 +1,268 @@
+#include <string.h>
+#include "globals.h"
+#include "image_codec.h"
+
+
+#define OP_INDEX 0x00
+#define OP_DIFF  0x40
+#define OP_LUMA  0x80
+#define OP_RUN   0xC0
+#define OP_RGB   0xFE
+#define OP_MASK  0xC0
+#define MAX_RUN  62                   // 0xFE and 0xFF are taken out of the run range
+
+static const uint8_t image_magic[4] = {'M', 'B', 'I', '1'};
+
+static inline int pixelHash(uint16_t px){
+  return ((px >> 11) * 3 + ((px >> 5) & 0x3F) * 5 + (px & 0x1F) * 7) & (IMAGE_INDEX_SIZE - 1);
+}
+
+// Channel differences wrap around, so any change of a 5 or 6 bit channel fits a signed 5 or 6 bit value
+static inline int wrap5(int d){ return ((d + 16) & 0x1F) - 16; }
+static inline int wrap6(int d){ return ((d + 32) & 0x3F) - 32; }
+
+static void putU16(uint8_t *p, uint16_t v){ p[0] = v & 0xFF; p[1] = v >> 8; }
+static void putU32(uint8_t *p, uint32_t v){ putU16(p, v & 0xFFFF); putU16(p + 2, v >> 16); }
+static uint16_t getU16(const uint8_t *p){ return p[0] | (p[1] << 8); }
+static uint32_t getU32(const uint8_t *p){ return getU16(p) | ((uint32_t)getU16(p + 2) << 16); }
+
+static void writeHeader(uint8_t *out, const ImageHeader *h){
+  memcpy(out, image_magic, 4);
+  putU16(out + 4, h->width);
+  putU16(out + 6, h->height);
+  out[8] = h->format;
+  out[9] = h->codec;
+  putU16(out + 10, 0);
+  putU32(out + 12, h->timestamp);
+  putU32(out + 16, h->payload_len);
+}
+
+static size_t encodePixels(const uint8_t *pixels, size_t count, uint8_t *out, size_t out_cap){
+  // Returns the payload size, 0 as soon as it would pass out_cap
+  uint16_t index[IMAGE_INDEX_SIZE] = {0};
+  uint16_t prev = 0;
+  int run = 0;
+  size_t n = 0;
+
+  for (size_t i = 0; i < count; i++){
+    const uint16_t px = (pixels[2 * i] << 8) | pixels[2 * i + 1];
+
+    if (px == prev){
+      if (++run == MAX_RUN){
+        if (n + 1 > out_cap) return 0;
+        out[n++] = OP_RUN | (run - 1);
+        run = 0;
+      }
+      continue;
+    }
+
+    if (n + 4 > out_cap) return 0;      // Room for a pending run plus the longest op
+    if (run){
+      out[n++] = OP_RUN | (run - 1);
+      run = 0;
+    }
+
+    const int h = pixelHash(px);
+    if (index[h] == px){
+      out[n++] = OP_INDEX | h;
+    } else{
+      index[h] = px;
+      const int dr = wrap5((px >> 11) - (prev >> 11));
+      const int dg = wrap6(((px >> 5) & 0x3F) - ((prev >> 5) & 0x3F));
+      const int db = wrap5((px & 0x1F) - (prev & 0x1F));
+
+      if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1){
+        out[n++] = OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+      } else{
+        const int dr_dg = wrap5(dr - (dg >> 1));    // Green has twice the steps of red and blue
+        const int db_dg = wrap5(db - (dg >> 1));
+        if (dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7){
+          out[n++] = OP_LUMA | (dg + 32);
+          out[n++] = ((dr_dg + 8) << 4) | (db_dg + 8);
+        } else{
+          out[n++] = OP_RGB;
+          out[n++] = px >> 8;
+          out[n++] = px & 0xFF;
+        }
+      }
+    }
+    prev = px;
+  }
+
+  if (run){
+    if (n + 1 > out_cap) return 0;
+    out[n++] = OP_RUN | (run - 1);
+  }
+  return n;
+}
+
+size_t imageMaxFileSize(int width, int height){
+  return IMAGE_HEADER_SIZE + (size_t)width * height * 2;
+}
+
+size_t encodeImage(const uint8_t *pixels, int width, int height, uint32_t timestamp, uint8_t *out, size_t out_cap){
+  // Packed payloads that come out no smaller than raw (noise) are stored raw instead
+  const size_t raw_len = (size_t)width * height * 2;
+  if (out_cap < IMAGE_HEADER_SIZE){
+    return 0;
+  }
+
+  ImageHeader header = {(uint16_t)width, (uint16_t)height, PIXFORMAT_RGB565, IMAGE_CODEC_QOI, timestamp, 0};
+  const size_t room = min(out_cap - IMAGE_HEADER_SIZE, raw_len - 1);
+  header.payload_len = encodePixels(pixels, (size_t)width * height, out + IMAGE_HEADER_SIZE, room);
+
+  if (!header.payload_len){
+    if (out_cap - IMAGE_HEADER_SIZE < raw_len){
+      return 0;
+    }
+    header.codec = IMAGE_CODEC_RAW;
+    header.payload_len = raw_len;
+    memcpy(out + IMAGE_HEADER_SIZE, pixels, raw_len);
+  }
+
+  writeHeader(out, &header);
+  return IMAGE_HEADER_SIZE + header.payload_len;
+}
+
+size_t encodeFrame(const camera_fb_t *fb, uint32_t timestamp, uint8_t *out, size_t out_cap){
+  if (fb->format != PIXFORMAT_RGB565 || fb->len < fb->width * fb->height * 2){
+    return 0;
+  }
+  return encodeImage(fb->buf, fb->width, fb->height, timestamp, out, out_cap);
+}
+
+// ============================= Decoder =============================
+static bool refill(ImageReader *r){
+  r->chunk_len = readCachedFile(&r->file, r->chunk, IMAGE_READ_CHUNK);
+  r->chunk_pos = 0;
+  return r->chunk_len > 0;
+}
+
+static inline bool nextByte(ImageReader *r, uint8_t *b){
+  if (r->chunk_pos == r->chunk_len && !refill(r)){
+    return false;
+  }
+  *b = r->chunk[r->chunk_pos++];
+  return true;
+}
+
+bool openImage(ImageReader *r, const char *path){
+  if (!openCachedFile(&r->file, path)){
+    return false;
+  }
+
+  r->chunk_len = r->chunk_pos = 0;
+  r->prev = 0;
+  r->run = 0;
+  r->rows_read = 0;
+  memset(r->index, 0, sizeof(r->index));
+
+  uint8_t head[IMAGE_HEADER_SIZE];
+  const size_t got = readCachedFile(&r->file, head, IMAGE_HEADER_SIZE);
+
+  if (got == IMAGE_HEADER_SIZE && !memcmp(head, image_magic, 4)){
+    r->header.width = getU16(head + 4);
+    r->header.height = getU16(head + 6);
+    r->header.format = head[8];
+    r->header.codec = head[9];
+    r->header.timestamp = getU32(head + 12);
+    r->header.payload_len = getU32(head + 16);
+
+    if (r->header.format == PIXFORMAT_RGB565 && r->header.codec <= IMAGE_CODEC_QOI && r->header.width <= 2048){
+      return true;
+    }
+    Serial.println("Unsupported image format");
+    closeCachedFile(&r->file);
+    return false;
+  }
+
+  // Headerless .raw from before the format, the bytes just read are already pixels
+  r->header = {IMAGE_WIDTH, IMAGE_HEIGHT, PIXFORMAT_RGB565, IMAGE_CODEC_RAW, 0, IMAGE_WIDTH * IMAGE_HEIGHT * 2};
+  memcpy(r->chunk, head, got);
+  r->chunk_len = got;
+  return true;
+}
+
+static bool readRawRow(ImageReader *r, uint8_t *dst, int len){
+  // Raw rows skip the chunk buffer, apart from bytes already in it
+  const int buffered = min(len, r->chunk_len - r->chunk_pos);
+  memcpy(dst, r->chunk + r->chunk_pos, buffered);
+  r->chunk_pos += buffered;
+  len -= buffered;
+  return !len || readCachedFile(&r->file, dst + buffered, len) == (size_t)len;
+}
+
+bool readImageRow(ImageReader *r, uint16_t *row){
+  const int w = r->header.width;
+  if (r->rows_read >= r->header.height){
+    return false;
+  }
+  r->rows_read++;
+
+  if (r->header.codec == IMAGE_CODEC_RAW){
+    return readRawRow(r, (uint8_t *)row, w * 2);
+  }
+
+  uint8_t *out = (uint8_t *)row;        // Written MSB first, the order the tft expects with SWAP_BYTES false
+  uint16_t px = r->prev;
+
+  for (int x = 0; x < w; x++){
+    if (r->run){
+      r->run--;
+    } else{
+      uint8_t op, b1, b2;
+      if (!nextByte(r, &op)) return false;
+
+      if (op == 0xFF){
+        return false;                       // Reserved, never written
+      } else if (op == OP_RGB){
+        if (!nextByte(r, &b1) || !nextByte(r, &b2)) return false;
+        px = (b1 << 8) | b2;
+      } else if ((op & OP_MASK) == OP_RUN){
+        r->run = op & 0x3F;                 // This pixel is the first of the run
+      } else if ((op & OP_MASK) == OP_INDEX){
+        px = r->index[op];
+      } else if ((op & OP_MASK) == OP_DIFF){
+        const int dr = ((op >> 4) & 3) - 2, dg = ((op >> 2) & 3) - 2, db = (op & 3) - 2;
+        px = ((((px >> 11) + dr) & 0x1F) << 11) | (((((px >> 5) & 0x3F) + dg) & 0x3F) << 5) | (((px & 0x1F) + db) & 0x1F);
+      } else{
+        if (!nextByte(r, &b1)) return false;
+        const int dg = (op & 0x3F) - 32;
+        const int dr = (b1 >> 4) - 8 + (dg >> 1), db = (b1 & 0x0F) - 8 + (dg >> 1);
+        px = ((((px >> 11) + dr) & 0x1F) << 11) | (((((px >> 5) & 0x3F) + dg) & 0x3F) << 5) | (((px & 0x1F) + db) & 0x1F);
+      }
+
+      if ((op & OP_MASK) != OP_RUN || op == OP_RGB){
+        r->index[pixelHash(px)] = px;
+      }
+    }
+    out[2 * x] = px >> 8;
+    out[2 * x + 1] = px & 0xFF;
+  }
+
+  r->prev = px;
+  return true;
+}
+
+int readImageRows(ImageReader *r, uint16_t *rows, int count){
+  const int w = r->header.width;
+  count = min(count, r->header.height - r->rows_read);
+  if (count <= 0){
+    return 0;
+  }
+
+  if (r->header.codec == IMAGE_CODEC_RAW){
+    r->rows_read += count;
+    return readRawRow(r, (uint8_t *)rows, w * 2 * count) ? count : -1;
+  }
+  for (int i = 0; i < count; i++){
+    if (!readImageRow(r, rows + i * w)){
+      return -1;
+    }
+  }
+  return count;
+}
+
+void closeImage(ImageReader *r){
+  closeCachedFile(&r->file);
+}
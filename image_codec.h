@@ -0,0 +1,69 @@
+/*
+
+Lossless RGB565 image files
+
+Photos are saved as a 20 byte header followed by the pixels, either raw or packed with a QOI style codec
+adapted to 16 bit pixels. Every pixel is one of:
+
+  INDEX  00iiiiii                     pixel seen recently, slot i of a 64 entry hash table
+  DIFF   01rrggbb                     r, g, b each changed by -2..1 from the previous pixel
+  LUMA   10gggggg rrrrbbbb            g changed by -32..31, r and b by -8..7 more than half of that
+  RUN    11nnnnnn                     previous pixel repeated n + 1 times (1..62)
+  RGB    11111110 hhhhhhhh llllllll   full pixel, MSB first
+
+Header (little endian): "MBI1", width u16, height u16, pixel format u8, codec u8, reserved u16,
+timestamp u32 (unix seconds), payload length u32
+
+Pixels come out in the same MSB first order the camera delivers and the tft takes, so decoded rows
+can be pushed as they are. Headerless .raw files from before the format are read as raw 240x240 frames
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <FS.h>
+#include <esp_camera.h>
+#include "block_cache.h"
+
+#define IMAGE_FILE_EXT ".mbi"
+#define IMAGE_HEADER_SIZE 20
+#define IMAGE_INDEX_SIZE 64
+#define IMAGE_READ_CHUNK 4096         // Bytes pulled from the SD per refill when decoding, each read call costs as much as ~300 bytes of transfer
+
+enum ImageCodec { IMAGE_CODEC_RAW = 0, IMAGE_CODEC_QOI = 1 };
+
+struct ImageHeader {
+  uint16_t width;
+  uint16_t height;
+  uint8_t format;                     // PIXFORMAT_RGB565
+  uint8_t codec;                      // ImageCodec
+  uint32_t timestamp;
+  uint32_t payload_len;
+};
+
+struct ImageReader {
+  CachedFile file;                    // Through the block cache, photos and sidecars read again come from PSRAM
+  ImageHeader header;
+  uint8_t chunk[IMAGE_READ_CHUNK];
+  int chunk_len;
+  int chunk_pos;
+  uint16_t prev;
+  int run;                            // Repeats of prev still owed, runs carry over row ends
+  uint16_t index[IMAGE_INDEX_SIZE];
+  int rows_read;
+};
+
+size_t imageMaxFileSize(int width, int height);      // Header plus raw pixels, the encoder never needs more
+
+size_t encodeImage(const uint8_t *pixels, int width, int height, uint32_t timestamp, uint8_t *out, size_t out_cap);  // Whole file into out, 0 if it doesn't fit
+
+size_t encodeFrame(const camera_fb_t *fb, uint32_t timestamp, uint8_t *out, size_t out_cap);   // Same for a camera fb
+
+bool openImage(ImageReader *reader, const char *path);   // Reads the header, false if the file is missing or unreadable
+
+bool readImageRow(ImageReader *reader, uint16_t *row);   // Next row of header.width pixels, false past the end or on a short file
+
+int readImageRows(ImageReader *reader, uint16_t *rows, int count);   // Up to count rows back to back, raw ones in one SD read. Rows read, -1 on a short file
+
+void closeImage(ImageReader *reader);
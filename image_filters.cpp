@@ -0,0 +1,249 @@
+#include "image_filters.h"
+#include <atomic>
+#include <Arduino.h>
+
+
+const FilterChain filter_chains[NUM_FILTER_CHAINS] = {
+  {"None", 0, {}},
+  {"Gray", 1, {FILTER_GRAYSCALE}},
+  {"Gray + contrast", 2, {FILTER_GRAYSCALE, FILTER_CONTRAST}},
+  {"Contrast", 1, {FILTER_CONTRAST}},
+  {"Edges", 1, {FILTER_SOBEL}},
+  {"Sketch", 2, {FILTER_SOBEL, FILTER_NEGATIVE}},
+  {"Posterize", 2, {FILTER_CONTRAST, FILTER_POSTERIZE}},
+  {"Negative", 1, {FILTER_NEGATIVE}},
+};
+
+float filter_stage_ms[FILTER_MAX_STAGES] = {};
+
+// The capture task sums the stage times and publishes their means once a second as one word, 16 bits of
+// hundredths of a ms per stage, so the display on the other core never sees half a second's numbers
+static uint32_t stage_us[FILTER_MAX_STAGES] = {};     // Summed since window_start_ms, frameCaptureTask only
+static uint32_t stage_frames = 0;
+static uint32_t window_start_ms = 0;
+static int timed_chain = -1;
+static std::atomic<uint32_t> published_costs(0);
+
+static_assert(FILTER_MAX_STAGES == 2, "stage costs are published as two 16 bit halves of one word");
+
+#define LANES(v) ((v) * 0x00010001u)                  // v in both 16 bit lanes
+#define LANE_BIAS 0x01000100u                         // 256 in both lanes, bit 8 is the comparison result
+
+const char *imageFilterName(ImageFilter filter){
+  static const char *names[NUM_IMAGE_FILTERS] = {"Gray", "Contrast", "Sobel", "Posterize", "Negative"};
+  return filter < NUM_IMAGE_FILTERS ? names[filter] : "?";
+}
+
+// ============================= Lane helpers =============================
+static inline uint32_t swapPair(uint32_t w){
+  // MSB first pixels to native RGB565 lanes and back
+  return ((w & 0x00FF00FFu) << 8) | ((w >> 8) & 0x00FF00FFu);
+}
+
+static inline uint32_t lumaPair(uint32_t p){
+  // Native lanes to 6 bit luma lanes, 0.299 r + 0.587 g + 0.114 b with white at 63. Largest sum is 16178
+  const uint32_t r = (p >> 11) & LANES(0x1F);
+  const uint32_t g = (p >> 5) & LANES(0x3F);
+  const uint32_t b = p & LANES(0x1F);
+  return ((r * 156 + g * 151 + b * 59) >> 8) & LANES(0x3F);
+}
+
+static inline uint32_t grayPair(uint32_t y){
+  // 6 bit lanes back to RGB565 grays
+  const uint32_t y5 = (y >> 1) & LANES(0x1F);
+  return (y5 << 11) | (y << 5) | y5;
+}
+
+static inline uint32_t laneMask(uint32_t bits){
+  // Bit 8 of each lane to 0xFFFF or 0
+  return ((bits >> 8) & LANES(1)) * 0xFFFFu;
+}
+
+static inline uint32_t clampLanes(uint32_t v, uint32_t max){
+  // Lanes below 256 saturated at max
+  const uint32_t over = laneMask((v | LANE_BIAS) - LANES(max + 1));
+  return (v & ~over) | (LANES(max) & over);
+}
+
+static inline uint32_t absDiffLanes(uint32_t a, uint32_t b){
+  // |a - b| of lanes below 256
+  const uint32_t ab = (a | LANE_BIAS) - b;
+  const uint32_t ba = (b | LANE_BIAS) - a;
+  const uint32_t a_bigger = laneMask(ab);
+  return ((ab & a_bigger) | (ba & ~a_bigger)) & LANES(0xFF);
+}
+
+static inline uint32_t stretchLanes(uint32_t c, uint32_t lo, uint32_t gain, uint32_t max){
+  // (c - lo) * gain / 256 floored at 0 and saturated at max, gain at most 1024 so a 6 bit lane stays in 16 bits
+  uint32_t d = (c | LANE_BIAS) - LANES(lo);
+  d &= laneMask(d) & LANES(0xFF);
+  return clampLanes(((d * gain) >> 8) & LANES(0xFF), max);
+}
+
+// ============================= Point filters =============================
+void grayscale565(uint16_t *pixels, int count){
+  uint32_t *w = (uint32_t *)pixels;
+  for (int i = 0; i < count / 2; i++){
+    w[i] = swapPair(grayPair(lumaPair(swapPair(w[i]))));
+  }
+}
+
+void negative565(uint16_t *pixels, int count){
+  // Every channel inverted is every bit inverted, in any byte order
+  uint32_t *w = (uint32_t *)pixels;
+  for (int i = 0; i < count / 2; i++){
+    w[i] = ~w[i];
+  }
+}
+
+void posterize565(uint16_t *pixels, int count){
+  // Keeps the top 2 bits of red and blue and 3 of green and sets the next one, so a level sits mid range
+  // Native masks 0xC718 and 0x2084, written byte swapped
+  uint32_t *w = (uint32_t *)pixels;
+  for (int i = 0; i < count / 2; i++){
+    w[i] = (w[i] & LANES(0x18C7)) | LANES(0x8420);
+  }
+}
+
+void contrast565(uint16_t *pixels, int width, int height){
+  // Percentiles from every 4th pixel of every 4th row, then one pass with the same gain on all three channels
+  uint32_t histogram[64] = {};
+  uint32_t samples = 0;
+  for (int y = 0; y < height; y += 4){
+    const uint16_t *row = pixels + y * width;
+    for (int x = 0; x < width; x += 4){
+      histogram[(row[x] & 0x07) << 3 | row[x] >> 13]++;     // Green of a byte swapped pixel
+      samples++;
+    }
+  }
+  const uint32_t cut = samples / 50;
+  uint32_t seen = 0;
+  int lo = 0, hi = 63;
+  while (lo < 63 && (seen += histogram[lo]) <= cut){
+    lo++;
+  }
+  seen = 0;
+  while (hi > 0 && (seen += histogram[hi]) <= cut){
+    hi--;
+  }
+  if (hi - lo < 4){
+    return;                                           // Flat frame, stretching would only show the noise
+  }
+  const uint32_t gain = min(63 * 256 / (hi - lo), 1024);
+
+  uint32_t *w = (uint32_t *)pixels;
+  for (int i = 0; i < width * height / 2; i++){
+    const uint32_t p = swapPair(w[i]);
+    const uint32_t r = stretchLanes((p >> 11) & LANES(0x1F), lo >> 1, gain, 0x1F);
+    const uint32_t g = stretchLanes((p >> 5) & LANES(0x3F), lo, gain, 0x3F);
+    const uint32_t b = stretchLanes(p & LANES(0x1F), lo >> 1, gain, 0x1F);
+    w[i] = swapPair((r << 11) | (g << 5) | b);
+  }
+}
+
+// ============================= Sobel =============================
+#define SOBEL_ROW_WORDS (FILTER_MAX_WIDTH / 2 + 2)        // One word of repeated edge either side
+
+static void lumaRow(const uint16_t *row, int width, uint32_t *out){
+  // Luma lanes with two pixels of the edge repeated either side, word k holds pixels 2k - 2 and 2k - 1
+  const uint32_t *w = (const uint32_t *)row;
+  const int words = width / 2;
+  for (int k = 0; k < words; k++){
+    out[k + 1] = lumaPair(swapPair(w[k]));
+  }
+  out[0] = LANES(out[1] & 0xFFFF);
+  out[words + 1] = LANES(out[words] >> 16);
+}
+
+bool sobel565(uint16_t *pixels, int width, int height){
+  // In place: row y is written once the luma of row y + 1 is taken, row y - 1 was taken before it was written
+  static uint32_t luma[3][SOBEL_ROW_WORDS];           // frameCaptureTask only
+  if (width > FILTER_MAX_WIDTH || width % 2 || height < 1){
+    return false;
+  }
+  const int words = width / 2;
+  uint32_t *top = luma[0], *mid = luma[1], *bot = luma[2];
+  lumaRow(pixels, width, mid);
+  memcpy(top, mid, sizeof(luma[0]));
+
+  for (int y = 0; y < height; y++){
+    if (y + 1 < height){
+      lumaRow(pixels + (y + 1) * width, width, bot);
+    } else{
+      memcpy(bot, mid, sizeof(luma[0]));
+    }
+
+    uint32_t *out = (uint32_t *)(pixels + y * width);
+    uint32_t vs_prev = top[0] + 2 * mid[0] + bot[0];  // Vertical smoothing, lanes up to 252
+    uint32_t vs = top[1] + 2 * mid[1] + bot[1];
+    for (int k = 1; k <= words; k++){
+      const uint32_t vs_next = top[k + 1] + 2 * mid[k + 1] + bot[k + 1];
+      const uint32_t gx = absDiffLanes((vs >> 16) | (vs_next << 16), (vs_prev >> 16) | (vs << 16));
+
+      // Horizontal smoothing of the rows above and below, the pixel pairs either side come from the neighbours
+      const uint32_t hs_top = ((top[k - 1] >> 16) | (top[k] << 16)) + 2 * top[k] + ((top[k] >> 16) | (top[k + 1] << 16));
+      const uint32_t hs_bot = ((bot[k - 1] >> 16) | (bot[k] << 16)) + 2 * bot[k] + ((bot[k] >> 16) | (bot[k + 1] << 16));
+      const uint32_t gy = absDiffLanes(hs_bot, hs_top);
+
+      const uint32_t edge = clampLanes(((gx + gy) >> 2) & LANES(0x7F), 0x3F);
+      out[k - 1] = swapPair(grayPair(edge));
+      vs_prev = vs;
+      vs = vs_next;
+    }
+
+    uint32_t *done = top;                             // Rotate the window down one row
+    top = mid;
+    mid = bot;
+    bot = done;
+  }
+  return true;
+}
+
+// ============================= Chains =============================
+bool applyImageFilter(ImageFilter filter, uint16_t *pixels, int width, int height){
+  if ((width * height) % 2 || (uintptr_t)pixels % 4){
+    return false;
+  }
+  switch (filter){
+    case FILTER_GRAYSCALE:  grayscale565(pixels, width * height);   return true;
+    case FILTER_CONTRAST:   contrast565(pixels, width, height);     return true;
+    case FILTER_SOBEL:      return sobel565(pixels, width, height);
+    case FILTER_POSTERIZE:  posterize565(pixels, width * height);   return true;
+    case FILTER_NEGATIVE:   negative565(pixels, width * height);    return true;
+    default:                return false;
+  }
+}
+
+void applyFilterChain(int chain, uint16_t *pixels, int width, int height){
+  const FilterChain *c = &filter_chains[constrain(chain, 0, NUM_FILTER_CHAINS - 1)];
+  if (chain != timed_chain){                          // Costs of the last chain don't carry over
+    memset(stage_us, 0, sizeof(stage_us));
+    stage_frames = 0;
+    timed_chain = chain;
+  }
+  for (int i = 0; i < c->stages; i++){
+    const uint32_t start_us = micros();
+    applyImageFilter(c->stage[i], pixels, width, height);
+    stage_us[i] += micros() - start_us;
+  }
+  stage_frames++;
+
+  const uint32_t now = millis();
+  if (now - window_start_ms >= 1000){
+    uint32_t costs = 0;
+    for (int i = 0; i < FILTER_MAX_STAGES; i++){
+      costs |= min(stage_us[i] / 10 / stage_frames, (uint32_t)0xFFFF) << (16 * i);
+      stage_us[i] = 0;
+    }
+    published_costs = costs;
+    stage_frames = 0;
+    window_start_ms = now;
+  }
+}
+
+void updateFilterCosts(){
+  const uint32_t costs = published_costs;
+  for (int i = 0; i < FILTER_MAX_STAGES; i++){
+    filter_stage_ms[i] = ((costs >> (16 * i)) & 0xFFFF) / 100.f;
+  }
+}
@@ -0,0 +1,55 @@
+/*
+
+Live filters for the camera preview
+
+frameCaptureTask runs the chosen chain of stages over each preview frame in place, after a frame due for saving
+was copied into the frame ring (photos stay unfiltered) and before it goes to the display. Every stage is
+fixed point and works on two pixels per 32 bit word, each 16 bit lane holding one channel of one pixel
+with room above it, so adds and multiplies never carry into the other pixel. Comparisons are done by
+biasing a lane by 256 and reading bit 8 back as the result
+
+Pixels are MSB first like the camera delivers them, so on the little endian ESP32 each lane holds a byte
+swapped pixel. Negative and posterize work on the swapped lanes as they are, the rest swap both pixels with
+one mask and shift first
+
+Contrast stretches each channel between the 2nd and 98th percentile of a sparse green histogram of the frame
+itself. Sobel takes |Gx| + |Gy| over a rolling window of three luma rows, the edges of the frame repeat
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include "globals.h"
+
+#define FILTER_MAX_STAGES 2
+#define FILTER_MAX_WIDTH IMAGE_WIDTH    // Sobel's luma rows are sized for the preview
+#define NUM_FILTER_CHAINS 8
+
+enum ImageFilter { FILTER_GRAYSCALE, FILTER_CONTRAST, FILTER_SOBEL, FILTER_POSTERIZE, FILTER_NEGATIVE, NUM_IMAGE_FILTERS };
+
+struct FilterChain {
+  const char *name;
+  int stages;                           // 0 for the unfiltered preview
+  ImageFilter stage[FILTER_MAX_STAGES];
+};
+
+extern const FilterChain filter_chains[NUM_FILTER_CHAINS];
+extern float filter_stage_ms[FILTER_MAX_STAGES];           // Mean cost per frame of each stage of the running chain, over the last second
+
+const char *imageFilterName(ImageFilter filter);
+
+void grayscale565(uint16_t *pixels, int count);             // count even, pixels 4 byte aligned like every kernel here
+
+void negative565(uint16_t *pixels, int count);
+
+void posterize565(uint16_t *pixels, int count);             // 4 levels of red and blue, 8 of green
+
+void contrast565(uint16_t *pixels, int width, int height);
+
+bool sobel565(uint16_t *pixels, int width, int height);     // Edge strength as gray, false if wider than FILTER_MAX_WIDTH
+
+bool applyImageFilter(ImageFilter filter, uint16_t *pixels, int width, int height);    // false if the frame doesn't suit the filter
+
+void applyFilterChain(int chain, uint16_t *pixels, int width, int height);   // frameCaptureTask only, times every stage
+
+void updateFilterCosts();                                   // Once a second, copies the costs frameCaptureTask last published into filter_stage_ms
@@ -0,0 +1,197 @@
+#include "image_ops.h"
+#include <Arduino.h>
+
+
+// Destination index of source pixel (x, y) for each kind of tiled copy
+// Transpose and the 90/ 270 rotations produce a height wide, width tall image
+enum TileMap {
+  MAP_TRANSPOSE,
+  MAP_ROTATE_90,
+  MAP_ROTATE_270
+};
+
+static void tiledCopy(const uint16_t *src, uint16_t *dst, int width, int height, TileMap map){
+  // Reads each tile row by row and writes it column by column, one tile at a time
+
+  for (int ty = 0; ty < height; ty += IMAGE_TILE){
+    const int y_end = min(ty + IMAGE_TILE, height);
+
+    for (int tx = 0; tx < width; tx += IMAGE_TILE){
+      const int x_end = min(tx + IMAGE_TILE, width);
+
+      for (int y = ty; y < y_end; y++){
+        const uint16_t *row = src + y * width;
+
+        switch (map){
+          case MAP_TRANSPOSE:                         // (x, y) -> (y, x)
+            for (int x = tx; x < x_end; x++){
+              dst[x * height + y] = row[x];
+            }
+            break;
+          case MAP_ROTATE_90:                         // (x, y) -> (height - 1 - y, x)
+            for (int x = tx; x < x_end; x++){
+              dst[x * height + (height - 1 - y)] = row[x];
+            }
+            break;
+          case MAP_ROTATE_270:                        // (x, y) -> (y, width - 1 - x)
+            for (int x = tx; x < x_end; x++){
+              dst[(width - 1 - x) * height + y] = row[x];
+            }
+            break;
+        }
+      }
+    }
+  }
+}
+
+void transpose565(const uint16_t *src, uint16_t *dst, int width, int height){
+  tiledCopy(src, dst, width, height, MAP_TRANSPOSE);
+}
+
+void transposeInPlace565(uint16_t *buf, int size){
+  // Swaps tile (i, j) with tile (j, i), tiles on the diagonal swap with themselves across their own diagonal
+
+  for (int ty = 0; ty < size; ty += IMAGE_TILE){
+    const int y_end = min(ty + IMAGE_TILE, size);
+
+    for (int tx = ty; tx < size; tx += IMAGE_TILE){
+      const int x_end = min(tx + IMAGE_TILE, size);
+
+      for (int y = ty; y < y_end; y++){
+        uint16_t *row = buf + y * size;
+        for (int x = (tx == ty) ? y + 1 : tx; x < x_end; x++){
+          uint16_t tmp = row[x];
+          row[x] = buf[x * size + y];
+          buf[x * size + y] = tmp;
+        }
+      }
+    }
+  }
+}
+
+static void reverse565(uint16_t *buf, int len){
+  for (int i = 0, j = len - 1; i < j; i++, j--){
+    uint16_t tmp = buf[i];
+    buf[i] = buf[j];
+    buf[j] = tmp;
+  }
+}
+
+void mirror565(uint16_t *buf, int width, int height, bool horizontal){
+
+  if (horizontal){
+    for (int y = 0; y < height; y++){
+      reverse565(buf + y * width, width);
+    }
+    return;
+  }
+
+  // Vertical, swap whole rows from the outside in
+  for (int top = 0, bottom = height - 1; top < bottom; top++, bottom--){
+    uint16_t *a = buf + top * width;
+    uint16_t *b = buf + bottom * width;
+    for (int x = 0; x < width; x++){
+      uint16_t tmp = a[x];
+      a[x] = b[x];
+      b[x] = tmp;
+    }
+  }
+}
+
+bool rotate565(const uint16_t *src, uint16_t *dst, int width, int height, int degrees){
+
+  switch (degrees){
+    case 0:
+      memcpy(dst, src, width * height * sizeof(uint16_t));
+      return true;
+    case 90:
+      tiledCopy(src, dst, width, height, MAP_ROTATE_90);
+      return true;
+    case 180:
+      for (int i = 0, n = width * height; i < n; i++){
+        dst[n - 1 - i] = src[i];                      // Both sides stream sequentially, no tiling needed
+      }
+      return true;
+    case 270:
+      tiledCopy(src, dst, width, height, MAP_ROTATE_270);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool rotateInPlace565(uint16_t *buf, int width, int height, int degrees){
+  // 180 reverses the whole buffer, 90/ 270 are a transpose followed by a mirror
+
+  switch (degrees){
+    case 0:
+      return true;
+    case 180:
+      reverse565(buf, width * height);
+      return true;
+    case 90:
+    case 270:
+      if (width != height){
+        return false;                                 // Non square needs a second buffer, use rotate565()
+      }
+      transposeInPlace565(buf, width);
+      mirror565(buf, width, height, degrees == 90);
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool rotateFrame(camera_fb_t *fb, int degrees, uint16_t *scratch){
+  // Rotates a RGB565 frame in place, going through scratch (fb->len bytes) when it can't be done in place
+
+  uint16_t *pixels = (uint16_t *)fb->buf;
+  const int width = fb->width;
+  const int height = fb->height;
+
+  if (!rotateInPlace565(pixels, width, height, degrees)){
+    if (!scratch || !rotate565(pixels, scratch, width, height, degrees)){
+      return false;
+    }
+    memcpy(pixels, scratch, width * height * sizeof(uint16_t));
+  }
+
+  if (degrees == 90 || degrees == 270){
+    fb->width = height;
+    fb->height = width;
+  }
+  return true;
+}
+
+void upscale565(const uint16_t *src, int src_stride, uint16_t *dst, int width, int height, int factor){
+  // Each source row is widened once, two pixels per 32 bit store for 2x and 4x, then copied down factor - 1 times
+
+  const int dst_width = width * factor;
+
+  for (int y = 0; y < height; y++){
+    const uint16_t *in = src + y * src_stride;
+    uint16_t *out = dst + y * factor * dst_width;
+
+    if (factor == 2 || factor == 4){
+      uint32_t *out32 = (uint32_t *)out;
+      for (int x = 0; x < width; x++){
+        const uint32_t pair = in[x] | ((uint32_t)in[x] << 16);
+        *out32++ = pair;
+        if (factor == 4){
+          *out32++ = pair;
+        }
+      }
+    } else{
+      for (int x = 0; x < width; x++){
+        for (int i = 0; i < factor; i++){
+          *out++ = in[x];
+        }
+      }
+      out = dst + y * factor * dst_width;
+    }
+
+    for (int i = 1; i < factor; i++){
+      memcpy(out + i * dst_width, out, dst_width * sizeof(uint16_t));
+    }
+  }
+}
@@ -0,0 +1,33 @@
+/*
+
+RGB565 image kernels
+
+Transpose, rotate, mirror and upscale on 16 bit pixels. Pixels are moved as whole uint16_t values, so byte order
+doesn't matter (works on camera frames and panel order buffers alike)
+
+The transposing kernels walk the image in IMAGE_TILE x IMAGE_TILE tiles, so the source rows and the
+destination columns of one tile stay in cache (PSRAM is only reached through the 32 kB cache on the ESP32)
+
+Rotations are clockwise in degrees (0, 90, 180, 270)
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include <esp_camera.h>
+
+#define IMAGE_TILE 16                 // 16 pixels = 32 bytes, one cache line per tile row
+
+void transpose565(const uint16_t *src, uint16_t *dst, int width, int height);   // dst is height wide and width tall
+
+void transposeInPlace565(uint16_t *buf, int size);                              // Square images only
+
+bool rotate565(const uint16_t *src, uint16_t *dst, int width, int height, int degrees);   // dst must not overlap src
+
+bool rotateInPlace565(uint16_t *buf, int width, int height, int degrees);      // 90/ 270 need a square image
+
+void mirror565(uint16_t *buf, int width, int height, bool horizontal);         // Horizontal flips left/ right
+
+bool rotateFrame(camera_fb_t *fb, int degrees, uint16_t *scratch);              // Swaps fb width/ height for 90/ 270, scratch only needed if not square
+
+void upscale565(const uint16_t *src, int src_stride, uint16_t *dst, int width, int height, int factor);   // Nearest neighbour, width x height pixels to factor times that, dst 4 byte aligned
@@ -23,8 +23,6 @@ Author: Yuvraj Sandhu
 #include <WiFi.h>               // Wifi Connectivity
 #include <time.h>               // NTP time and 
 #include <esp_camera.h>         // Camera drivers
-#include <vector>               // For filenames array that changes size
-#include <queue>                // For holding ram usage over time and removing oldest
 
 // My includes
 #include "globals.h"            // All defines and global variables
@@ -32,6 +30,14 @@ Author: Yuvraj Sandhu
 #include "button_handlers.h"    // Various button handling functions for different apps
 #include "display.h"            // Drawing functions for TFT display
 #include "helpers.h"            // General/ helper functions
+#include "compositor.h"         // Dirty rectangle tracking between the draw functions and the display
+#include "timeseries.h"         // Heap, PSRAM and largest block history for the System Data graph
+#include "file_index.h"         // Photo list kept on the SD card, so the file browser doesn't rescan
+#include "sd_writer.h"          // Write-behind SD writes for saved photos
+#include "frame_ring.h"         // PSRAM ring of captured frames waiting to be saved
+#include "thumbnail.h"          // Small sidecar copies of the photos for the SD gallery
+#include "viewer_cache.h"       // Decoded photos around the one in the image viewer
+#include "block_cache.h"        // PSRAM read cache under the photo and sidecar reads
 
 void setup() {
 
@@ -45,9 +51,15 @@ void setup() {
   initWiFi();
   initNTP();
   initSD();
+  initBlockCache();
   initTFT();
-  initHeapQueue();
-  loadFileNames();
+  initCompositor();
+  initTimeSeries();
+  loadFileIndex();
+  initSdWriter();
+  initFrameRing();
+  initThumbnails();
+  initViewerCache();
 
   // Create tasks
   xTaskCreatePinnedToCore(
@@ -105,10 +117,53 @@ void setup() {
   );
   Serial.println("ntpTimeTask initialized");
 
+  xTaskCreatePinnedToCore(
+    sdWriterTask,                // Task function
+    "sdWriterTask",              // Task name
+    5000,                        // Stack size (bytes)
+    NULL,                        // Task parameters
+    1,                           // Priority
+    NULL,                        // Task handle
+    1                            // Core ID
+  );
+  Serial.println("sdWriterTask initialized");
+
+  xTaskCreatePinnedToCore(
+    saveFrameToSDTask,           // Task function
+    "saveFrameToSDTask",         // Task name
+    5000,                        // Stack size (bytes)
+    NULL,                        // Task parameters
+    1,                           // Priority
+    &saveFrameToSDTask_handle,   // Task handle
+    1                            // Core ID
+  );
+  Serial.println("saveFrameToSDTask initialized");
+
+  xTaskCreatePinnedToCore(
+    thumbnailTask,               // Task function
+    "thumbnailTask",             // Task name
+    5000,                        // Stack size (bytes)
+    NULL,                        // Task parameters
+    0,                           // Priority (below everything, backfills only run on idle time)
+    NULL,                        // Task handle
+    1                            // Core ID
+  );
+  Serial.println("thumbnailTask initialized");
+
+  xTaskCreatePinnedToCore(
+    prefetchTask,                // Task function
+    "prefetchTask",              // Task name
+    5000,                        // Stack size (bytes)
+    NULL,                        // Task parameters
+    1,                           // Priority
+    NULL,                        // Task handle
+    1                            // Core ID
+  );
+  Serial.println("prefetchTask initialized");
+
   // Suspend all tasks that won't be used at start
-  vTaskSuspend(saveFrameToSDTask_handle);
   vTaskSuspend(deleteFromSDTask_handle);
-  Serial.println("Suspended frame capture, save to sd, delete from sd tasks.");
+  Serial.println("Suspended delete from sd task.");
 }
 
 void loop() {
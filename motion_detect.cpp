@@ -0,0 +1,95 @@
+#include "motion_detect.h"
+#include <Arduino.h>
+
+
+MotionStats motion_stats = {};
+
+static uint16_t reference[MOTION_GRID * MOTION_GRID];   // Block values x16, running average
+static uint8_t current[MOTION_GRID * MOTION_GRID];
+static volatile bool watching = false;
+static volatile bool reset_reference = false;           // Set by the button handler, done by the capture task
+static bool armed = true;                               // Cleared by a trigger, set again once the scene is quiet
+static uint32_t last_trigger_ms = 0;
+
+void startMotionWatch(){
+  reset_reference = true;
+  watching = true;
+}
+
+void stopMotionWatch(){
+  watching = false;
+}
+
+bool motionWatching(){
+  return watching;
+}
+
+static inline uint8_t green(const uint8_t *px){
+  return ((px[0] & 0x07) << 3) | (px[1] >> 5);          // MSB first RGB565
+}
+
+static void measureBlocks(const camera_fb_t *fb){
+  // Green of the pixels a quarter and three quarters into each block, both ways
+  const int bw = fb->width / MOTION_GRID, bh = fb->height / MOTION_GRID;
+  const int x0 = bw / 4, x1 = bw * 3 / 4, y0 = bh / 4, y1 = bh * 3 / 4;
+  const size_t stride = fb->width * 2;
+
+  for (int by = 0; by < MOTION_GRID; by++){
+    const uint8_t *top = fb->buf + (by * bh + y0) * stride;
+    const uint8_t *bottom = fb->buf + (by * bh + y1) * stride;
+    for (int bx = 0; bx < MOTION_GRID; bx++){
+      const int left = (bx * bw + x0) * 2, right = (bx * bw + x1) * 2;
+      current[by * MOTION_GRID + bx] = green(top + left) + green(top + right) + green(bottom + left) + green(bottom + right);
+    }
+  }
+}
+
+bool detectMotion(const camera_fb_t *fb){
+  if (!watching || fb->format != PIXFORMAT_RGB565 || fb->width < MOTION_GRID || fb->height < MOTION_GRID){
+    return false;
+  }
+  const uint32_t start_us = micros();
+  const int blocks = MOTION_GRID * MOTION_GRID;
+  measureBlocks(fb);
+
+  if (reset_reference){
+    reset_reference = false;
+    for (int i = 0; i < blocks; i++){
+      reference[i] = current[i] << 4;
+    }
+    motion_stats = {};
+    armed = true;
+  }
+
+  // Mean difference first, a change of brightness across the whole frame isn't motion
+  int32_t sum = 0;
+  for (int i = 0; i < blocks; i++){
+    sum += (current[i] << 4) - reference[i];
+  }
+  const int32_t mean = sum / blocks;
+
+  int changed = 0;
+  for (int i = 0; i < blocks; i++){
+    const int32_t diff = (current[i] << 4) - reference[i];
+    changed += abs(diff - mean) > MOTION_BLOCK_DELTA << 4;
+    reference[i] += diff / 8;                           // Eighth of the way to the new value, sums of 4 bit steps stay exact
+  }
+
+  const bool warm = ++motion_stats.frames > MOTION_WARMUP_FRAMES;
+  const int percent_x100 = changed * 10000 / blocks;
+  motion_stats.changed_percent = percent_x100 / 100.f;
+
+  bool trigger = false;
+  if (percent_x100 < MOTION_RELEASE_X100){
+    armed = true;
+  }
+  else if (warm && armed && percent_x100 >= MOTION_TRIGGER_PERCENT * 100 &&
+           (!motion_stats.triggers || millis() - last_trigger_ms >= MOTION_COOLDOWN_MS)){
+    armed = false;
+    trigger = true;
+    last_trigger_ms = millis();
+    motion_stats.triggers++;
+  }
+  motion_stats.cost_us = micros() - start_us;
+  return trigger;
+}
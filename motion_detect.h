@@ -0,0 +1,49 @@
+/*
+
+Motion detection for the camera's motion mode
+
+While watching, frameCaptureTask hands every frame to detectMotion() before anything else touches it. The frame
+is cut into MOTION_GRID x MOTION_GRID blocks and each block is measured by the green of four pixels in it, 3600
+pixel reads for a 240x240 frame instead of 57600. The reference is a running average of those block values, so
+slow light changes fade into it, and the mean difference over all blocks is taken off every block first, so
+the sensor's auto exposure stepping doesn't look like motion
+
+A block has changed when it is more than MOTION_BLOCK_DELTA away from the reference. MOTION_TRIGGER_PERCENT of
+the blocks changed starts a save of MOTION_SAVE_FRAMES frames through the frame ring. Then it stays quiet until
+the change falls under half of MOTION_TRIGGER_PERCENT (hysteresis, one save per movement, not one per frame of it) and
+MOTION_COOLDOWN_MS have passed
+
+Set the threshold with -DMOTION_TRIGGER_PERCENT=..., lower is more sensitive
+
+*/
+
+#pragma once
+#include <esp_camera.h>
+#include "globals.h"
+
+#define MOTION_GRID 30                  // 8x8 pixel blocks of a 240x240 frame
+#define MOTION_BLOCK_DELTA 24           // Four green samples summed (0..252), about 10% of the range per pixel
+#ifndef MOTION_TRIGGER_PERCENT
+#define MOTION_TRIGGER_PERCENT 4
+#endif
+#define MOTION_RELEASE_X100 (MOTION_TRIGGER_PERCENT * 50)   // Half the trigger in hundredths of a percent, still above 0 for a trigger of 1
+#define MOTION_COOLDOWN_MS 5000
+#define MOTION_SAVE_FRAMES 3
+#define MOTION_WARMUP_FRAMES 8          // Frames the reference settles for after watching starts, nothing triggers
+
+struct MotionStats {
+  uint32_t frames;                      // Frames measured since watching started
+  uint32_t triggers;                    // Saves started
+  float changed_percent;                // Blocks changed in the last frame
+  uint32_t cost_us;                     // detectMotion() on the last frame
+};
+
+extern MotionStats motion_stats;
+
+void startMotionWatch();                // Resets the reference, the next frames are the new background
+
+void stopMotionWatch();
+
+bool motionWatching();
+
+bool detectMotion(const camera_fb_t *fb);   // frameCaptureTask only, true when a save should start now
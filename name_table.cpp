@@ -0,0 +1,133 @@
+#include "name_table.h"
+
+
+NameTable filenames = {};                 // Every photo on the card, see file_index.h
+NameTable marked_files = {};              // Photos marked in the gallery for a batch delete, display task only
+
+bool initNameTable(NameTable *table, int capacity, size_t arena_size){
+  table->arena = (char *)ps_malloc(arena_size);
+  table->offsets = (uint32_t *)ps_malloc(capacity * sizeof(uint32_t));
+  if (!table->arena || !table->offsets){
+    free(table->arena);
+    free(table->offsets);
+    *table = {};
+    return false;
+  }
+  table->capacity = capacity;
+  table->arena_size = arena_size;
+  clearNames(table);
+  return true;
+}
+
+void clearNames(NameTable *table){
+  table->count = 0;
+  table->arena_used = 0;
+  table->dead_bytes = 0;
+}
+
+static int compareNames(const char *a, const char *b){
+  // strcmp, except that '/' and '_' right after the date compare equal (ties broken by strcmp), so photos sort by
+  // time whether they're in their day's directory, /YYYY-MM-DD/hh-mm-ss, or in the root from before, /YYYY-MM-DD_hh-mm-ss
+  for (int i = 0;; i++){
+    uint8_t ca = a[i], cb = b[i];
+    if (i == 11){
+      ca = ca == '_' ? '/' : ca;
+      cb = cb == '_' ? '/' : cb;
+    }
+    if (ca != cb){
+      return ca - cb;
+    }
+    if (!ca){
+      return strcmp(a, b);
+    }
+  }
+}
+
+int lowerBoundName(const NameTable *table, const char *key){
+  int lo = 0, hi = table->count;
+  while (lo < hi){
+    const int mid = (lo + hi) / 2;
+    if (compareNames(table->arena + table->offsets[mid], key) < 0){
+      lo = mid + 1;
+    } else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+int findName(const NameTable *table, const char *name){
+  const int i = lowerBoundName(table, name);
+  return i < table->count && !strcmp(table->arena + table->offsets[i], name) ? i : -1;
+}
+
+static void compactNames(NameTable *table){
+  // Walks the arena in order and slides every live name down over the dead ones, so a name never moves up.
+  // A name is live if its entry points at this copy, a removed name that was added again has a dead copy too
+  size_t used = 0;
+  for (size_t pos = 0; pos < table->arena_used;){
+    const char *name = table->arena + pos;
+    const size_t len = strlen(name) + 1;
+    const int i = findName(table, name);
+    if (i >= 0 && table->offsets[i] == pos){
+      memmove(table->arena + used, name, len);
+      table->offsets[i] = used;
+      used += len;
+    }
+    pos += len;
+  }
+  table->arena_used = used;
+  table->dead_bytes = 0;
+}
+
+bool insertName(NameTable *table, const char *name){
+  const size_t len = strlen(name) + 1;
+  const int i = lowerBoundName(table, name);
+  if (i < table->count && !strcmp(table->arena + table->offsets[i], name)){
+    return true;
+  }
+  if (table->count == table->capacity){
+    return false;
+  }
+  if (table->arena_used + len > table->arena_size && table->dead_bytes){
+    compactNames(table);
+  }
+  if (table->arena_used + len > table->arena_size){
+    return false;
+  }
+
+  memcpy(table->arena + table->arena_used, name, len);
+  memmove(&table->offsets[i + 1], &table->offsets[i], (table->count - i) * sizeof(uint32_t));
+  table->offsets[i] = table->arena_used;
+  table->count++;
+  table->arena_used += len;
+  return true;
+}
+
+void removeName(NameTable *table, int index){
+  if (index < 0 || index >= table->count){
+    return;
+  }
+  table->dead_bytes += strlen(table->arena + table->offsets[index]) + 1;
+  memmove(&table->offsets[index], &table->offsets[index + 1], (table->count - index - 1) * sizeof(uint32_t));
+  table->count--;
+
+  if (table->dead_bytes > table->arena_size / 2){
+    compactNames(table);
+  }
+}
+
+const char *getName(const NameTable *table, int index){
+  if (index < 0 || index >= table->count){
+    return "";
+  }
+  return table->arena + table->offsets[index];
+}
+
+size_t nameTableBytes(const NameTable *table){
+  return table->arena_size + table->capacity * sizeof(uint32_t);
+}
+
+size_t nameTableUsedBytes(const NameTable *table){
+  return table->arena_used - table->dead_bytes + table->count * sizeof(uint32_t);
+}
@@ -0,0 +1,50 @@
+/*
+
+Name table for the file list
+
+All names live back to back in one arena, NUL terminated, with an offset per entry, both allocated once in
+PSRAM. Adding a name is a copy to the end of the arena and removing one only moves the offsets after it, so
+nothing is allocated per name and the internal heap is left alone
+
+Entries are kept sorted and unique, so lookups are binary searches. Photo names sort by capture time (a day
+directory and the root sort together, see compareNames), a new photo usually goes on the end. Index i stays the same name until a name before it is added or removed.
+Space freed by removals is reclaimed by compacting the arena once it's needed or half of the arena is dead
+
+*/
+
+#pragma once
+#include "globals.h"
+
+#define NAME_TABLE_ENTRIES 4096
+#define NAME_TABLE_ARENA_BYTES (NAME_TABLE_ENTRIES * 28)    // "/YYYY-MM-DD/hh-mm-ss_NN.mbi" plus its NUL, burst frames get the _NN
+
+struct NameTable {
+  char *arena;
+  uint32_t *offsets;              // Arena offset of each entry, in name order
+  int count;
+  int capacity;
+  size_t arena_used;              // Bytes up to the end of the last name
+  size_t arena_size;
+  size_t dead_bytes;              // Bytes of removed names still in the arena
+};
+
+extern NameTable filenames;
+extern NameTable marked_files;
+
+bool initNameTable(NameTable *table, int capacity, size_t arena_size);   // false if PSRAM ran out
+
+void clearNames(NameTable *table);
+
+bool insertName(NameTable *table, const char *name);       // Into its sorted place, true if it was there already, false if the table is full
+
+void removeName(NameTable *table, int index);
+
+const char *getName(const NameTable *table, int index);    // Valid until the table changes, "" out of range
+
+int findName(const NameTable *table, const char *name);    // -1 if missing
+
+int lowerBoundName(const NameTable *table, const char *key);   // First entry not sorting before key, count if none
+
+size_t nameTableBytes(const NameTable *table);             // PSRAM reserved for the table
+
+size_t nameTableUsedBytes(const NameTable *table);         // Of that, holding live names and their offsets
@@ -0,0 +1,197 @@
+#include <atomic>
+#include <Arduino.h>
+#include "night_capture.h"
+#include "frame_ring.h"
+
+
+NightStats night_stats = {};
+
+static std::atomic<bool> requested(false);          // Set by the button handler, cleared by the capture task once the photo is in
+static uint32_t *accumulator = NULL;                // Packed channel sums, only while a photo is being taken
+static int frames_in = 0;
+static int width = 0, height = 0;
+static uint32_t first_ms = 0;
+static uint32_t first_timestamp = 0;
+static uint32_t cost_us = 0;
+static int max_shift = 0;
+static int32_t ref_cols[IMAGE_WIDTH], ref_rows[IMAGE_HEIGHT];   // Edge profiles of the first frame
+static int32_t cols[IMAGE_WIDTH], rows[IMAGE_HEIGHT];
+
+static_assert(NIGHT_FRAMES >= 1 && NIGHT_FRAMES <= 32, "10 bits of blue sum hold 32 frames");
+
+bool requestNightCapture(){
+  if (requested){
+    return false;
+  }
+  requested = true;
+  return true;
+}
+
+bool nightCapturePending(){
+  return requested;
+}
+
+static void dropNightCapture(){
+  free(accumulator);
+  accumulator = NULL;
+  frames_in = 0;
+  requested = false;
+}
+
+void endNightCapture(){
+  dropNightCapture();
+}
+
+// ============================= Alignment =============================
+static void edgeProfiles(const uint8_t *buf, int32_t *col_sums, int32_t *row_sums){
+  // Green steps to the left summed down each column and steps up summed along each row, so the profiles
+  // peak at edges, which plain sums of a textured scene can average away
+  static uint8_t above[IMAGE_WIDTH];
+  memset(col_sums, 0, width * sizeof(int32_t));
+  for (int y = 0; y < height; y++){
+    const uint8_t *px = buf + y * width * 2;
+    int32_t row_sum = 0;
+    uint8_t left = ((px[0] & 0x07) << 3) | (px[1] >> 5);
+    for (int x = 0; x < width; x++, px += 2){
+      const uint8_t g = ((px[0] & 0x07) << 3) | (px[1] >> 5);   // MSB first RGB565
+      col_sums[x] += abs(g - left);
+      row_sum += y ? abs(g - above[x]) : 0;
+      above[x] = left = g;
+    }
+    row_sums[y] = row_sum;
+  }
+}
+
+static int bestShift(const int32_t *ref, const int32_t *cur, int n, int32_t clip){
+  // Shift s where cur[i + s] matches ref[i] best, by the mean difference over the overlap, no shift wins ties
+  // Each difference is clipped, so something moving through the frame can't outvote the background
+  int best = 0;
+  int64_t best_sad = -1, best_count = 1;
+  for (int s = -NIGHT_MAX_SHIFT; s <= NIGHT_MAX_SHIFT; s++){
+    int64_t sad = 0;
+    const int start = max(0, -s), end = min(n, n - s);
+    for (int i = start; i < end; i++){
+      sad += min(abs(ref[i] - cur[i + s]), clip);
+    }
+    const int64_t count = end - start;
+    if (best_sad < 0 || sad * best_count < best_sad * count || (sad * best_count == best_sad * count && abs(s) < abs(best))){
+      best = s;
+      best_sad = sad;
+      best_count = count;
+    }
+  }
+  return best;
+}
+
+// ============================= Accumulation =============================
+static inline uint32_t packPixel(const uint8_t *px){
+  // RGB565 to red << 21 | green << 10 | blue, each with room for 32 frames of sums above it
+  const uint32_t p = (px[0] << 8) | px[1];
+  return ((p & 0xF800) << 10) | ((p & 0x07E0) << 5) | (p & 0x1F);
+}
+
+static void addRow(uint32_t *acc, const uint8_t *row, int dx){
+  // acc[x] += row[x + dx], the edge pixel repeats where x + dx falls outside
+  const int start = max(0, -dx), end = min(width, width - dx);
+  const uint32_t left = packPixel(row), right = packPixel(row + (width - 1) * 2);
+  for (int x = 0; x < start; x++){
+    acc[x] += left;
+  }
+  const uint8_t *px = row + (start + dx) * 2;
+  for (int x = start; x < end; x++, px += 2){
+    acc[x] += packPixel(px);
+  }
+  for (int x = end; x < width; x++){
+    acc[x] += right;
+  }
+}
+
+static void resolveInPlace(){
+  // Sums back to MSB first RGB565 over the front half of the accumulator, pixel i's bytes land at or before
+  // the word they come from, so nothing is overwritten before it's read
+  const uint32_t n = frames_in;
+  uint8_t *out = (uint8_t *)accumulator;
+  for (int i = 0; i < width * height; i++){
+    const uint32_t a = accumulator[i];
+    const uint32_t r = ((a >> 21) + n / 2) / n;
+    const uint32_t g = (((a >> 10) & 0x7FF) + n / 2) / n;
+    const uint32_t b = ((a & 0x3FF) + n / 2) / n;
+    const uint16_t c = (r << 11) | (g << 5) | b;
+    out[2 * i] = c >> 8;
+    out[2 * i + 1] = c & 0xFF;
+  }
+}
+
+bool accumulateNightFrame(const camera_fb_t *fb, uint32_t timestamp){
+  if (!requested){
+    return false;
+  }
+  const uint32_t start_us = micros();
+
+  if (!accumulator){                                // First frame, the others line up with it
+    if (fb->format != PIXFORMAT_RGB565 || fb->width > IMAGE_WIDTH || fb->height > IMAGE_HEIGHT){
+      Serial.println("Night photo needs the RGB565 preview");
+      dropNightCapture();
+      return false;
+    }
+    width = fb->width;
+    height = fb->height;
+    accumulator = (uint32_t *)ps_malloc(width * height * sizeof(uint32_t));
+    if (!accumulator){
+      Serial.println("Not enough PSRAM for a night photo");
+      frame_ring_stats.dropped++;
+      dropNightCapture();
+      return false;
+    }
+    memset(accumulator, 0, width * height * sizeof(uint32_t));
+    frames_in = 0;
+    first_ms = millis();
+    first_timestamp = timestamp;
+    cost_us = 0;
+    max_shift = 0;
+  }
+  else if ((int)fb->width != width || (int)fb->height != height){
+    Serial.println("Night photo dropped, the frame size changed");
+    frame_ring_stats.dropped++;
+    dropNightCapture();
+    return false;
+  }
+
+  int dx = 0, dy = 0;
+  if (NIGHT_MAX_SHIFT > 0){
+    if (frames_in == 0){
+      edgeProfiles(fb->buf, ref_cols, ref_rows);
+    } else{
+      edgeProfiles(fb->buf, cols, rows);
+      dx = bestShift(ref_cols, cols, width, NIGHT_CLIP_LEVELS * height);
+      dy = bestShift(ref_rows, rows, height, NIGHT_CLIP_LEVELS * width);
+      max_shift = max(max_shift, max(abs(dx), abs(dy)));
+    }
+  }
+  for (int y = 0; y < height; y++){
+    const int sy = constrain(y + dy, 0, height - 1);
+    addRow(accumulator + y * width, fb->buf + sy * width * 2, dx);
+  }
+  frames_in++;
+  cost_us += micros() - start_us;
+
+  if (frames_in < NIGHT_FRAMES){
+    return false;
+  }
+
+  resolveInPlace();
+  camera_fb_t photo = {};
+  photo.buf = (uint8_t *)accumulator;
+  photo.len = width * height * 2;
+  photo.width = width;
+  photo.height = height;
+  photo.format = PIXFORMAT_RGB565;
+  const bool pushed = pushRingFrame(&photo, first_timestamp);   // Counts a full ring as dropped itself
+
+  night_stats.last_ms = millis() - first_ms;
+  night_stats.max_shift = max_shift;
+  night_stats.cost_us = cost_us / frames_in;
+  night_stats.captures += pushed;
+  dropNightCapture();
+  return pushed;
+}
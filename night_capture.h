@@ -0,0 +1,44 @@
+/*
+
+Night photos, several preview frames averaged into one
+
+SELECT in night mode asks for NIGHT_FRAMES consecutive frames. frameCaptureTask hands each one to
+accumulateNightFrame() before the filter touches it, which adds it into a PSRAM accumulator and lets it go, so
+only the sums are ever held, never the frames. The accumulator packs a pixel's three channel sums into one 32
+bit word, red and green 11 bits and blue 10, so a frame is one add per pixel. After the last frame the sums are
+divided back into RGB565 in place and the result goes to the frame ring like any other photo. The accumulator
+is only allocated while a night photo is being taken
+
+Averaging N frames cuts the sensor noise by the square root of N, as long as the frames line up. Each frame
+is aligned to the first by a global shift of up to NIGHT_MAX_SHIFT pixels either way: the green edges summed
+down each column and along each row are compared with the first frame's, which finds a small shake in one pass
+over the frame. Pixels shifted in from outside the frame repeat the edge. Build with -DNIGHT_MAX_SHIFT=0 to add frames as they are
+
+*/
+
+#pragma once
+#include <esp_camera.h>
+#include "globals.h"
+
+#define NIGHT_CLIP_LEVELS 1            // A column or row sum counts at most this many green levels per pixel as off
+#define NIGHT_FRAMES 8                  // 320 ms at sensor rate, up to 32 fit the accumulator
+#ifndef NIGHT_MAX_SHIFT
+#define NIGHT_MAX_SHIFT 4
+#endif
+
+struct NightStats {
+  uint32_t captures;                    // Night photos sent to the frame ring
+  uint32_t last_ms;                     // First frame to the photo being in the ring
+  int max_shift;                        // Largest shift either way in the last photo
+  uint32_t cost_us;                     // Mean accumulateNightFrame() per frame of the last photo
+};
+
+extern NightStats night_stats;
+
+bool requestNightCapture();             // false while the last one is still being taken
+
+bool nightCapturePending();             // Frames are still wanted, frameCaptureTask grabs them at sensor rate
+
+bool accumulateNightFrame(const camera_fb_t *fb, uint32_t timestamp);   // frameCaptureTask only, true once the photo is in the ring
+
+void endNightCapture();                 // Camera closing, after frameCaptureTask is deleted, drops a photo half taken
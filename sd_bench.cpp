@@ -0,0 +1,120 @@
+#include <SD_MMC.h>
+#include "sd_bench.h"
+
+
+const uint32_t sd_bench_sizes[SD_BENCH_SIZES] = {512, 4096, SD_BENCH_MAX_BLOCK};
+SdBenchResult sd_bench_results[SD_BENCH_STEPS] = {};
+volatile int sd_bench_steps_done = 0;
+
+static uint8_t *buffer = NULL;                      // DMA capable, SD_BENCH_MAX_BLOCK
+static uint32_t *latencies = NULL;                  // One per call of the step running, the most any step makes
+
+static const int max_calls = SD_BENCH_FILE_BYTES / 512 > SD_BENCH_RANDOM_OPS ? SD_BENCH_FILE_BYTES / 512 : SD_BENCH_RANDOM_OPS;
+
+const char *sdBenchTestName(SdBenchTest test){
+  static const char *names[SD_BENCH_NUM_TESTS] = {"seq write", "seq read", "rand write", "rand read"};
+  return test < SD_BENCH_NUM_TESTS ? names[test] : "?";
+}
+
+bool beginSdBench(){
+  buffer = (uint8_t *)heap_caps_malloc(SD_BENCH_MAX_BLOCK, MALLOC_CAP_DMA);
+  latencies = (uint32_t *)ps_malloc(max_calls * sizeof(uint32_t));
+  if (!buffer || !latencies){
+    Serial.println("Failed to allocate SD benchmark buffers");
+    endSdBench();
+    return false;
+  }
+  for (int i = 0; i < SD_BENCH_MAX_BLOCK; i++){
+    buffer[i] = i * 31 + 7;                         // Not all zeroes, in case the card treats those differently
+  }
+  return true;
+}
+
+void endSdBench(){
+  heap_caps_free(buffer);
+  free(latencies);
+  buffer = NULL;
+  latencies = NULL;
+  SD_MMC.remove(SD_BENCH_FILE);
+}
+
+static int compareU32(const void *a, const void *b){
+  const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint32_t nextOffset(uint32_t *seed, uint32_t block_size){
+  // xorshift32, the same offsets every run so results compare between cards
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed % (SD_BENCH_FILE_BYTES / block_size) * block_size;
+}
+
+bool runSdBenchStep(int step, SdBenchResult *result){
+  const uint32_t size = sd_bench_sizes[step / SD_BENCH_NUM_TESTS];
+  const SdBenchTest test = (SdBenchTest)(step % SD_BENCH_NUM_TESTS);
+  const bool write = test == SD_BENCH_SEQ_WRITE || test == SD_BENCH_RANDOM_WRITE;
+  const bool random = test == SD_BENCH_RANDOM_WRITE || test == SD_BENCH_RANDOM_READ;
+  const int calls = random ? SD_BENCH_RANDOM_OPS : SD_BENCH_FILE_BYTES / size;
+
+  *result = {size, test, false, 0, 0, 0};
+  if (!buffer){
+    return false;
+  }
+
+  // Sequential writes make the file from scratch, random writes change it in place
+  const char *mode = test == SD_BENCH_SEQ_WRITE ? FILE_WRITE : test == SD_BENCH_RANDOM_WRITE ? "r+" : FILE_READ;
+  const uint32_t start_us = micros();
+  fs::File file = SD_MMC.open(SD_BENCH_FILE, mode);
+  bool ok = file;
+  uint32_t seed = 0x2545F491 + size;
+
+  for (int i = 0; i < calls && ok; i++){
+    const uint32_t call_us = micros();
+    if (random){
+      ok = file.seek(nextOffset(&seed, size));
+    }
+    ok = ok && (write ? file.write(buffer, size) : file.read(buffer, size)) == size;
+    latencies[i] = micros() - call_us;
+  }
+  if (file){
+    file.close();                                   // Flushes, part of what a write costs
+  }
+  const uint32_t total_us = micros() - start_us;
+
+  if (!ok){
+    Serial.printf("SD benchmark %s %lu B failed\n", sdBenchTestName(test), (unsigned long)size);
+    return false;
+  }
+  qsort(latencies, calls, sizeof(uint32_t), compareU32);
+  result->ok = true;
+  result->mb_per_s = total_us ? (float)calls * size / total_us : 0;      // Bytes per us is MB/s
+  result->p50_us = latencies[calls / 2];
+  result->p99_us = latencies[min(calls * 99 / 100, calls - 1)];
+  return true;
+}
+
+bool saveSdBenchResults(const SdBenchResult *results, int count, uint32_t timestamp){
+  const bool fresh = !SD_MMC.exists(SD_BENCH_RESULTS_FILE);
+  fs::File file = SD_MMC.open(SD_BENCH_RESULTS_FILE, FILE_APPEND);
+  if (!file){
+    Serial.println("Failed to open SD benchmark results file");
+    return false;
+  }
+  bool ok = true;
+  if (fresh){
+    static const char header[] = "timestamp,bus,block_bytes,test,ok,mb_per_s,p50_us,p99_us\n";
+    ok = file.write((const uint8_t *)header, sizeof(header) - 1) == sizeof(header) - 1;
+  }
+  for (int i = 0; i < count && ok; i++){
+    const SdBenchResult *r = &results[i];
+    char line[96];
+    snprintf(line, sizeof(line), "%lu,1-bit,%lu,%s,%d,%.3f,%lu,%lu\n", (unsigned long)timestamp, (unsigned long)r->block_size,
+             sdBenchTestName(r->test), r->ok, r->mb_per_s, (unsigned long)r->p50_us, (unsigned long)r->p99_us);
+    const size_t len = strlen(line);
+    ok = file.write((const uint8_t *)line, len) == len;
+  }
+  file.close();
+  return ok;
+}
@@ -0,0 +1,51 @@
+/*
+
+SD card throughput and latency benchmark
+
+Runs sequential and random writes and reads through SD_MMC, in the 1-bit mode initSD() mounts the card in,
+at each of SD_BENCH_SIZES block sizes. Every call is timed on its own, so a step reports MB/s over the whole
+run (closing the file included for writes) and the p50/ p99 of the single calls
+
+Sequential steps go through an SD_BENCH_FILE_BYTES scratch file, random steps hit SD_BENCH_RANDOM_OPS
+block aligned offsets inside it, the same ones every run. The buffer is DMA capable like the SD writer's
+staging buffer, so the card is measured and not the bounce copies. Nothing here knows about the display,
+the host benchmark in sim/bench runs the same steps against the SD stand-in
+
+*/
+
+#pragma once
+#include "globals.h"
+
+#define SD_BENCH_FILE "/.sdbench.bin"           // Hidden from the file list like the index
+#define SD_BENCH_RESULTS_FILE "/.sdbench.csv"   // One line per step, appended every run, hidden so it isn't listed as a photo
+#define SD_BENCH_FILE_BYTES (1024 * 1024)
+#define SD_BENCH_RANDOM_OPS 128
+#define SD_BENCH_SIZES 3                        // 512 B, 4 kB, 32 kB
+#define SD_BENCH_MAX_BLOCK 32768
+
+enum SdBenchTest { SD_BENCH_SEQ_WRITE, SD_BENCH_SEQ_READ, SD_BENCH_RANDOM_WRITE, SD_BENCH_RANDOM_READ, SD_BENCH_NUM_TESTS };
+
+#define SD_BENCH_STEPS (SD_BENCH_SIZES * SD_BENCH_NUM_TESTS)
+
+struct SdBenchResult {
+  uint32_t block_size;
+  SdBenchTest test;
+  bool ok;                                      // false if a call failed or came up short
+  float mb_per_s;
+  uint32_t p50_us;
+  uint32_t p99_us;
+};
+
+extern const uint32_t sd_bench_sizes[SD_BENCH_SIZES];
+extern SdBenchResult sd_bench_results[SD_BENCH_STEPS];   // Filled in by sdBenchTask as the steps finish
+extern volatile int sd_bench_steps_done;
+
+const char *sdBenchTestName(SdBenchTest test);
+
+bool beginSdBench();                                        // Allocates the buffers, false if internal RAM is short
+
+bool runSdBenchStep(int step, SdBenchResult *result);       // Step 0..SD_BENCH_STEPS-1, sizes outer, tests in enum order
+
+void endSdBench();                                          // Frees the buffers and removes the scratch file
+
+bool saveSdBenchResults(const SdBenchResult *results, int count, uint32_t timestamp);    // Appends to SD_BENCH_RESULTS_FILE
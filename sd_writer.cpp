@@ -0,0 +1,135 @@
+#include <SD_MMC.h>
+#include "sd_writer.h"
+#include "helpers.h"
+
+
+SdWriterStats sd_writer_stats = {};
+
+static QueueHandle_t free_buffers = NULL;           // uint8_t * of every slot not being filled or written
+static QueueHandle_t write_jobs = NULL;             // SdWriteJob, at most one per slot and the still so a send never waits
+static QueueHandle_t still_free = NULL;             // Holds a token while no still buffer is allocated
+static uint8_t *still_buffer = NULL;
+static uint8_t *staging = NULL;
+
+void initSdWriter(){
+  free_buffers = xQueueCreate(SD_WRITE_SLOTS, sizeof(uint8_t *));
+  write_jobs = xQueueCreate(SD_WRITE_SLOTS + 1, sizeof(SdWriteJob));
+  still_free = xQueueCreate(1, sizeof(uint8_t));
+  staging = (uint8_t *)heap_caps_malloc(SD_STAGING_BYTES, MALLOC_CAP_DMA);
+
+  const uint8_t token = 1;
+  bool ok = free_buffers && write_jobs && still_free && staging && xQueueSend(still_free, &token, 0) == pdTRUE;
+  for (int i = 0; i < SD_WRITE_SLOTS && ok; i++){
+    uint8_t *buffer = (uint8_t *)ps_malloc(SD_WRITE_SLOT_BYTES);
+    ok = buffer && xQueueSend(free_buffers, &buffer, 0) == pdTRUE;
+  }
+  if (!ok){
+    Serial.println("Failed to allocate SD writer buffers");
+    while(1) {}
+  }
+  Serial.println("SD writer initialized");
+}
+
+uint8_t *acquireSdBuffer(TickType_t ticks_to_wait){
+  uint8_t *buffer = NULL;
+  xQueueReceive(free_buffers, &buffer, ticks_to_wait);
+  return buffer;
+}
+
+uint8_t *acquireStillSdBuffer(size_t bytes, TickType_t ticks_to_wait){
+  uint8_t token;
+  if (xQueueReceive(still_free, &token, ticks_to_wait) != pdTRUE){
+    return NULL;
+  }
+  still_buffer = (uint8_t *)ps_malloc(bytes);
+  if (!still_buffer){
+    xQueueSend(still_free, &token, 0);
+  }
+  return still_buffer;
+}
+
+void releaseSdBuffer(uint8_t *buffer){
+  if (buffer && buffer == still_buffer){
+    const uint8_t token = 1;
+    free(still_buffer);
+    still_buffer = NULL;
+    xQueueSend(still_free, &token, 0);
+    return;
+  }
+  xQueueSend(free_buffers, &buffer, 0);
+}
+
+void submitSdWrite(const char *path, uint8_t *buffer, size_t len, size_t thumb_len, uint32_t start_ms){
+  SdWriteJob job = {};
+  strncpy(job.path, path, MAX_FILENAME_LENGTH - 1);
+  job.data = buffer;
+  job.len = len;
+  job.thumb_len = thumb_len;
+  job.start_ms = start_ms;
+  sd_writer_stats.submitted++;
+  xQueueSend(write_jobs, &job, 0);
+}
+
+bool waitSdWrite(SdWriteJob *job){
+  return xQueueReceive(write_jobs, job, portMAX_DELAY) == pdTRUE;
+}
+
+static bool writeFile(const char *path, const uint8_t *data, size_t len){
+  if (!makeParentDir(path)){
+    return false;
+  }
+  fs::File file = SD_MMC.open(path, FILE_WRITE);
+  const bool opened = file;                         // close() clears the handle
+  bool ok = opened;
+
+  if (ok){
+    // Seeking past the end of a file open for writing extends it, clusters included
+    ok = file.seek(len) && file.seek(0);
+  }
+  for (size_t pos = 0; ok && pos < len; pos += SD_STAGING_BYTES){
+    const size_t n = min((size_t)SD_STAGING_BYTES, len - pos);
+    memcpy(staging, data + pos, n);
+    ok = file.write(staging, n) == n;
+  }
+  if (file){
+    file.close();
+  }
+  if (!ok && opened){
+    SD_MMC.remove(path);                            // Don't leave a preallocated file with junk at the end
+  }
+  invalidateCachedFile(path);                       // A name freed by a delete can come back with new pixels
+  return ok;
+}
+
+bool writeStagedFile(const SdWriteJob *job){
+  const uint32_t start_us = micros();
+  const bool ok = writeFile(job->path, job->data, job->len);
+  size_t thumb_written = 0;
+
+  if (ok && job->thumb_len){
+    char path[THUMB_PATH_LENGTH];
+    thumbPath(job->path, path);
+    thumb_written = writeFile(path, job->data + job->len, job->thumb_len) ? job->thumb_len : 0;   // Missing ones are backfilled
+  }
+  releaseSdBuffer(job->data);
+
+  if (ok){
+    const uint32_t latency_ms = millis() - job->start_ms;
+    sd_writer_stats.files++;
+    sd_writer_stats.bytes += job->len + thumb_written;
+    sd_writer_stats.write_us += micros() - start_us;
+    sd_writer_stats.last_latency_ms = latency_ms;
+    sd_writer_stats.max_latency_ms = max(sd_writer_stats.max_latency_ms, latency_ms);
+  } else{
+    sd_writer_stats.failed++;
+  }
+  return ok;
+}
+
+float sdWriteMBps(){
+  return sd_writer_stats.write_us ? (float)sd_writer_stats.bytes / sd_writer_stats.write_us : 0;
+}
+
+int sdWritesPending(){
+  return sd_writer_stats.submitted - sd_writer_stats.files - sd_writer_stats.failed;
+}
@@ -0,0 +1,64 @@
+/*
+
+Write-behind SD writer
+
+saveFrameToSDTask packs a frame from the frame ring (see frame_ring.h) into one of SD_WRITE_SLOTS PSRAM file
+buffers and submits it, sdWriterTask does the card writes from there. The ring slot goes back as soon as the
+frame is packed, and the save task is ready for the next frame as soon as it has submitted. The photo's
+thumbnail (see thumbnail.h) rides in the same buffer right after it and is written next
+
+The SDMMC DMA can't read PSRAM, for such buffers the driver writes one 512 byte sector per command. The writer
+copies each file through an internal DMA capable staging buffer instead, in SD_STAGING_BYTES chunks that start
+on sector boundaries, so each chunk is one multi sector write. Files are extended to their final size before
+the first chunk, so FAT allocates the cluster chain once instead of once per cluster
+
+A still at STILL_FRAME_SIZE doesn't fit a slot. acquireStillSdBuffer() allocates one buffer sized for it, only
+one at a time, and it is freed instead of pooled once written
+
+*/
+
+#pragma once
+#include "globals.h"
+#include "thumbnail.h"
+
+#define SD_WRITE_SLOTS 2                // File buffers, one being written while the next is packed
+#define SD_WRITE_SLOT_BYTES (IMAGE_WIDTH * IMAGE_HEIGHT * 2 + 64 + THUMB_FILE_BYTES)   // A raw frame plus any file header, then its thumbnail
+#define SD_STAGING_BYTES 8192           // Multiple of the 512 byte sector
+
+struct SdWriteJob {
+  char path[MAX_FILENAME_LENGTH];
+  uint8_t *data;                      // A buffer from acquireSdBuffer()
+  size_t len;
+  size_t thumb_len;                   // Thumbnail file at data + len, 0 for none
+  uint32_t start_ms;                  // When the save was requested, for the latency
+};
+
+struct SdWriterStats {
+  uint32_t submitted;
+  uint32_t files;
+  uint32_t failed;
+  uint64_t bytes;
+  uint64_t write_us;                  // Open to close, summed over all files
+  uint32_t last_latency_ms;           // start_ms to the file being closed
+  uint32_t max_latency_ms;
+};
+
+extern SdWriterStats sd_writer_stats;
+
+void initSdWriter();                                        // Allocates the buffers, call before sdWriterTask starts
+
+uint8_t *acquireSdBuffer(TickType_t ticks_to_wait);         // SD_WRITE_SLOT_BYTES to fill, NULL if none came free in time
+
+uint8_t *acquireStillSdBuffer(size_t bytes, TickType_t ticks_to_wait);     // bytes to fill, NULL if the last still isn't written in time or PSRAM is short
+
+void releaseSdBuffer(uint8_t *buffer);                      // Hand a buffer back without writing it, a still buffer is freed
+
+void submitSdWrite(const char *path, uint8_t *buffer, size_t len, size_t thumb_len, uint32_t start_ms);   // Never blocks, the buffer is returned once written
+
+bool waitSdWrite(SdWriteJob *job);                          // sdWriterTask only, blocks for the next job
+
+bool writeStagedFile(const SdWriteJob *job);                // sdWriterTask only, writes the job (photo, then thumbnail) and returns its buffer
+
+float sdWriteMBps();                                        // Sustained rate over every file written so far
+
+int sdWritesPending();                                      // Submitted files not yet written or failed
@@ -0,0 +1,196 @@
+/*
+
+Host benchmark for the photo codec in image_codec.h
+
+For each test frame: packed size and ratio, encode and decode throughput on the host (wall clock), and the
+time the save would spend on the card for the raw and the packed file under the simulator's SD model
+(virtual clock, open + one write + close). Every frame is decoded back through the SD stand-in and
+compared with the source pixels
+
+Usage: image_codec_bench [min_ms_per_kernel]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <SD_MMC.h>
+#include "globals.h"
+#include "image_codec.h"
+#include "../sim.h"
+
+static double min_ms = 300;
+static int failures = 0;
+
+static double timeUs(const std::function<void()> &kernel){
+  // Mean wall clock per run over at least min_ms
+  using clock = std::chrono::steady_clock;
+  int runs = 0;
+  auto start = clock::now();
+  double elapsed_ms = 0;
+  do {
+    kernel();
+    runs++;
+    elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  } while (elapsed_ms < min_ms);
+  return elapsed_ms * 1000.0 / runs;
+}
+
+static double sdSaveMs(const char *path, const uint8_t *data, size_t len){
+  // What saveFrameToSDTask spends on the card, charged on the virtual clock
+  const uint64_t start = simNowNs();
+  fs::File file = SD_MMC.open(path, FILE_WRITE);
+  file.write(data, len);
+  file.close();
+  invalidateCachedFile(path);                     // Decoded back through the block cache next
+  return (simNowNs() - start) / 1e6;
+}
+
+static bool decodeMatches(const char *path, const std::vector<uint8_t> &src, int w, int h){
+  static ImageReader reader;
+  std::vector<uint16_t> row(w);
+  if (!openImage(&reader, path) || reader.header.width != w || reader.header.height != h){
+    return false;
+  }
+  bool ok = true;
+  for (int y = 0; y < h && ok; y++){
+    ok = readImageRow(&reader, row.data()) && !memcmp(row.data(), &src[(size_t)y * w * 2], w * 2);
+  }
+  ok = ok && !readImageRow(&reader, row.data());
+  closeImage(&reader);
+  return ok;
+}
+
+static void put565(std::vector<uint8_t> &buf, size_t i, int r, int g, int b){
+  const uint16_t c = (constrain(r, 0, 31) << 11) | (constrain(g, 0, 63) << 5) | constrain(b, 0, 31);
+  buf[2 * i] = c >> 8;
+  buf[2 * i + 1] = c & 0xFF;
+}
+
+// ============================= Test frames =============================
+static std::vector<uint8_t> cameraFrame(int w, int h){
+  // The simulator's sensor scene, gradient + block + up to 2 LSB of noise per channel
+  static bool started = false;
+  if (!started){
+    camera_config_t config = {};
+    config.pixel_format = PIXFORMAT_RGB565;
+    config.frame_size = FRAMESIZE_240X240;
+    config.fb_count = 1;
+    esp_camera_init(&config);
+    started = true;
+  }
+  camera_fb_t *fb = esp_camera_fb_get();
+  std::vector<uint8_t> buf(fb->buf, fb->buf + fb->len);
+  esp_camera_fb_return(fb);
+  return buf;
+}
+
+static std::vector<uint8_t> cleanFrame(int w, int h){
+  // Same scene without sensor noise
+  std::vector<uint8_t> buf((size_t)w * h * 2);
+  for (int y = 0; y < h; y++){
+    for (int x = 0; x < w; x++){
+      const bool block = x >= w / 3 && x < w / 3 + w / 6 && y >= h / 3 && y < h / 3 + h / 6;
+      put565(buf, (size_t)y * w + x, block ? 4 : x * 31 / w, block ? 56 : 20 + (x + y) * 20 / (w + h), block ? 6 : y * 31 / h);
+    }
+  }
+  return buf;
+}
+
+static std::vector<uint8_t> flatFrame(int w, int h){
+  // Screen grab style content, flat fills and outlines in a handful of colours
+  std::vector<uint8_t> buf((size_t)w * h * 2);
+  for (int y = 0; y < h; y++){
+    for (int x = 0; x < w; x++){
+      const int item = y / 60;
+      const bool outline = y % 60 == 0 || x == 0 || x == w - 1;
+      const bool text = y % 60 > 24 && y % 60 < 36 && x > 80 && x < 160 && ((x / 2 + y) % 5 < 2);
+      if (outline || text){
+        put565(buf, (size_t)y * w + x, 31, 63, 31);
+      } else{
+        put565(buf, (size_t)y * w + x, item == 1 ? 0 : 4, item == 1 ? 20 : 8, item == 1 ? 31 : 8);
+      }
+    }
+  }
+  return buf;
+}
+
+static std::vector<uint8_t> noiseFrame(int w, int h){
+  // Incompressible, the encoder has to fall back to raw
+  std::vector<uint8_t> buf((size_t)w * h * 2);
+  uint32_t s = 0x9E3779B9;
+  for (auto &b : buf){
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    b = s >> 24;
+  }
+  return buf;
+}
+
+// ============================= Bench =============================
+static void benchFrame(const char *name, const std::vector<uint8_t> &src, int w, int h){
+  const size_t cap = imageMaxFileSize(w, h);
+  std::vector<uint8_t> out(cap);
+  size_t len = 0;
+
+  const double enc_us = timeUs([&](){ len = encodeImage(src.data(), w, h, 1735761600, out.data(), cap); });
+  const double raw_ms = sdSaveMs("/bench.raw", src.data(), src.size());
+  const double save_ms = sdSaveMs("/bench" IMAGE_FILE_EXT, out.data(), len);
+  const bool ok = len && decodeMatches("/bench" IMAGE_FILE_EXT, src, w, h);
+
+  std::vector<uint16_t> row(w);
+  static ImageReader reader;
+  const double dec_us = timeUs([&](){
+    openImage(&reader, "/bench" IMAGE_FILE_EXT);
+    while (readImageRow(&reader, row.data())){
+    }
+    closeImage(&reader);
+  });
+
+  const double mb = src.size() / 1e6;
+  printf("%-22s %4dx%-4d %7zu %6.2fx %4s %8.1f us %7.1f MB/s %8.1f us %7.1f MB/s %7.1f ms %7.1f ms  %s\n",
+         name, w, h, len, (double)src.size() / len, out[9] == IMAGE_CODEC_QOI ? "qoi" : "raw",
+         enc_us, mb / (enc_us / 1e6), dec_us, mb / (dec_us / 1e6), raw_ms, save_ms, ok ? "ok" : "MISMATCH");
+  if (!ok){
+    failures++;
+  }
+}
+
+int main(int argc, char **argv){
+  if (argc > 1){
+    min_ms = atof(argv[1]);
+  }
+
+  char dir[] = "/tmp/image_codec_benchXXXXXX";
+  if (!mkdtemp(dir)){
+    perror("mkdtemp");
+    return 1;
+  }
+  simSetSdRoot(dir);
+  SD_MMC.begin();
+  initBlockCache();
+
+  printf("%-22s %9s %7s %7s %4s %24s %24s %10s %10s\n",
+         "frame", "size", "bytes", "ratio", "fmt", "encode", "decode", "sd raw", "sd packed");
+  benchFrame("camera (sim sensor)", cameraFrame(IMAGE_WIDTH, IMAGE_HEIGHT), IMAGE_WIDTH, IMAGE_HEIGHT);
+  benchFrame("camera, no noise", cleanFrame(IMAGE_WIDTH, IMAGE_HEIGHT), IMAGE_WIDTH, IMAGE_HEIGHT);
+  benchFrame("flat ui", flatFrame(IMAGE_WIDTH, IMAGE_HEIGHT), IMAGE_WIDTH, IMAGE_HEIGHT);
+  benchFrame("noise (worst case)", noiseFrame(IMAGE_WIDTH, IMAGE_HEIGHT), IMAGE_WIDTH, IMAGE_HEIGHT);
+  benchFrame("camera, no noise", cleanFrame(640, 480), 640, 480);
+
+  remove((std::string(dir) + "/bench.raw").c_str());
+  remove((std::string(dir) + "/bench" IMAGE_FILE_EXT).c_str());
+  rmdir(dir);
+
+  if (failures){
+    printf("FAIL: %d frames did not decode back to the source\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+/*
+
+Host benchmark for the preview filters in image_filters.h
+
+Checks every stage against a one pixel at a time reference with the same fixed point maths, so a carry
+leaking between the two pixels of a word shows up as a mismatch. Then times each stage and each chain on a
+240x240 frame, next to a float grayscale as the baseline, and how many frames a second that leaves
+
+The frame is a dim, low contrast gradient with a block and sensor noise, so contrast and Sobel have something
+to do. Host numbers are wall clock and only rank the stages, on the ESP32 each pass also reads and writes the
+frame through the 32 kB PSRAM cache
+
+Usage: image_filters_bench [min_ms_per_stage]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "image_filters.h"
+
+static const int W = IMAGE_WIDTH, H = IMAGE_HEIGHT;
+
+// ============================= Frames =============================
+static uint16_t toMemory(uint16_t native){
+  return (native >> 8) | (native << 8);         // MSB first, as the camera delivers it
+}
+
+static uint16_t toNative(uint16_t memory){
+  return (memory >> 8) | (memory << 8);
+}
+
+static std::vector<uint16_t> testFrame(){
+  std::vector<uint16_t> frame(W * H);
+  uint32_t noise = 0x9E3779B9;
+  for (int y = 0; y < H; y++){
+    for (int x = 0; x < W; x++){
+      noise ^= noise << 13;
+      noise ^= noise >> 17;
+      noise ^= noise << 5;
+      const int n = (int)(noise & 3) - 1;
+      const bool block = x >= 90 && x < 150 && y >= 60 && y < 120;
+      int r = block ? 20 : 6 + x * 10 / W;
+      int g = block ? 12 : 14 + (x + y) * 20 / (W + H);
+      int b = block ? 8 : 6 + y * 10 / H;
+      r = constrain(r + n, 0, 31);
+      g = constrain(g + n, 0, 63);
+      b = constrain(b + n, 0, 31);
+      frame[y * W + x] = toMemory((r << 11) | (g << 5) | b);
+    }
+  }
+  return frame;
+}
+
+// ============================= Reference =============================
+static int refLuma(uint16_t p){
+  return ((p >> 11) * 156 + ((p >> 5) & 0x3F) * 151 + (p & 0x1F) * 59) >> 8;
+}
+
+static uint16_t refGray(int y){
+  return ((y >> 1) << 11) | (y << 5) | (y >> 1);
+}
+
+static void refFilter(ImageFilter filter, std::vector<uint16_t> &frame){
+  std::vector<uint16_t> p(frame.size());
+  for (size_t i = 0; i < frame.size(); i++){
+    p[i] = toNative(frame[i]);
+  }
+  std::vector<uint16_t> out = p;
+
+  if (filter == FILTER_GRAYSCALE){
+    for (size_t i = 0; i < p.size(); i++){
+      out[i] = refGray(refLuma(p[i]));
+    }
+  }
+  else if (filter == FILTER_NEGATIVE){
+    for (size_t i = 0; i < p.size(); i++){
+      out[i] = ~p[i];
+    }
+  }
+  else if (filter == FILTER_POSTERIZE){
+    for (size_t i = 0; i < p.size(); i++){
+      out[i] = (p[i] & 0xC718) | 0x2084;
+    }
+  }
+  else if (filter == FILTER_CONTRAST){
+    int histogram[64] = {}, samples = 0;
+    for (int y = 0; y < H; y += 4){
+      for (int x = 0; x < W; x += 4){
+        histogram[(p[y * W + x] >> 5) & 0x3F]++;
+        samples++;
+      }
+    }
+    int lo = 0, hi = 63, seen = 0;
+    while (lo < 63 && (seen += histogram[lo]) <= samples / 50){
+      lo++;
+    }
+    seen = 0;
+    while (hi > 0 && (seen += histogram[hi]) <= samples / 50){
+      hi--;
+    }
+    if (hi - lo >= 4){
+      const int gain = min(63 * 256 / (hi - lo), 1024);
+      auto stretch = [&](int c, int l, int max_c){ return min(max(c - l, 0) * gain >> 8, max_c); };
+      for (size_t i = 0; i < p.size(); i++){
+        out[i] = (stretch(p[i] >> 11, lo >> 1, 31) << 11) | (stretch((p[i] >> 5) & 0x3F, lo, 63) << 5) | stretch(p[i] & 0x1F, lo >> 1, 31);
+      }
+    }
+  }
+  else if (filter == FILTER_SOBEL){
+    auto L = [&](int x, int y){ return refLuma(p[constrain(y, 0, H - 1) * W + constrain(x, 0, W - 1)]); };
+    for (int y = 0; y < H; y++){
+      for (int x = 0; x < W; x++){
+        const int gx = (L(x + 1, y - 1) + 2 * L(x + 1, y) + L(x + 1, y + 1)) - (L(x - 1, y - 1) + 2 * L(x - 1, y) + L(x - 1, y + 1));
+        const int gy = (L(x - 1, y + 1) + 2 * L(x, y + 1) + L(x + 1, y + 1)) - (L(x - 1, y - 1) + 2 * L(x, y - 1) + L(x + 1, y - 1));
+        out[y * W + x] = refGray(min((abs(gx) + abs(gy)) >> 2, 63));
+      }
+    }
+  }
+  for (size_t i = 0; i < frame.size(); i++){
+    frame[i] = toMemory(out[i]);
+  }
+}
+
+static void floatGrayscale(uint16_t *pixels, int count){
+  // The obvious per pixel version, for comparison
+  for (int i = 0; i < count; i++){
+    const uint16_t p = toNative(pixels[i]);
+    const float y = 0.299f * (p >> 11) / 31.f + 0.587f * ((p >> 5) & 0x3F) / 63.f + 0.114f * (p & 0x1F) / 31.f;
+    const int y6 = (int)(y * 63.f + 0.5f);
+    pixels[i] = toMemory(refGray(y6));
+  }
+}
+
+// ============================= Timing =============================
+static double min_ms = 300;
+static int failures = 0;
+
+static double timeUs(const std::function<void()> &kernel){
+  using clock = std::chrono::steady_clock;
+  int runs = 0;
+  auto start = clock::now();
+  double elapsed_ms = 0;
+  do {
+    kernel();
+    runs++;
+    elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  } while (elapsed_ms < min_ms);
+  return elapsed_ms * 1000.0 / runs;
+}
+
+int main(int argc, char **argv){
+  if (argc > 1){
+    min_ms = atof(argv[1]);
+  }
+  const std::vector<uint16_t> src = testFrame();
+  std::vector<uint16_t> work(src.size());
+  auto reset = [&](){ memcpy(work.data(), src.data(), src.size() * 2); };
+
+  printf("%-24s %12s %10s  %s\n", "stage", "per frame", "MB/s", "check");
+  for (int f = 0; f < NUM_IMAGE_FILTERS; f++){
+    const ImageFilter filter = (ImageFilter)f;
+    std::vector<uint16_t> expected = src;
+    refFilter(filter, expected);
+    reset();
+    applyImageFilter(filter, work.data(), W, H);
+    const bool ok = work == expected;
+    if (!ok){
+      failures++;
+    }
+    // Repeated passes over a frame already filtered cost the same, except contrast which may find it flat
+    const double us = timeUs([&](){ reset(); applyImageFilter(filter, work.data(), W, H); }) - timeUs(reset);
+    printf("%-24s %9.1f us %10.1f  %s\n", imageFilterName(filter), us, W * H * 2 / us, ok ? "ok" : "MISMATCH");
+  }
+  const double float_us = timeUs([&](){ floatGrayscale(work.data(), W * H); });
+  printf("%-24s %9.1f us %10.1f  baseline\n\n", "float grayscale", float_us, W * H * 2 / float_us);
+
+  printf("%-24s %12s %14s\n", "chain", "per frame", "frames/s max");
+  for (int c = 1; c < NUM_FILTER_CHAINS; c++){
+    const double us = timeUs([&](){ reset(); applyFilterChain(c, work.data(), W, H); }) - timeUs(reset);
+    printf("%-24s %9.1f us %14.0f\n", filter_chains[c].name, us, 1e6 / us);
+  }
+
+  if (failures){
+    printf("FAIL: %d stages disagree with the reference\n", failures);
+    return 1;
+  }
+  return 0;
+}
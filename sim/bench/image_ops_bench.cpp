@@ -0,0 +1,192 @@
+/*
+
+Host benchmark for the RGB565 kernels in image_ops.h
+
+Checks every kernel against a naive per-pixel reference, then reports throughput (source MB/s and us per frame)
+next to the two byte-wise transposes that helpers.cpp used before (copied below as the baseline)
+
+A 240x240 frame fits in a desktop L2, so the cache effects the tiling is for only show on the larger sizes.
+On the ESP32 every frame is larger than the 32 kB PSRAM cache
+
+Usage: image_ops_bench [min_ms_per_kernel]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "image_ops.h"
+
+// ============================= Baseline =============================
+// helpers.cpp before the kernels, kept verbatim apart from the names
+
+static void oldTransposeImage(camera_fb_t *fb, int bytes_per_pixel){
+  const int size = fb->width;
+  const int length = fb->len;
+  uint8_t *img_buf = new uint8_t[length];
+  int counter = 0;
+  int start_index = 0;
+  int index = 0;
+  for (int i = 0; i < length; i++){
+    index = start_index + (counter * size) + (i % bytes_per_pixel);
+    img_buf[i] = fb->buf[index];
+    if ((i != 0) && (i % bytes_per_pixel == 0)){
+      counter++;
+    }
+    if (counter == size){
+      counter = 0;
+      start_index++;
+    }
+  }
+  memcpy(fb->buf, img_buf, length);
+  delete[] img_buf;
+}
+
+static void oldTransposeImageInPlace(camera_fb_t *fb){
+  const int bpp = 2;
+  const int width = fb->width;
+  const int height = fb->height;
+  uint8_t *buf = fb->buf;
+  for (int y = 0; y < height; y++){
+    for (int x = y + 1; x < width; x++){
+      int idx1 = (y * width + x) * bpp;
+      int idx2 = (x * width + y) * bpp;
+      uint8_t tmp0 = buf[idx1];
+      uint8_t tmp1 = buf[idx1 + 1];
+      buf[idx1] = buf[idx2];
+      buf[idx1 + 1] = buf[idx2 + 1];
+      buf[idx2] = tmp0;
+      buf[idx2 + 1] = tmp1;
+    }
+  }
+}
+
+// ============================= Reference =============================
+static uint16_t refPixel(const std::vector<uint16_t> &src, int w, int h, int x, int y, int op){
+  // Source pixel that lands on (x, y) of the result, op: 0 transpose, 90/ 180/ 270 rotate, 1 mirror h, 2 mirror v
+  switch (op){
+    case 0:   return src[x * w + y];
+    case 90:  return src[(h - 1 - x) * w + y];
+    case 180: return src[(h - 1 - y) * w + (w - 1 - x)];
+    case 270: return src[x * w + (w - 1 - y)];
+    case 1:   return src[y * w + (w - 1 - x)];
+    default:  return src[(h - 1 - y) * w + x];
+  }
+}
+
+static bool matches(const std::vector<uint16_t> &src, const uint16_t *out, int w, int h, int op){
+  const bool swapped = (op == 0 || op == 90 || op == 270);
+  const int ow = swapped ? h : w, oh = swapped ? w : h;
+  for (int y = 0; y < oh; y++){
+    for (int x = 0; x < ow; x++){
+      if (out[y * ow + x] != refPixel(src, w, h, x, y, op)){
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// ============================= Timing =============================
+static double min_ms = 300;
+static int failures = 0;
+
+static void report(const char *name, int w, int h, bool ok, const std::function<void()> &kernel, bool baseline = false){
+  // Runs the kernel until min_ms has passed, throughput counts the source bytes once per run
+  using clock = std::chrono::steady_clock;
+  int runs = 0;
+  auto start = clock::now();
+  double elapsed_ms = 0;
+  do {
+    kernel();
+    runs++;
+    elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  } while (elapsed_ms < min_ms);
+
+  const double us = elapsed_ms * 1000.0 / runs;
+  const double mb_s = (double)w * h * 2 / us;
+  printf("%-28s %4dx%-4d %9.1f us %9.1f MB/s  %s\n", name, w, h, us, mb_s, ok ? "ok" : (baseline ? "wrong output" : "MISMATCH"));
+  if (!ok && !baseline){
+    failures++;
+  }
+}
+
+static void benchSize(int w, int h){
+  std::vector<uint16_t> src((size_t)w * h), dst((size_t)w * h), work((size_t)w * h);
+  for (size_t i = 0; i < src.size(); i++){
+    src[i] = (uint16_t)(i * 2654435761u >> 7);
+  }
+
+  camera_fb_t fb = {};
+  fb.buf = (uint8_t *)work.data();
+  fb.len = work.size() * 2;
+  fb.width = w;
+  fb.height = h;
+  auto reset = [&](){ memcpy(work.data(), src.data(), src.size() * 2); fb.width = w; fb.height = h; };
+
+  if (w == h){
+    reset();
+    oldTransposeImage(&fb, 2);
+    report("old transposeImage", w, h, matches(src, work.data(), w, h, 0), [&](){ oldTransposeImage(&fb, 2); }, true);
+
+    reset();
+    oldTransposeImageInPlace(&fb);
+    report("old transposeImageInPlace", w, h, matches(src, work.data(), w, h, 0), [&](){ oldTransposeImageInPlace(&fb); }, true);
+
+    reset();
+    transposeInPlace565(work.data(), w);
+    report("transposeInPlace565", w, h, matches(src, work.data(), w, h, 0), [&](){ transposeInPlace565(work.data(), w); });
+  }
+
+  transpose565(src.data(), dst.data(), w, h);
+  report("transpose565", w, h, matches(src, dst.data(), w, h, 0), [&](){ transpose565(src.data(), dst.data(), w, h); });
+
+  const int angles[] = {90, 180, 270};
+  for (int deg : angles){
+    char name[40];
+    rotate565(src.data(), dst.data(), w, h, deg);
+    snprintf(name, sizeof(name), "rotate565 %d", deg);
+    report(name, w, h, matches(src, dst.data(), w, h, deg), [&](){ rotate565(src.data(), dst.data(), w, h, deg); });
+
+    reset();
+    if (rotateInPlace565(work.data(), w, h, deg)){
+      snprintf(name, sizeof(name), "rotateInPlace565 %d", deg);
+      report(name, w, h, matches(src, work.data(), w, h, deg), [&](){ rotateInPlace565(work.data(), w, h, deg); });
+    }
+  }
+
+  reset();
+  mirror565(work.data(), w, h, true);
+  report("mirror565 horizontal", w, h, matches(src, work.data(), w, h, 1), [&](){ mirror565(work.data(), w, h, true); });
+
+  reset();
+  mirror565(work.data(), w, h, false);
+  report("mirror565 vertical", w, h, matches(src, work.data(), w, h, 2), [&](){ mirror565(work.data(), w, h, false); });
+
+  // Non square frames rotate through scratch and come back with swapped dimensions
+  reset();
+  bool ok = rotateFrame(&fb, 90, dst.data()) && (int)fb.width == h && (int)fb.height == w;
+  report("rotateFrame 90", w, h, ok && matches(src, work.data(), w, h, 90), [&](){ rotateFrame(&fb, 90, dst.data()); });
+  printf("\n");
+}
+
+int main(int argc, char **argv){
+  if (argc > 1){
+    min_ms = atof(argv[1]);
+  }
+
+  printf("%-28s %9s %12s %14s\n", "kernel", "size", "per frame", "throughput");
+  benchSize(240, 240);      // Camera preview frame
+  benchSize(320, 240);      // QVGA, not square
+  benchSize(640, 480);      // VGA
+  benchSize(1024, 1024);    // 2 MB, outgrows the host's L2 the way a 115 kB frame outgrows the ESP32's 32 kB cache
+
+  if (failures){
+    printf("FAIL: %d kernels disagree with the reference\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+/*
+
+Host benchmark for the motion detection in motion_detect.h
+
+Plays a scripted scene through detectMotion() at 25 frames a second on the virtual clock and checks every
+phase gets the saves it should: none while the scene is still or the whole frame gets brighter, none for an
+object too small to pass the threshold, one for a moving block, none when it moves again within the cooldown
+and one after it. Then times a frame against a per pixel difference of the whole frame as the baseline
+
+Usage: motion_bench [min_ms]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "motion_detect.h"
+#include "../sim.h"
+
+static const int W = IMAGE_WIDTH, H = IMAGE_HEIGHT;
+static const uint64_t FRAME_NS = 40000000;              // 25 frames a second
+
+// ============================= Scene =============================
+struct Scene {
+  int brightness;                       // Added to every channel
+  int block;                            // Side of the moving block, 0 for none
+  int bx, by;
+};
+
+static void renderScene(const Scene &s, uint8_t *buf, uint32_t &noise){
+  // Mid range gradient so a brightness step doesn't clip, +-1 LSB of sensor noise per channel
+  for (int y = 0; y < H; y++){
+    for (int x = 0; x < W; x++){
+      noise ^= noise << 13;
+      noise ^= noise >> 17;
+      noise ^= noise << 5;
+      const int n = (int)(noise & 3) - 1;
+      const bool in_block = s.block && x >= s.bx && x < s.bx + s.block && y >= s.by && y < s.by + s.block;
+      int r = in_block ? 26 : 8 + x * 10 / W;
+      int g = in_block ? 56 : 16 + (x + y) * 20 / (W + H);
+      int b = in_block ? 4 : 8 + y * 10 / H;
+      r = constrain(r + s.brightness + n, 0, 31);
+      g = constrain(g + 2 * s.brightness + n, 0, 63);
+      b = constrain(b + s.brightness + n, 0, 31);
+      const uint16_t c = (r << 11) | (g << 5) | b;
+      *buf++ = c >> 8;                                  // MSB first like the sensor
+      *buf++ = c & 0xFF;
+    }
+  }
+}
+
+struct Phase {
+  const char *name;
+  int frames;
+  int brightness;
+  int block;
+  int step;                             // Pixels the block moves per frame
+  uint32_t expected;                    // Saves started during the phase
+};
+
+static const Phase phases[] = {
+  {"still", 40, 0, 0, 0, 0},
+  {"small object", 40, 0, 12, 3, 0},
+  {"moving block", 20, 0, 48, 4, 1},
+  {"still again", 30, 0, 0, 0, 0},
+  {"brighter", 30, 4, 0, 0, 0},
+  {"block in cooldown", 15, 4, 48, 4, 0},
+  {"still, cooldown ends", 60, 4, 0, 0, 0},
+  {"block after cooldown", 20, 4, 48, 4, 1},
+};
+
+// ============================= Timing =============================
+static double min_ms = 300;
+
+static double timeUs(const std::function<void()> &kernel){
+  using clock = std::chrono::steady_clock;
+  int runs = 0;
+  auto start = clock::now();
+  double elapsed_ms = 0;
+  do {
+    kernel();
+    runs++;
+    elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  } while (elapsed_ms < min_ms);
+  return elapsed_ms * 1000.0 / runs;
+}
+
+static int fullFrameDiff(const uint8_t *a, const uint8_t *b){
+  // Every pixel's green against the last frame, the obvious version
+  int changed = 0;
+  for (int i = 0; i < W * H * 2; i += 2){
+    const int ga = ((a[i] & 0x07) << 3) | (a[i + 1] >> 5);
+    const int gb = ((b[i] & 0x07) << 3) | (b[i + 1] >> 5);
+    changed += abs(ga - gb) > 6;
+  }
+  return changed;
+}
+
+int main(int argc, char **argv){
+  if (argc > 1){
+    min_ms = atof(argv[1]);
+  }
+  std::vector<uint8_t> buf(W * H * 2);
+  camera_fb_t fb = {};
+  fb.buf = buf.data();
+  fb.len = buf.size();
+  fb.width = W;
+  fb.height = H;
+  fb.format = PIXFORMAT_RGB565;
+
+  uint32_t noise = 0x9E3779B9;
+  int failures = 0;
+  Scene scene = {};
+  startMotionWatch();
+
+  printf("%-22s %7s %10s %10s  %s\n", "phase", "frames", "max change", "saves", "check");
+  for (const Phase &p : phases){
+    const uint32_t triggers_before = motion_stats.triggers;
+    float max_change = 0;
+    scene.brightness = p.brightness;
+    scene.block = p.block;
+    for (int f = 0; f < p.frames; f++){
+      scene.bx = (scene.bx + p.step) % (W - p.block + 1);
+      scene.by = (W / 3 + scene.bx / 2) % (H - p.block + 1);
+      renderScene(scene, buf.data(), noise);
+      detectMotion(&fb);
+      max_change = max(max_change, motion_stats.changed_percent);
+      simConsumeNs(FRAME_NS);
+    }
+    const uint32_t saves = motion_stats.triggers - triggers_before;
+    const bool ok = saves == p.expected;
+    failures += !ok;
+    printf("%-22s %7d %9.1f%% %10lu  %s\n", p.name, p.frames, max_change, (unsigned long)saves, ok ? "ok" : "WRONG");
+  }
+
+  // Cost per frame, the detector sees the same frame over and over which costs it the same as new ones
+  std::vector<uint8_t> last = buf;
+  const double detect_us = timeUs([&](){ detectMotion(&fb); });
+  volatile int sink = 0;
+  const double full_us = timeUs([&](){ sink = sink + fullFrameDiff(buf.data(), last.data()); });
+  printf("\n%-22s %9.1f us per frame\n", "detectMotion", detect_us);
+  printf("%-22s %9.1f us per frame  baseline\n", "full frame diff", full_us);
+
+  if (failures){
+    printf("FAIL: %d phases got the wrong number of saves\n", failures);
+    return 1;
+  }
+  return 0;
+}
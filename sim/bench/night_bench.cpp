@@ -0,0 +1,175 @@
+/*
+
+Host benchmark for the night photos in night_capture.h
+
+Renders a textured scene NIGHT_FRAMES times with a hand shake of up to 3 pixels between frames and strong
+sensor noise, and takes a night photo of it through accumulateNightFrame() and the frame ring. The photo has
+to match a per pixel average of the same frames shifted back by the shake the scene was rendered with, bit
+for bit, which only holds if the alignment found every shift. Then compares the noise of one frame, the
+frames averaged without alignment and the night photo against the clean scene, and times a frame
+
+Usage: night_bench [min_ms]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "frame_ring.h"
+#include "night_capture.h"
+
+static const int W = IMAGE_WIDTH, H = IMAGE_HEIGHT;
+static const int shake[][2] = {{0, 0}, {2, -1}, {-3, 1}, {1, 3}, {-1, -2}, {3, 0}, {0, -3}, {-2, 2}};
+static_assert(sizeof(shake) / sizeof(shake[0]) >= NIGHT_FRAMES, "a shake for every frame");
+
+// ============================= Scene =============================
+static void scene(int x, int y, int &r, int &g, int &b){
+  // Mid range tiles and stripes, so the noise isn't clipped and the shifts have edges to find
+  x += 64;
+  y += 64;
+  const int tile = ((x / 12) ^ (y / 17)) & 3;
+  const int stripe = ((x + 2 * y) / 7) & 1;
+  r = 9 + 3 * tile + 2 * stripe;
+  g = 18 + 5 * tile + 6 * stripe;
+  b = 14 - 2 * tile + stripe;
+}
+
+static void renderFrame(int ox, int oy, uint8_t *buf, uint32_t &noise, bool noisy){
+  for (int y = 0; y < H; y++){
+    for (int x = 0; x < W; x++){
+      int r, g, b;
+      scene(x + ox, y + oy, r, g, b);
+      if (noisy){
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        r += (int)(noise % 7) - 3;
+        g += (int)((noise >> 8) % 13) - 6;
+        b += (int)((noise >> 16) % 7) - 3;
+      }
+      const uint16_t c = (constrain(r, 0, 31) << 11) | (constrain(g, 0, 63) << 5) | constrain(b, 0, 31);
+      *buf++ = c >> 8;
+      *buf++ = c & 0xFF;
+    }
+  }
+}
+
+// ============================= Reference =============================
+static void averageFrames(const std::vector<std::vector<uint8_t>> &frames, bool aligned, std::vector<uint8_t> &out){
+  // Same rounding and edge repeat as the accumulator, shifted by the true shake
+  const int n = NIGHT_FRAMES;
+  for (int y = 0; y < H; y++){
+    for (int x = 0; x < W; x++){
+      int r = 0, g = 0, b = 0;
+      for (int k = 0; k < n; k++){
+        const int sx = aligned ? constrain(x - shake[k][0], 0, W - 1) : x;
+        const int sy = aligned ? constrain(y - shake[k][1], 0, H - 1) : y;
+        const uint8_t *px = &frames[k][(sy * W + sx) * 2];
+        const int p = (px[0] << 8) | px[1];
+        r += p >> 11;
+        g += (p >> 5) & 0x3F;
+        b += p & 0x1F;
+      }
+      const int c = (((r + n / 2) / n) << 11) | (((g + n / 2) / n) << 5) | ((b + n / 2) / n);
+      out[(y * W + x) * 2] = c >> 8;
+      out[(y * W + x) * 2 + 1] = c & 0xFF;
+    }
+  }
+}
+
+static double psnr(const uint8_t *a, const uint8_t *clean){
+  // Over the three channels scaled to 6 bits, leaving out the border the shake repeats edges into
+  double err = 0;
+  int count = 0;
+  for (int y = 4; y < H - 4; y++){
+    for (int x = 4; x < W - 4; x++){
+      const int i = (y * W + x) * 2;
+      const int p = (a[i] << 8) | a[i + 1], q = (clean[i] << 8) | clean[i + 1];
+      const int dr = 2 * ((p >> 11) - (q >> 11)), dg = ((p >> 5) & 0x3F) - ((q >> 5) & 0x3F), db = 2 * ((p & 0x1F) - (q & 0x1F));
+      err += dr * dr + dg * dg + db * db;
+      count += 3;
+    }
+  }
+  return err ? 10 * log10(63.0 * 63.0 * count / err) : 99;
+}
+
+// ============================= Timing =============================
+static double min_ms = 300;
+
+static double timeUs(const std::function<void()> &kernel){
+  using clock = std::chrono::steady_clock;
+  int runs = 0;
+  auto start = clock::now();
+  double elapsed_ms = 0;
+  do {
+    kernel();
+    runs++;
+    elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  } while (elapsed_ms < min_ms);
+  return elapsed_ms * 1000.0 / runs;
+}
+
+static bool takePhoto(const std::vector<std::vector<uint8_t>> &frames, std::vector<uint8_t> &out){
+  // One night photo through the module and the frame ring, false if it never came out
+  camera_fb_t fb = {};
+  fb.len = W * H * 2;
+  fb.width = W;
+  fb.height = H;
+  fb.format = PIXFORMAT_RGB565;
+  requestNightCapture();
+  bool done = false;
+  for (int k = 0; k < NIGHT_FRAMES && !done; k++){
+    fb.buf = (uint8_t *)frames[k].data();
+    done = accumulateNightFrame(&fb, 0);
+  }
+  RingFrame *photo = done ? takeRingFrame(0) : NULL;
+  if (!photo){
+    return false;
+  }
+  memcpy(out.data(), photo->pixels, out.size());
+  releaseRingFrame(photo);
+  return true;
+}
+
+int main(int argc, char **argv){
+  if (argc > 1){
+    min_ms = atof(argv[1]);
+  }
+  initFrameRing();
+  uint32_t noise = 0x9E3779B9;
+  std::vector<std::vector<uint8_t>> frames(NIGHT_FRAMES, std::vector<uint8_t>(W * H * 2));
+  for (int k = 0; k < NIGHT_FRAMES; k++){
+    renderFrame(shake[k][0], shake[k][1], frames[k].data(), noise, true);
+  }
+  std::vector<uint8_t> clean(W * H * 2), photo(W * H * 2), expected(W * H * 2), unaligned(W * H * 2);
+  renderFrame(0, 0, clean.data(), noise, false);
+  averageFrames(frames, true, expected);
+  averageFrames(frames, false, unaligned);
+
+  if (!takePhoto(frames, photo)){
+    printf("FAIL: no night photo came out of the frame ring\n");
+    return 1;
+  }
+  const bool ok = photo == expected;
+  printf("%d frames, shake up to 3 px, alignment found up to %d px: %s\n\n", NIGHT_FRAMES, night_stats.max_shift,
+         ok ? "matches the average with the true shifts" : "MISMATCH");
+
+  printf("%-24s %8s\n", "against the clean scene", "PSNR");
+  printf("%-24s %6.1f dB\n", "one frame", psnr(frames[0].data(), clean.data()));
+  printf("%-24s %6.1f dB\n", "averaged, not aligned", psnr(unaligned.data(), clean.data()));
+  printf("%-24s %6.1f dB\n\n", "night photo", psnr(photo.data(), clean.data()));
+
+  const double us = timeUs([&](){ takePhoto(frames, photo); }) / NIGHT_FRAMES;
+  printf("%-24s %8.1f us per frame\n", "accumulate + align", us);
+  printf("%-24s %8d kB, against %d kB for every frame\n", "PSRAM while taking", W * H * 4 / 1024, NIGHT_FRAMES * W * H * 2 / 1024);
+
+  if (!ok){
+    printf("FAIL: the night photo differs from the aligned average\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+
+Host run of the SD card benchmark in sd_bench.h
+
+The same steps the SD Bench app runs on the device, through the SD stand-in backed by a host directory.
+MB/s and the latencies are on the virtual clock, so they show what the simulator's SD model (1-bit bus,
+per call and per open costs) makes of each block size. The wall clock column is the host's own file I/O for
+the step, page cache and all. Results are appended to the same CSV the device writes
+
+Usage: sd_card_bench [dir]      dir defaults to a fresh temporary directory, the CSV is left in it
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <SD_MMC.h>
+#include "globals.h"
+#include "sd_bench.h"
+#include "../sim.h"
+
+int main(int argc, char **argv){
+  char tmp[] = "/tmp/sd_card_benchXXXXXX";
+  const char *dir = argc > 1 ? argv[1] : mkdtemp(tmp);
+  if (!dir){
+    perror("mkdtemp");
+    return 1;
+  }
+  simSetSdRoot(dir);
+  SD_MMC.begin();
+
+  if (!beginSdBench()){
+    return 1;
+  }
+
+  printf("%-6s %-10s %9s %9s %9s %10s\n", "block", "test", "MB/s", "p50 us", "p99 us", "wall ms");
+  int failures = 0;
+  for (int step = 0; step < SD_BENCH_STEPS; step++){
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    runSdBenchStep(step, &sd_bench_results[step]);
+    const double wall_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    const SdBenchResult *r = &sd_bench_results[step];
+    if (!r->ok){
+      printf("%-6lu %-10s failed\n", (unsigned long)r->block_size, sdBenchTestName(r->test));
+      failures++;
+      continue;
+    }
+    printf("%-6lu %-10s %9.2f %9lu %9lu %10.2f\n", (unsigned long)r->block_size, sdBenchTestName(r->test),
+           r->mb_per_s, (unsigned long)r->p50_us, (unsigned long)r->p99_us, wall_ms);
+  }
+  endSdBench();
+
+  if (!saveSdBenchResults(sd_bench_results, SD_BENCH_STEPS, time(NULL))){
+    failures++;
+  }
+  printf("Results appended to %s%s\n", dir, SD_BENCH_RESULTS_FILE);
+
+  if (failures){
+    printf("FAIL: %d steps did not complete\n", failures);
+    return 1;
+  }
+  return 0;
+}
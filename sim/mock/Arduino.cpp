@@ -0,0 +1,125 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <map>
+#include "esp_camera.h"
+#include "../sim.h"
+
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// Sim boot time, fixed so every run stamps the same file names (2025-01-01 12:00:00)
+static const time_t SIM_EPOCH = 1735732800;
+static long sim_gmt_offset = 0;
+
+int HardwareSerial::printf(const char *fmt, ...){
+  char buf[512];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  write(buf);
+  return n;
+}
+
+void HardwareSerial::write(const char *s){
+  // Serial goes to stderr so stdout stays clean for the run summary
+  fputs(s, stderr);
+}
+
+// Heap usage wanders a little with time so the System Data graph has something to show
+static uint32_t heapWobble(){
+  uint64_t s = simNowUs() / 1000000;
+  return (uint32_t)((s * 7919) % 23) * 512;
+}
+
+uint32_t EspClass::getHeapSize(){ return 327680; }
+uint32_t EspClass::getFreeHeap(){ return 151552 - heapWobble(); }
+uint32_t EspClass::getMinFreeHeap(){ return 139264; }
+uint32_t EspClass::getMaxAllocHeap(){ return 110592; }
+uint32_t EspClass::getPsramSize(){ return 4192123; }
+static uint32_t min_free_psram = 4192123;
+
+uint32_t EspClass::getFreePsram(){
+  // Only the camera pool is counted, it is the one big allocation that comes and goes
+  const uint32_t free_psram = 4192123 - sim_camera_stats.pool_bytes;
+  min_free_psram = min(min_free_psram, free_psram);
+  return free_psram;
+}
+uint32_t EspClass::getMinFreePsram(){ return min(min_free_psram, getFreePsram()); }
+uint32_t EspClass::getMaxAllocPsram(){ return 4128756 - sim_camera_stats.pool_bytes; }
+
+uint32_t getCpuFrequencyMhz(){
+  return 240;
+}
+
+bool psramFound(){
+  return true;
+}
+
+void *ps_malloc(size_t size){
+  return malloc(size);
+}
+
+void *ps_calloc(size_t n, size_t size){
+  return calloc(n, size);
+}
+
+static std::map<uintptr_t, size_t> dma_blocks;      // Start and size of every MALLOC_CAP_DMA allocation
+
+void *heap_caps_malloc(size_t size, uint32_t caps){
+  void *ptr = malloc(size);
+  if (ptr && (caps & MALLOC_CAP_DMA)){
+    dma_blocks[(uintptr_t)ptr] = size;
+  }
+  return ptr;
+}
+
+void heap_caps_free(void *ptr){
+  dma_blocks.erase((uintptr_t)ptr);
+  free(ptr);
+}
+
+bool esp_ptr_dma_capable(const void *ptr){
+  auto it = dma_blocks.upper_bound((uintptr_t)ptr);
+  if (it == dma_blocks.begin()){
+    return false;
+  }
+  --it;
+  return (uintptr_t)ptr < it->first + it->second;
+}
+
+unsigned long millis(){
+  return (unsigned long)(simNowUs() / 1000);
+}
+
+unsigned long micros(){
+  return (unsigned long)simNowUs();
+}
+
+void delay(uint32_t ms){
+  if (simInTask()){
+    vTaskDelay(pdMS_TO_TICKS(ms));
+  } else{
+    simConsumeNs((uint64_t)ms * 1000000ULL);
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+}
+
+int analogRead(uint8_t pin){
+  simConsumeNs(10000);            // One ADC conversion
+  return simButtonAdc();
+}
+
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char *server1,
+                const char *server2, const char *server3){
+  sim_gmt_offset = gmt_offset_sec + daylight_offset_sec;
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms){
+  time_t now = SIM_EPOCH + sim_gmt_offset + (time_t)(simNowUs() / 1000000);
+  gmtime_r(&now, info);
+  return true;
+}
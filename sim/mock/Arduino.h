@@ -0,0 +1,151 @@
+/*
+
+Host stand-in for the parts of the ESP32 Arduino core used by MiniBerryOS
+
+String, Serial, ESP heap queries, timing, ADC and NTP time on the simulator's virtual clock
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LOW 0
+#define HIGH 1
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+// ============================= String =============================
+class String {
+public:
+  String() {}
+  String(const char *s) : str(s ? s : "") {}
+  String(const std::string &s) : str(s) {}
+  String(char c) : str(1, c) {}
+  String(int v) : str(std::to_string(v)) {}
+  String(unsigned int v) : str(std::to_string(v)) {}
+  String(long v) : str(std::to_string(v)) {}
+  String(unsigned long v) : str(std::to_string(v)) {}
+  String(long long v) : str(std::to_string(v)) {}
+  String(unsigned long long v) : str(std::to_string(v)) {}
+  String(float v, unsigned int dp = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", dp, v); str = b; }
+  String(double v, unsigned int dp = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", dp, v); str = b; }
+
+  const char *c_str() const { return str.c_str(); }
+  unsigned int length() const { return str.length(); }
+  bool isEmpty() const { return str.empty(); }
+  char operator[](unsigned int i) const { return str[i]; }
+  void toCharArray(char *buf, unsigned int size) const {
+    if (size == 0) return;
+    strncpy(buf, str.c_str(), size - 1);
+    buf[size - 1] = '\0';
+  }
+  bool startsWith(const String &s) const { return str.compare(0, s.str.size(), s.str) == 0; }
+  bool endsWith(const String &s) const { return str.size() >= s.str.size() && str.compare(str.size() - s.str.size(), s.str.size(), s.str) == 0; }
+  int indexOf(char c) const { size_t p = str.find(c); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c) const { size_t p = str.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const { return from < str.size() ? String(str.substr(from, to - from)) : String(); }
+  long toInt() const { return atol(str.c_str()); }
+
+  String &operator+=(const String &s) { str += s.str; return *this; }
+  bool operator==(const String &s) const { return str == s.str; }
+  bool operator!=(const String &s) const { return str != s.str; }
+  bool operator<(const String &s) const { return str < s.str; }
+  friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+
+private:
+  std::string str;
+};
+
+// ============================= Serial =============================
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) {}
+  int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+  void print(const String &s) { write(s.c_str()); }
+  void print(const char *s) { write(s); }
+  void print(int v) { print(String(v)); }
+  void print(unsigned int v) { print(String(v)); }
+  void print(long v) { print(String(v)); }
+  void print(unsigned long v) { print(String(v)); }
+  void print(double v, int dp = 2) { print(String(v, dp)); }
+  template <typename T> auto print(const T &v) -> decltype(v.toString(), void()) { print(v.toString()); }
+  template <typename T> void println(const T &v) { print(v); write("\n"); }
+  void println(double v, int dp) { print(v, dp); write("\n"); }
+  void println() { write("\n"); }
+
+private:
+  void write(const char *s);
+};
+
+extern HardwareSerial Serial;
+
+// ============================= ESP =============================
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getPsramSize();
+  uint32_t getFreePsram();
+  uint32_t getMinFreePsram();
+  uint32_t getMaxAllocPsram();
+};
+
+extern EspClass ESP;
+
+uint32_t getCpuFrequencyMhz();
+
+// ============================= PSRAM =============================
+bool psramFound();
+
+void *ps_malloc(size_t size);
+
+void *ps_calloc(size_t n, size_t size);
+
+// ============================= Heap caps =============================
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+
+void heap_caps_free(void *ptr);
+
+bool esp_ptr_dma_capable(const void *ptr);     // Only heap_caps_malloc(MALLOC_CAP_DMA) memory counts here, stack and ps_malloc don't
+
+// ============================= Timing and IO =============================
+unsigned long millis();
+
+unsigned long micros();
+
+void delay(uint32_t ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+
+int analogRead(uint8_t pin);
+
+// ============================= Time =============================
+void configTime(long gmt_offset_sec, int daylight_offset_sec, const char *server1,
+                const char *server2 = NULL, const char *server3 = NULL);
+
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
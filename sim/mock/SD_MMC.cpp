@@ -0,0 +1,255 @@
+#include "SD_MMC.h"
+#include <stdio.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "../sim.h"
+
+
+SDMMCFS SD_MMC;
+
+static std::string sd_root = "sdcard";
+
+void simSetSdRoot(const std::string &dir){
+  sd_root = dir;
+}
+
+static std::string hostPath(const char *path){
+  return sd_root + (path[0] == '/' ? "" : "/") + path;
+}
+
+// Charge card latency: a fixed command cost plus transfer time at the bus rate
+static void sdCost(uint64_t op_ns, size_t bytes){
+  simBlockNs(op_ns + (uint64_t)bytes * 1000000000ULL / SIM_SD_BYTES_PER_SEC);
+}
+
+namespace fs {
+
+struct FileImpl {
+  FILE *fp = NULL;
+  bool dir = false;
+  std::string path;                     // Path on the card, e.g. /photo.raw
+  std::string name;                     // Base name, what File::name() returns
+  std::vector<std::string> entries;     // Directory listing, sorted for deterministic runs
+  size_t next = 0;
+
+  ~FileImpl(){
+    if (fp){
+      fclose(fp);
+    }
+  }
+};
+
+static std::shared_ptr<FileImpl> openImpl(const char *path, const char *mode){
+  std::string host = hostPath(path);
+  struct stat st;
+  bool exists = stat(host.c_str(), &st) == 0;
+
+  auto impl = std::make_shared<FileImpl>();
+  impl->path = path;
+  size_t slash = impl->path.find_last_of('/');
+  impl->name = (slash == std::string::npos) ? impl->path : impl->path.substr(slash + 1);
+
+  if (exists && S_ISDIR(st.st_mode)){
+    DIR *d = opendir(host.c_str());
+    if (!d){
+      return NULL;
+    }
+    while (struct dirent *e = readdir(d)){
+      if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..")){
+        impl->entries.push_back(e->d_name);
+      }
+    }
+    closedir(d);
+    std::sort(impl->entries.begin(), impl->entries.end());
+    impl->dir = true;
+    return impl;
+  }
+
+  if (!exists && mode[0] == 'r'){
+    return NULL;
+  }
+  std::string m = std::string(mode) + "b";
+  if (mode[0] == 'r'){
+    m = strchr(mode, '+') ? "r+b" : "rb";     // "r+" writes in place, random write benchmarks
+  }
+  impl->fp = fopen(host.c_str(), m.c_str());
+  return impl->fp ? impl : NULL;
+}
+
+File::operator bool() const{
+  return impl && (impl->fp || impl->dir);
+}
+
+size_t File::write(const uint8_t *buf, size_t size){
+  if (!impl || !impl->fp){
+    return 0;
+  }
+  // The driver bounces buffers its DMA can't reach (PSRAM) through one sector at a time, a command each
+  const uint64_t commands = esp_ptr_dma_capable(buf) ? 1 : std::max<uint64_t>(1, (size + SIM_SD_SECTOR_BYTES - 1) / SIM_SD_SECTOR_BYTES);
+  sdCost(SIM_SD_READ_NS * commands, size);
+  return fwrite(buf, 1, size, impl->fp);
+}
+
+size_t File::read(uint8_t *buf, size_t size){
+  if (!impl || !impl->fp){
+    return 0;
+  }
+  sdCost(SIM_SD_READ_NS, size);
+  return fread(buf, 1, size, impl->fp);
+}
+
+int File::read(){
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek(){
+  if (!impl || !impl->fp){
+    return -1;
+  }
+  int c = fgetc(impl->fp);
+  if (c != EOF){
+    ungetc(c, impl->fp);
+  }
+  return c == EOF ? -1 : c;
+}
+
+int File::available(){
+  if (!impl || !impl->fp){
+    return 0;
+  }
+  return (int)(size() - position());
+}
+
+void File::flush(){
+  if (impl && impl->fp){
+    fflush(impl->fp);
+  }
+}
+
+bool File::seek(uint32_t pos, SeekMode mode){
+  if (!impl || !impl->fp){
+    return false;
+  }
+  sdCost(SIM_SD_READ_NS, 0);
+  int whence = (mode == SeekSet) ? SEEK_SET : (mode == SeekCur) ? SEEK_CUR : SEEK_END;
+  return fseek(impl->fp, pos, whence) == 0;
+}
+
+size_t File::position() const{
+  return (impl && impl->fp) ? (size_t)ftell(impl->fp) : 0;
+}
+
+size_t File::size() const{
+  if (!impl || !impl->fp){
+    return 0;
+  }
+  long here = ftell(impl->fp);
+  fseek(impl->fp, 0, SEEK_END);
+  long end = ftell(impl->fp);
+  fseek(impl->fp, here, SEEK_SET);
+  return (size_t)end;
+}
+
+void File::close(){
+  if (impl && (impl->fp || impl->dir)){
+    sdCost(SIM_SD_OP_NS, 0);
+  }
+  impl.reset();
+}
+
+const char *File::name() const{
+  return impl ? impl->name.c_str() : "";
+}
+
+const char *File::path() const{
+  return impl ? impl->path.c_str() : "";
+}
+
+bool File::isDirectory() const{
+  return impl && impl->dir;
+}
+
+File File::openNextFile(const char *mode){
+  if (!impl || !impl->dir || impl->next >= impl->entries.size()){
+    return File();
+  }
+  std::string child = impl->path;
+  if (child.empty() || child.back() != '/'){
+    child += "/";
+  }
+  child += impl->entries[impl->next++];
+  sdCost(SIM_SD_OP_NS, 0);
+  return File(openImpl(child.c_str(), mode));
+}
+
+void File::rewindDirectory(){
+  if (impl){
+    impl->next = 0;
+  }
+}
+
+File FS::open(const char *path, const char *mode, bool create){
+  sdCost(SIM_SD_OP_NS, 0);
+  return File(openImpl(path, mode));
+}
+
+bool FS::exists(const char *path){
+  sdCost(SIM_SD_OP_NS, 0);
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char *path){
+  sdCost(SIM_SD_OP_NS, 0);
+  return ::unlink(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char *from, const char *to){
+  sdCost(SIM_SD_OP_NS, 0);
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char *path){
+  sdCost(SIM_SD_OP_NS, 0);
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+bool FS::rmdir(const char *path){
+  sdCost(SIM_SD_OP_NS, 0);
+  return ::rmdir(hostPath(path).c_str()) == 0;
+}
+
+}  // namespace fs
+
+bool SDMMCFS::begin(const char *mountpoint, bool mode1bit, bool format_if_mount_failed,
+                    int sdmmc_frequency, uint8_t maxOpenFiles){
+  ::mkdir(sd_root.c_str(), 0755);
+  struct stat st;
+  mounted = stat(sd_root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  sdCost(50 * SIM_SD_OP_NS, 0);             // Card identification and FAT mount
+  return mounted;
+}
+
+void SDMMCFS::end(){
+  mounted = false;
+}
+
+sdcard_type_t SDMMCFS::cardType(){
+  return mounted ? CARD_SDHC : CARD_NONE;
+}
+
+uint64_t SDMMCFS::cardSize(){
+  return mounted ? 8ULL << 30 : 0;
+}
+
+uint64_t SDMMCFS::totalBytes(){
+  return cardSize();
+}
+
+uint64_t SDMMCFS::usedBytes(){
+  return 0;
+}
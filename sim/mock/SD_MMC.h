@@ -0,0 +1,32 @@
+/*
+
+Host stand-in for the ESP32 SD_MMC driver
+
+*/
+
+#pragma once
+#include "FS.h"
+
+typedef enum {
+  CARD_NONE,
+  CARD_MMC,
+  CARD_SD,
+  CARD_SDHC,
+  CARD_UNKNOWN
+} sdcard_type_t;
+
+class SDMMCFS : public fs::FS {
+public:
+  bool begin(const char *mountpoint = "/sdcard", bool mode1bit = false, bool format_if_mount_failed = false,
+             int sdmmc_frequency = 20000, uint8_t maxOpenFiles = 5);
+  void end();
+  sdcard_type_t cardType();
+  uint64_t cardSize();
+  uint64_t totalBytes();
+  uint64_t usedBytes();
+
+private:
+  bool mounted = false;
+};
+
+extern SDMMCFS SD_MMC;
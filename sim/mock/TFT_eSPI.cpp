@@ -0,0 +1,368 @@
+#include "TFT_eSPI.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../sim.h"
+#include "glcdfont.h"
+
+
+SimTftStats sim_tft_stats = {};
+
+static TFT_eSPI *panel = NULL;        // The instance init() was called on
+
+static inline uint16_t bswap16(uint16_t v){
+  return (v << 8) | (v >> 8);
+}
+
+TFT_eSPI::TFT_eSPI(int16_t w, int16_t h)
+  : _width(w), _height(h), fb((size_t)w * h, TFT_BLACK), rotation(0), swap_bytes(false),
+    text_fg(TFT_WHITE), text_bg(TFT_BLACK), text_datum(TL_DATUM), text_size(1) {}
+
+void TFT_eSPI::init(){
+  panel = this;
+  simConsumeNs(120000000ULL);           // Reset + sleep out + display on delays in the init sequence
+}
+
+TFT_eSPI *TFT_eSPI::simPanel(){
+  return panel;
+}
+
+void TFT_eSPI::countWindow(uint64_t pixels){
+  // Every address window costs a command sequence, then 16 bits per pixel at the SPI clock
+  sim_tft_stats.windows++;
+  sim_tft_stats.pixels += pixels;
+  sim_tft_stats.bytes += pixels * 2;
+  simConsumeNs(SIM_SPI_WINDOW_NS + pixels * 16ULL * 1000000000ULL / SIM_SPI_HZ);
+}
+
+bool TFT_eSPI::clip(int32_t &x, int32_t &y, int32_t &w, int32_t &h) const{
+  if (x < 0){ w += x; x = 0; }
+  if (y < 0){ h += y; y = 0; }
+  if (x + w > _width){ w = _width - x; }
+  if (y + h > _height){ h = _height - y; }
+  return (w > 0) && (h > 0);
+}
+
+void TFT_eSPI::fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color){
+  if (!clip(x, y, w, h)){
+    return;
+  }
+  busIdle();
+  for (int32_t j = y; j < y + h; j++){
+    uint16_t *row = &fb[(size_t)j * _width];
+    for (int32_t i = x; i < x + w; i++){
+      row[i] = color;
+    }
+  }
+  countWindow((uint64_t)w * h);
+}
+
+void TFT_eSPI::fillScreen(uint32_t color){
+  fillWindow(0, 0, _width, _height, color);
+}
+
+void TFT_eSPI::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color){
+  fillWindow(x, y, w, h, color);
+}
+
+void TFT_eSPI::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color){
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y + 1, h - 2, color);
+  drawFastVLine(x + w - 1, y + 1, h - 2, color);
+}
+
+void TFT_eSPI::drawPixel(int32_t x, int32_t y, uint32_t color){
+  fillWindow(x, y, 1, 1, color);
+}
+
+void TFT_eSPI::drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color){
+  fillWindow(x, y, w, 1, color);
+}
+
+void TFT_eSPI::drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color){
+  fillWindow(x, y, 1, h, color);
+}
+
+void TFT_eSPI::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color){
+  // Bresenham, emitting one fast line per run like TFT_eSPI does
+  bool steep = abs(y1 - y0) > abs(x1 - x0);
+  if (steep){
+    int32_t t = x0; x0 = y0; y0 = t;
+    t = x1; x1 = y1; y1 = t;
+  }
+  if (x0 > x1){
+    int32_t t = x0; x0 = x1; x1 = t;
+    t = y0; y0 = y1; y1 = t;
+  }
+
+  int32_t dx = x1 - x0, dy = abs(y1 - y0);
+  int32_t err = dx >> 1, ystep = (y0 < y1) ? 1 : -1;
+  int32_t xs = x0, dlen = 0;
+
+  for (; x0 <= x1; x0++){
+    dlen++;
+    err -= dy;
+    if (err < 0){
+      err += dx;
+      if (steep){
+        drawFastVLine(y0, xs, dlen, color);
+      } else{
+        drawFastHLine(xs, y0, dlen, color);
+      }
+      dlen = 0;
+      y0 += ystep;
+      xs = x0 + 1;
+    }
+  }
+  if (dlen){
+    if (steep){
+      drawFastVLine(y0, xs, dlen, color);
+    } else{
+      drawFastHLine(xs, y0, dlen, color);
+    }
+  }
+}
+
+void TFT_eSPI::drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color){
+  int32_t f = 1 - r, ddF_x = 1, ddF_y = -2 * r, x = 0, y = r;
+
+  drawPixel(x0, y0 + r, color);
+  drawPixel(x0, y0 - r, color);
+  drawPixel(x0 + r, y0, color);
+  drawPixel(x0 - r, y0, color);
+
+  while (x < y){
+    if (f >= 0){
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+    drawPixel(x0 + x, y0 + y, color);
+    drawPixel(x0 - x, y0 + y, color);
+    drawPixel(x0 + x, y0 - y, color);
+    drawPixel(x0 - x, y0 - y, color);
+    drawPixel(x0 + y, y0 + x, color);
+    drawPixel(x0 - y, y0 + x, color);
+    drawPixel(x0 + y, y0 - x, color);
+    drawPixel(x0 - y, y0 - x, color);
+  }
+}
+
+void TFT_eSPI::fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color){
+  // One horizontal span per scanline
+  for (int32_t dy = -r; dy <= r; dy++){
+    int32_t half = 0;
+    while ((half + 1) * (half + 1) + dy * dy <= r * r){
+      half++;
+    }
+    drawFastHLine(x0 - half, y0 + dy, 2 * half + 1, color);
+  }
+}
+
+void TFT_eSPI::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data){
+  int32_t cx = x, cy = y, cw = w, ch = h;
+  if (!clip(cx, cy, cw, ch)){
+    return;
+  }
+  busIdle();
+  for (int32_t j = 0; j < ch; j++){
+    const uint16_t *src = data + (size_t)(cy - y + j) * w + (cx - x);
+    uint16_t *dst = &fb[(size_t)(cy + j) * _width + cx];
+    for (int32_t i = 0; i < cw; i++){
+      dst[i] = swap_bytes ? src[i] : bswap16(src[i]);    // Bytes go out in memory order, panel reads MSB first
+    }
+  }
+  countWindow((uint64_t)cw * ch);
+}
+
+void TFT_eSPI::simPushNative(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data){
+  int32_t cx = x, cy = y, cw = w, ch = h;
+  if (!clip(cx, cy, cw, ch)){
+    return;
+  }
+  busIdle();
+  for (int32_t j = 0; j < ch; j++){
+    memcpy(&fb[(size_t)(cy + j) * _width + cx], data + (size_t)(cy - y + j) * w + (cx - x), cw * sizeof(uint16_t));
+  }
+  countWindow((uint64_t)cw * ch);
+}
+
+void TFT_eSPI::readRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data){
+  // Inverse of pushImage so a read followed by a push round trips
+  busIdle();
+  for (int32_t j = 0; j < h; j++){
+    for (int32_t i = 0; i < w; i++){
+      int32_t px = x + i, py = y + j;
+      uint16_t c = (px >= 0 && py >= 0 && px < _width && py < _height) ? fb[(size_t)py * _width + px] : 0;
+      data[(size_t)j * w + i] = swap_bytes ? c : bswap16(c);
+    }
+  }
+  countWindow((uint64_t)w * h * 3 / 2);   // Panel reads back 18 bit colour, 3 bytes per pixel
+}
+
+void TFT_eSPI::pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer){
+  if (!dma_enabled || w <= 0 || h <= 0){
+    return;
+  }
+  if (x < 0 || y < 0 || x + w > _width || y + h > _height){
+    Serial.println("sim: clipped pushImageDMA is not simulated");
+    return;
+  }
+
+  if (buffer && buffer != data){
+    memcpy(buffer, data, (size_t)w * h * sizeof(uint16_t));                  // CPU copy out of PSRAM
+    simConsumeNs((uint64_t)w * h * sizeof(uint16_t) * 1000000000ULL / SIM_PSRAM_BYTES_PER_SEC);
+    data = buffer;
+  }
+  dmaWait();                                      // Previous transfer has to finish before the next window is set
+
+  const uint64_t pixels = (uint64_t)w * h;
+  sim_tft_stats.windows++;
+  sim_tft_stats.pixels += pixels;
+  sim_tft_stats.bytes += pixels * 2;
+  dma_pending = true;
+  dma_done_ns = simNowNs() + SIM_SPI_WINDOW_NS + pixels * 16ULL * 1000000000ULL / SIM_SPI_HZ;
+  dma_x = x;
+  dma_y = y;
+  dma_w = w;
+  dma_h = h;
+  dma_data = data;
+}
+
+void TFT_eSPI::dmaComplete(){
+  // Reads the source only now, so a buffer reused before the transfer finished shows up on screen
+  for (int32_t j = 0; j < dma_h; j++){
+    const uint16_t *src = dma_data + (size_t)j * dma_w;
+    uint16_t *dst = &fb[(size_t)(dma_y + j) * _width + dma_x];
+    for (int32_t i = 0; i < dma_w; i++){
+      dst[i] = swap_bytes ? src[i] : bswap16(src[i]);
+    }
+  }
+  dma_pending = false;
+}
+
+bool TFT_eSPI::dmaBusy(){
+  if (dma_pending && simNowNs() >= dma_done_ns){
+    dmaComplete();
+  }
+  return dma_pending;
+}
+
+void TFT_eSPI::dmaWait(){
+  if (!dma_pending){
+    return;
+  }
+  if (simNowNs() < dma_done_ns){
+    simBlockNs(dma_done_ns - simNowNs());       // Waits on the transfer semaphore, other tasks run
+  }
+  dmaComplete();
+}
+
+int16_t TFT_eSPI::textWidth(const char *s) const{
+  return (int16_t)(strlen(s) * 6 * text_size);
+}
+
+void TFT_eSPI::drawChar(char c, int32_t x, int32_t y){
+  // GLCD font 1: 5x7 glyph in a 6x8 cell, unknown characters draw as a blank cell
+  const int32_t s = text_size;
+  const bool fill_bg = text_bg != text_fg;
+  const uint8_t *glyph = (c >= 32 && c <= 126) ? sim_glcd_font[c - 32] : sim_glcd_font[0];
+
+  if (s == 1 && fill_bg){                     // Size 1 with background is a single 6x8 window
+    int32_t cx = x, cy = y, cw = 6, ch = 8;
+    if (!clip(cx, cy, cw, ch)){
+      return;
+    }
+    busIdle();
+    for (int32_t j = cy; j < cy + ch; j++){
+      for (int32_t i = cx; i < cx + cw; i++){
+        int32_t col = i - x, row = j - y;
+        bool on = (col < 5) && ((glyph[col] >> row) & 1);
+        fb[(size_t)j * _width + i] = on ? text_fg : text_bg;
+      }
+    }
+    countWindow((uint64_t)cw * ch);
+    return;
+  }
+
+  // Larger sizes and transparent text go pixel block by pixel block
+  for (int32_t col = 0; col < 6; col++){
+    for (int32_t row = 0; row < 8; row++){
+      bool on = (col < 5) && ((glyph[col] >> row) & 1);
+      if (on){
+        fillWindow(x + col * s, y + row * s, s, s, text_fg);
+      } else if (fill_bg){
+        fillWindow(x + col * s, y + row * s, s, s, text_bg);
+      }
+    }
+  }
+}
+
+int16_t TFT_eSPI::drawString(const char *s, int32_t x, int32_t y){
+  const int32_t w = textWidth(s);
+  const int32_t h = fontHeight();
+
+  switch (text_datum % 3){                    // Horizontal part of the datum
+    case 1: x -= w / 2; break;
+    case 2: x -= w; break;
+  }
+  switch (text_datum / 3){                    // Vertical part of the datum
+    case 1: y -= h / 2; break;
+    case 2: y -= h; break;
+  }
+
+  for (const char *p = s; *p; p++){
+    drawChar(*p, x, y);
+    x += 6 * text_size;
+  }
+  return (int16_t)w;
+}
+
+int16_t TFT_eSPI::drawNumber(long n, int32_t x, int32_t y){
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", n);
+  return drawString(buf, x, y);
+}
+
+int16_t TFT_eSPI::drawFloat(float f, uint8_t dp, int32_t x, int32_t y){
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", dp, f);
+  return drawString(buf, x, y);
+}
+
+void *TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames){
+  _width = w;
+  _height = h;
+  fb.assign((size_t)w * h, TFT_BLACK);
+  created = true;
+  return fb.data();
+}
+
+void TFT_eSprite::deleteSprite(){
+  fb.clear();
+  _width = 0;
+  _height = 0;
+  created = false;
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y){
+  if (created && parent){
+    parent->simPushNative(x, y, _width, _height, fb.data());
+  }
+}
+
+bool TFT_eSprite::pushSprite(int32_t tx, int32_t ty, int32_t sx, int32_t sy, int32_t sw, int32_t sh){
+  if (!created || !parent || !clip(sx, sy, sw, sh)){
+    return false;
+  }
+  std::vector<uint16_t> region((size_t)sw * sh);
+  for (int32_t j = 0; j < sh; j++){
+    memcpy(&region[(size_t)j * sw], &fb[(size_t)(sy + j) * _width + sx], sw * sizeof(uint16_t));
+  }
+  parent->simPushNative(tx, ty, sw, sh, region.data());
+  return true;
+}
@@ -0,0 +1,165 @@
+/*
+
+Host stand-in for TFT_eSPI
+
+Draws into an in-memory 240x320 RGB565 framebuffer and counts what would have gone over SPI
+Each primitive is split into address windows the same way the real library issues them,
+so pixel/ byte/ window counts and the charged SPI time track the hardware closely
+Only GLCD font 1 is available, other fonts fall back to it
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Arduino.h"
+
+#define TFT_WIDTH 240
+#define TFT_HEIGHT 320
+
+// Colors (RGB565)
+#define TFT_BLACK 0x0000
+#define TFT_NAVY 0x000F
+#define TFT_DARKGREEN 0x03E0
+#define TFT_MAROON 0x7800
+#define TFT_PURPLE 0x780F
+#define TFT_OLIVE 0x7BE0
+#define TFT_LIGHTGREY 0xD69A
+#define TFT_DARKGREY 0x7BEF
+#define TFT_BLUE 0x001F
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_RED 0xF800
+#define TFT_MAGENTA 0xF81F
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+#define TFT_ORANGE 0xFDA0
+#define TFT_BROWN 0x9A60
+
+// Text datums
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+// What the panel has been sent since boot (monotonic, the simulator diffs it per frame)
+struct SimTftStats {
+  uint64_t pixels;
+  uint64_t bytes;
+  uint64_t windows;
+};
+
+extern SimTftStats sim_tft_stats;
+
+class TFT_eSPI {
+public:
+  TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT);
+  virtual ~TFT_eSPI() {}
+
+  void init();
+  void begin() { init(); }
+  void setRotation(uint8_t r) { rotation = r; }
+  uint8_t getRotation() const { return rotation; }
+  void setSwapBytes(bool swap) { swap_bytes = swap; }
+  bool getSwapBytes() const { return swap_bytes; }
+  int16_t width() const { return _width; }
+  int16_t height() const { return _height; }
+
+  // Transactions are free on the host, endWrite still waits for DMA like the ESP32 library does
+  void startWrite() {}
+  void endWrite() { dmaWait(); }
+
+  // Primitives
+  void fillScreen(uint32_t color);
+  void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+  void drawPixel(int32_t x, int32_t y, uint32_t color);
+  void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color);
+  void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color);
+  void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color);
+  void drawCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color);
+  void fillCircle(int32_t x0, int32_t y0, int32_t r, uint32_t color);
+
+  // Images, data is in panel byte order unless swap bytes is set (same as the real library)
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data);
+  void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data) { pushImage(x, y, w, h, (const uint16_t *)data); }
+  void readRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data);
+
+  // DMA, one transfer in flight at a time. With a buffer the image is copied into it first, and the
+  // copy overlaps whatever transfer is still running (same order as the ESP32 implementation)
+  bool initDMA(bool ctrl_cs = false) { dma_enabled = true; return true; }
+  void deInitDMA() { dmaWait(); dma_enabled = false; }
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t *buffer = nullptr);
+  bool dmaBusy();
+  void dmaWait();
+
+  // Text (GLCD font 1, 6x8 cell scaled by text size)
+  void setTextColor(uint16_t fg) { text_fg = fg; text_bg = fg; }
+  void setTextColor(uint16_t fg, uint16_t bg, bool fill = false) { text_fg = fg; text_bg = bg; }
+  void setTextDatum(uint8_t d) { text_datum = d; }
+  uint8_t getTextDatum() const { return text_datum; }
+  void setTextSize(uint8_t s) { text_size = s > 0 ? s : 1; }
+  void setTextFont(uint8_t f) {}
+  void setTextWrap(bool wrap_x, bool wrap_y = false) {}
+  int16_t textWidth(const char *s) const;
+  int16_t textWidth(const String &s) const { return textWidth(s.c_str()); }
+  int16_t fontHeight() const { return 8 * text_size; }
+  int16_t drawString(const char *s, int32_t x, int32_t y);
+  int16_t drawString(const String &s, int32_t x, int32_t y) { return drawString(s.c_str(), x, y); }
+  int16_t drawNumber(long n, int32_t x, int32_t y);
+  int16_t drawFloat(float f, uint8_t dp, int32_t x, int32_t y);
+
+  uint16_t color565(uint8_t r, uint8_t g, uint8_t b) const { return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3); }
+
+  // Simulator access to the panel contents (native RGB565)
+  const uint16_t *framebuffer() const { return fb.data(); }
+  uint16_t pixelAt(int32_t x, int32_t y) const { return fb[y * _width + x]; }
+  static TFT_eSPI *simPanel();
+  void simPushNative(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data);   // Sprite pushes, no byte swap
+
+protected:
+  bool clip(int32_t &x, int32_t &y, int32_t &w, int32_t &h) const;
+  void fillWindow(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color);   // One address window, clipped
+  void drawChar(char c, int32_t x, int32_t y);
+  virtual void countWindow(uint64_t pixels);
+  void busIdle() { if (dma_pending) dmaWait(); }   // Blocking writes share the bus with DMA
+  void dmaComplete();
+
+  int16_t _width, _height;
+  std::vector<uint16_t> fb;
+  uint8_t rotation;
+  bool swap_bytes;
+  uint16_t text_fg, text_bg;
+  uint8_t text_datum, text_size;
+
+  // Transfer in flight, pixels land on the panel when it completes
+  bool dma_enabled = false;
+  bool dma_pending = false;
+  uint64_t dma_done_ns = 0;
+  int32_t dma_x = 0, dma_y = 0, dma_w = 0, dma_h = 0;
+  const uint16_t *dma_data = nullptr;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+public:
+  explicit TFT_eSprite(TFT_eSPI *parent) : TFT_eSPI(0, 0), parent(parent), created(false) {}
+
+  void *createSprite(int16_t w, int16_t h, uint8_t frames = 1);
+  void deleteSprite();
+  void setColorDepth(int8_t bits) {}       // Only 16 bit sprites are simulated
+  void fillSprite(uint32_t color) { fillRect(0, 0, _width, _height, color); }
+  uint16_t *getPointer() { return fb.data(); }
+  void pushSprite(int32_t x, int32_t y);
+  bool pushSprite(int32_t tx, int32_t ty, int32_t sx, int32_t sy, int32_t sw, int32_t sh);   // Push a region of the sprite
+
+protected:
+  void countWindow(uint64_t pixels) override {}   // Sprites live in RAM, nothing goes over SPI until pushed
+
+  TFT_eSPI *parent;
+  bool created;
+};
@@ -0,0 +1,59 @@
+#include "WiFi.h"
+#include "../sim.h"
+
+
+WiFiClass WiFi;
+
+static const char *nearby_ssids[] = {"BerryNet", "Neighbour-5G", "CoffeeShop", "PrinterDirect", "Guest"};
+static const int32_t nearby_rssi[] = {-48, -61, -70, -77, -84};
+static const int num_nearby = sizeof(nearby_ssids) / sizeof(nearby_ssids[0]);
+
+String IPAddress::toString() const{
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+  return String(buf);
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *password){
+  this->ssid = ssid;
+  connected = true;
+  return WL_CONNECTED;
+}
+
+wl_status_t WiFiClass::status(){
+  return connected ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifioff){
+  connected = false;
+  return true;
+}
+
+String WiFiClass::SSID() const{
+  return connected ? ssid : String();
+}
+
+String WiFiClass::SSID(uint8_t i) const{
+  return i < num_nearby ? String(nearby_ssids[i]) : String();
+}
+
+int32_t WiFiClass::RSSI() const{
+  return connected ? -52 : 0;
+}
+
+int32_t WiFiClass::RSSI(uint8_t i) const{
+  return i < num_nearby ? nearby_rssi[i] : 0;
+}
+
+IPAddress WiFiClass::localIP() const{
+  return connected ? IPAddress(192, 168, 1, 42) : IPAddress();
+}
+
+String WiFiClass::macAddress() const{
+  return String("24:6F:28:AA:BB:CC");
+}
+
+int16_t WiFiClass::scanNetworks(){
+  simBlockNs(300000000ULL);                 // Active scan over all channels, the radio does the work
+  return num_nearby;
+}
@@ -0,0 +1,47 @@
+/*
+
+Host stand-in for the ESP32 WiFi library
+
+Always associated with the configured network, scans return a fixed set of neighbours
+
+*/
+
+#pragma once
+#include "Arduino.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+  String toString() const;
+
+private:
+  uint8_t octets[4];
+};
+
+class WiFiClass {
+public:
+  wl_status_t begin(const char *ssid, const char *password = NULL);
+  wl_status_t status();
+  bool disconnect(bool wifioff = false);
+  String SSID() const;
+  String SSID(uint8_t i) const;
+  int32_t RSSI() const;
+  int32_t RSSI(uint8_t i) const;
+  IPAddress localIP() const;
+  String macAddress() const;
+  int16_t scanNetworks();
+
+private:
+  String ssid;
+  bool connected = false;
+};
+
+extern WiFiClass WiFi;
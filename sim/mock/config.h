@@ -0,0 +1,8 @@
+/*
+
+Board local configuration lives in config.h next to the firmware sources on the device
+The simulator has nothing to configure
+
+*/
+
+#pragma once
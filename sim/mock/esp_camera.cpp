@@ -0,0 +1,170 @@
+#include "esp_camera.h"
+#include <vector>
+#include "../sim.h"
+
+
+#define SIM_FB_TIMEOUT_NS 4000000000ULL    // Driver gives up on a frame after 4 s
+
+struct SimFrameSlot {
+  camera_fb_t fb;
+  std::vector<uint8_t> data;
+  bool in_use;
+};
+
+SimCameraStats sim_camera_stats = {};
+
+static std::vector<SimFrameSlot> slots;
+static bool initialized = false;
+static uint64_t last_frame_ns = 0;
+static uint32_t frame_count = 0;
+static uint32_t noise_state = 0x12345678;
+
+static void frameDims(framesize_t size, size_t *w, size_t *h){
+  static const uint16_t dims[][2] = {
+    {96, 96}, {160, 120}, {176, 144}, {240, 176}, {240, 240}, {320, 240}, {400, 296},
+    {480, 320}, {640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1280, 1024}, {1600, 1200}
+  };
+  int i = (size < FRAMESIZE_INVALID) ? size : FRAMESIZE_240X240;
+  *w = dims[i][0];
+  *h = dims[i][1];
+}
+
+static void renderScene(camera_fb_t *fb){
+  // Gradient background, a block bouncing across it and +-1 LSB of noise per channel
+  const int w = fb->width, h = fb->height;
+  const int block = w / 6;
+  const int span_x = w - block, span_y = h - block;
+  int bx = (frame_count * 3) % (2 * span_x);
+  int by = (frame_count * 2) % (2 * span_y);
+  bx = bx < span_x ? bx : 2 * span_x - bx;
+  by = by < span_y ? by : 2 * span_y - by;
+
+  uint8_t *p = fb->buf;
+  for (int y = 0; y < h; y++){
+    for (int x = 0; x < w; x++){
+      noise_state ^= noise_state << 13;
+      noise_state ^= noise_state >> 17;
+      noise_state ^= noise_state << 5;
+      int n = (int)(noise_state & 3) - 1;
+
+      int r, g, b;
+      if (x >= bx && x < bx + block && y >= by && y < by + block){
+        r = 4; g = 56; b = 6;
+      } else{
+        r = x * 31 / w;
+        g = 20 + (x + y) * 20 / (w + h);
+        b = y * 31 / h;
+      }
+      r = std::min(31, std::max(0, r + n));
+      g = std::min(63, std::max(0, g + n));
+      b = std::min(31, std::max(0, b + n));
+
+      uint16_t c = (r << 11) | (g << 5) | b;
+      *p++ = c >> 8;                          // Sensor outputs MSB first
+      *p++ = c & 0xFF;
+    }
+  }
+}
+
+esp_err_t esp_camera_init(const camera_config_t *config){
+  if (initialized){
+    return ESP_FAIL;
+  }
+  size_t w, h;
+  frameDims(config->frame_size, &w, &h);
+
+  slots.assign(config->fb_count, SimFrameSlot());
+  for (auto &s : slots){
+    s.data.assign(w * h * 2, 0);
+    s.fb.buf = s.data.data();
+    s.fb.len = s.data.size();
+    s.fb.width = w;
+    s.fb.height = h;
+    s.fb.format = config->pixel_format;
+    s.in_use = false;
+  }
+  initialized = true;
+  sim_camera_stats.pool_bytes = config->fb_count * w * h * 2;
+  simConsumeNs(250000000ULL);                 // Sensor probe and register setup over SCCB
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit(){
+  slots.clear();
+  sim_camera_stats.pool_bytes = 0;
+  initialized = false;
+  return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get(){
+  if (!initialized){
+    return NULL;
+  }
+
+  // Wait for a free buffer, the driver cannot capture into a buffer the app is still holding
+  const uint64_t deadline = simNowNs() + SIM_FB_TIMEOUT_NS;
+  SimFrameSlot *slot = NULL;
+  for (;;){
+    if (!initialized){
+      return NULL;
+    }
+    for (auto &s : slots){
+      if (!s.in_use){
+        slot = &s;
+        break;
+      }
+    }
+    if (slot || simNowNs() >= deadline){
+      break;
+    }
+    simBlockNs(1000000ULL);
+  }
+  if (!slot){
+    Serial.println("Failed to get the frame on time!");
+    sim_camera_stats.timeouts++;
+    return NULL;
+  }
+
+  // Frames come off the sensor on a fixed cadence
+  uint64_t next = (simNowNs() / SIM_SENSOR_FRAME_NS + 1) * SIM_SENSOR_FRAME_NS;
+  if (next < last_frame_ns + SIM_SENSOR_FRAME_NS){
+    next = last_frame_ns + SIM_SENSOR_FRAME_NS;
+  }
+  simBlockNs(next - simNowNs());
+  if (!initialized){
+    return NULL;
+  }
+  last_frame_ns = next;
+  frame_count++;
+
+  slot->in_use = true;
+  sim_camera_stats.frames++;
+  uint32_t held = 0;
+  for (auto &s : slots){
+    held += s.in_use;
+  }
+  sim_camera_stats.max_held = std::max(sim_camera_stats.max_held, held);
+  slot->fb.timestamp.tv_sec = next / 1000000000ULL;
+  slot->fb.timestamp.tv_usec = (next / 1000ULL) % 1000000ULL;
+  renderScene(&slot->fb);
+  return &slot->fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb){
+  for (auto &s : slots){
+    if (&s.fb == fb){
+      if (!s.in_use){
+        sim_camera_stats.bad_returns++;
+      }
+      s.in_use = false;
+      return;
+    }
+  }
+  sim_camera_stats.bad_returns++;
+}
+
+void esp_camera_return_all(){
+  for (auto &s : slots){
+    s.in_use = false;
+  }
+}
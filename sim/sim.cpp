@@ -0,0 +1,549 @@
+#include "sim.h"
+#include <ucontext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "mock/freertos/FreeRTOS.h"
+#include "mock/TFT_eSPI.h"
+#include "mock/esp_camera.h"
+
+
+#define SIM_TASK_STACK (256 * 1024)      // Host code is hungrier than the ESP32 build, stack depth arguments are ignored
+#define SIM_FRAME_TASK "displayTask"     // Each vTaskDelay of this task closes one frame
+
+// ============================= Scheduler state =============================
+struct tskTaskControlBlock {
+  std::string name;
+  TaskFunction_t fn;
+  void *param;
+  UBaseType_t priority;
+  uint32_t stack_depth;
+  ucontext_t ctx;
+  void *stack;
+  uint64_t wake_ns;
+  uint64_t last_run;
+  bool suspended;
+  bool deleted;
+};
+
+static std::vector<tskTaskControlBlock *> tasks;
+static tskTaskControlBlock *current = NULL;
+static ucontext_t sched_ctx;
+static uint64_t clock_ns = 0;
+static uint64_t dispatch_seq = 0;
+static bool quit_flag = false;
+static int exit_code = 0;
+
+// ============================= Script state =============================
+struct SimPress {
+  uint64_t start_ns;
+  uint64_t end_ns;
+  int adc;
+};
+
+struct SimEvent {
+  uint64_t t_ns;
+  bool quit;
+  std::string shot;
+};
+
+static std::vector<SimPress> presses;
+static std::deque<SimEvent> events;
+
+// ============================= Frame stats =============================
+struct SimFrame {
+  uint64_t t_ns;
+  uint64_t pixels;
+  uint64_t bytes;
+  uint64_t windows;
+  uint64_t host_ns;
+};
+
+static std::vector<SimFrame> frames;
+static SimTftStats frame_start_stats = {};
+static uint64_t frame_host_ns = 0;
+static std::string out_dir = "sim_out";
+
+// ============================= Virtual clock =============================
+uint64_t simNowNs(){
+  return clock_ns;
+}
+
+uint64_t simNowUs(){
+  return clock_ns / 1000;
+}
+
+void simConsumeNs(uint64_t ns){
+  clock_ns += ns;
+}
+
+static void yieldToScheduler(){
+  tskTaskControlBlock *self = current;
+  swapcontext(&self->ctx, &sched_ctx);
+}
+
+void simBlockNs(uint64_t ns){
+  if (!current){
+    clock_ns += ns;
+    return;
+  }
+  current->wake_ns = clock_ns + ns;
+  yieldToScheduler();
+}
+
+bool simInTask(){
+  return current != NULL;
+}
+
+const char *simCurrentTaskName(){
+  return current ? current->name.c_str() : "setup";
+}
+
+// ============================= Frames =============================
+static void closeFrame(){
+  SimFrame f;
+  f.t_ns = clock_ns;
+  f.pixels = sim_tft_stats.pixels - frame_start_stats.pixels;
+  f.bytes = sim_tft_stats.bytes - frame_start_stats.bytes;
+  f.windows = sim_tft_stats.windows - frame_start_stats.windows;
+  f.host_ns = frame_host_ns;
+  frames.push_back(f);
+  frame_start_stats = sim_tft_stats;
+  frame_host_ns = 0;
+}
+
+void simSetOutputDir(const std::string &dir){
+  out_dir = dir;
+}
+
+const std::string &simOutputDir(){
+  return out_dir;
+}
+
+void simScreenshot(const std::string &name){
+  TFT_eSPI *panel = TFT_eSPI::simPanel();
+  if (!panel){
+    return;
+  }
+  panel->dmaBusy();                               // Land a transfer that has finished by now
+  std::string path = out_dir + "/" + name + ".ppm";
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (!fp){
+    fprintf(stderr, "sim: cannot write %s\n", path.c_str());
+    return;
+  }
+  const int w = panel->width(), h = panel->height();
+  fprintf(fp, "P6\n%d %d\n255\n", w, h);
+  std::vector<uint8_t> rgb((size_t)w * h * 3);
+  const uint16_t *px = panel->framebuffer();
+  for (size_t i = 0; i < (size_t)w * h; i++){
+    uint16_t c = px[i];
+    rgb[i * 3 + 0] = ((c >> 11) & 0x1F) * 255 / 31;
+    rgb[i * 3 + 1] = ((c >> 5) & 0x3F) * 255 / 63;
+    rgb[i * 3 + 2] = (c & 0x1F) * 255 / 31;
+  }
+  fwrite(rgb.data(), 1, rgb.size(), fp);
+  fclose(fp);
+}
+
+static uint64_t percentile(std::vector<uint64_t> v, double p){
+  if (v.empty()){
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5))];
+}
+
+static uint64_t meanBytes(){
+  uint64_t total = 0;
+  for (const SimFrame &f : frames){
+    total += f.bytes;
+  }
+  return frames.empty() ? 0 : total / frames.size();
+}
+
+void simPrintSummary(){
+  std::string csv = out_dir + "/frames.csv";
+  FILE *fp = fopen(csv.c_str(), "w");
+  if (fp){
+    fprintf(fp, "frame,t_ms,pixels,bytes,windows,spi_us,host_us\n");
+  }
+
+  std::vector<uint64_t> bytes, host;
+  uint64_t total_bytes = 0, total_host = 0;
+  for (size_t i = 0; i < frames.size(); i++){
+    const SimFrame &f = frames[i];
+    uint64_t spi_ns = f.windows * SIM_SPI_WINDOW_NS + f.pixels * 16ULL * 1000000000ULL / SIM_SPI_HZ;
+    if (fp){
+      fprintf(fp, "%zu,%.3f,%llu,%llu,%llu,%.1f,%.1f\n", i, f.t_ns / 1e6, (unsigned long long)f.pixels,
+              (unsigned long long)f.bytes, (unsigned long long)f.windows, spi_ns / 1e3, f.host_ns / 1e3);
+    }
+    bytes.push_back(f.bytes);
+    host.push_back(f.host_ns);
+    total_bytes += f.bytes;
+    total_host += f.host_ns;
+  }
+  if (fp){
+    fclose(fp);
+  }
+
+  const size_t n = frames.size();
+  printf("simulated   %.3f s\n", clock_ns / 1e9);
+  printf("frames      %zu\n", n);
+  printf("spi bytes   total %llu  mean %llu  p50 %llu  p99 %llu  max %llu\n",
+         (unsigned long long)total_bytes, (unsigned long long)meanBytes(),
+         (unsigned long long)percentile(bytes, 0.5), (unsigned long long)percentile(bytes, 0.99),
+         (unsigned long long)percentile(bytes, 1.0));
+  printf("host us     mean %.1f  p99 %.1f\n", n ? total_host / 1e3 / n : 0.0, percentile(host, 0.99) / 1e3);
+  if (sim_camera_stats.frames){
+    printf("camera      frames %llu  timeouts %llu  bad returns %llu  max held %u\n",
+           (unsigned long long)sim_camera_stats.frames, (unsigned long long)sim_camera_stats.timeouts,
+           (unsigned long long)sim_camera_stats.bad_returns, sim_camera_stats.max_held);
+  }
+}
+
+bool simCheckBudget(uint64_t max_mean_bytes){
+  uint64_t mean = meanBytes();
+  if (mean > max_mean_bytes){
+    printf("FAIL: mean %llu bytes per frame exceeds budget of %llu\n",
+           (unsigned long long)mean, (unsigned long long)max_mean_bytes);
+    return false;
+  }
+  return true;
+}
+
+// ============================= Script =============================
+bool simLoadScript(const std::string &path){
+  // One command per line: <ms> press <UP|DOWN|SELECT|BACK> [hold_ms] | <ms> shot <name> | <ms> quit
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp){
+    return false;
+  }
+  char line[256];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), fp)){
+    line_no++;
+    char *hash = strchr(line, '#');
+    if (hash){
+      *hash = '\0';
+    }
+    unsigned long long ms = 0, hold = 100;
+    char cmd[32] = {0}, arg[128] = {0};
+    int n = sscanf(line, "%llu %31s %127s %llu", &ms, cmd, arg, &hold);
+    if (n <= 0){
+      continue;
+    }
+    uint64_t t = ms * 1000000ULL;
+
+    if (!strcmp(cmd, "press") && n >= 3){
+      // Typical ladder readings, roughly 120 counts under the theoretical maxima in globals.h
+      int adc = !strcmp(arg, "UP") ? 895 : !strcmp(arg, "DOWN") ? 1928 :
+                !strcmp(arg, "SELECT") ? 3021 : !strcmp(arg, "BACK") ? 4095 : -1;
+      if (adc < 0){
+        fprintf(stderr, "sim: %s:%d unknown button %s\n", path.c_str(), line_no, arg);
+        fclose(fp);
+        return false;
+      }
+      presses.push_back({t, t + hold * 1000000ULL, adc});
+    } else if (!strcmp(cmd, "shot") && n >= 3){
+      events.push_back({t, false, arg});
+    } else if (!strcmp(cmd, "quit")){
+      events.push_back({t, true, ""});
+    } else{
+      fprintf(stderr, "sim: %s:%d cannot parse \"%s\"\n", path.c_str(), line_no, cmd);
+      fclose(fp);
+      return false;
+    }
+  }
+  fclose(fp);
+  std::stable_sort(events.begin(), events.end(), [](const SimEvent &a, const SimEvent &b){ return a.t_ns < b.t_ns; });
+  return true;
+}
+
+int simButtonAdc(){
+  for (const SimPress &p : presses){
+    if (clock_ns >= p.start_ns && clock_ns < p.end_ns){
+      return p.adc;
+    }
+  }
+  return 0;                               // Pull down resistor
+}
+
+// ============================= Scheduler =============================
+static void taskEntry(){
+  current->fn(current->param);
+  current->deleted = true;                // Returning from a task is an error on FreeRTOS, treat it as a delete
+  yieldToScheduler();
+}
+
+static void processEvents(){
+  while (!events.empty() && events.front().t_ns <= clock_ns){
+    SimEvent e = events.front();
+    events.pop_front();
+    if (e.quit){
+      quit_flag = true;
+    } else{
+      simScreenshot(e.shot);
+    }
+  }
+}
+
+void simRun(uint64_t end_ns){
+  while (!quit_flag){
+    // Free the stacks of deleted tasks (never the one we just switched away from mid-delete)
+    for (tskTaskControlBlock *t : tasks){
+      if (t->deleted && t->stack){
+        free(t->stack);
+        t->stack = NULL;
+      }
+    }
+
+    tskTaskControlBlock *next = NULL;
+    for (tskTaskControlBlock *t : tasks){
+      if (t->deleted || t->suspended){
+        continue;
+      }
+      if (!next || t->wake_ns < next->wake_ns ||
+          (t->wake_ns == next->wake_ns && (t->priority > next->priority ||
+          (t->priority == next->priority && t->last_run < next->last_run)))){
+        next = t;
+      }
+    }
+    if (!next){
+      break;
+    }
+
+    uint64_t t = std::max(clock_ns, next->wake_ns);
+    while (!events.empty() && events.front().t_ns <= std::min(t, end_ns) && !quit_flag){
+      clock_ns = std::max(clock_ns, events.front().t_ns);
+      processEvents();
+    }
+    if (quit_flag){
+      break;
+    }
+    if (t >= end_ns){
+      clock_ns = end_ns;
+      break;
+    }
+    clock_ns = t;
+
+    next->last_run = ++dispatch_seq;
+    current = next;
+    auto start = std::chrono::steady_clock::now();
+    swapcontext(&sched_ctx, &next->ctx);
+    if (next->name == SIM_FRAME_TASK){
+      frame_host_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    current = NULL;
+  }
+}
+
+void simQuit(int code){
+  exit_code = code;
+  quit_flag = true;
+  if (current){
+    current->wake_ns = UINT64_MAX;
+    yieldToScheduler();
+  }
+}
+
+int simExitCode(){
+  return exit_code;
+}
+
+// ============================= FreeRTOS tasks =============================
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id){
+  tskTaskControlBlock *t = new tskTaskControlBlock();
+  t->name = name;
+  t->fn = fn;
+  t->param = param;
+  t->priority = priority;
+  t->stack_depth = stack_depth;
+  t->stack = malloc(SIM_TASK_STACK);
+  t->wake_ns = clock_ns;
+  t->last_run = 0;
+  t->suspended = false;
+  t->deleted = false;
+
+  getcontext(&t->ctx);
+  t->ctx.uc_stack.ss_sp = t->stack;
+  t->ctx.uc_stack.ss_size = SIM_TASK_STACK;
+  t->ctx.uc_link = NULL;
+  makecontext(&t->ctx, taskEntry, 0);
+
+  tasks.push_back(t);
+  if (handle){
+    *handle = t;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle){
+  return xTaskCreatePinnedToCore(fn, name, stack_depth, param, priority, handle, 1);
+}
+
+void vTaskDelete(TaskHandle_t task){
+  if (!task || task == current){
+    if (current){
+      current->deleted = true;
+      yieldToScheduler();                 // Never returns
+    }
+    return;
+  }
+  task->deleted = true;
+}
+
+void vTaskDelay(TickType_t ticks){
+  if (!current){
+    clock_ns += (uint64_t)ticks * 1000000ULL;
+    return;
+  }
+  if (current->name == SIM_FRAME_TASK){
+    closeFrame();
+  }
+  simBlockNs((uint64_t)ticks * 1000000ULL);
+}
+
+void vTaskSuspend(TaskHandle_t task){
+  if (!task){
+    task = current;
+  }
+  if (!task){
+    return;                               // Called from setup() before the scheduler runs
+  }
+  task->suspended = true;
+  if (task == current){
+    yieldToScheduler();
+  }
+}
+
+void vTaskResume(TaskHandle_t task){
+  if (task && task->suspended){
+    task->suspended = false;
+    task->wake_ns = std::max(task->wake_ns, clock_ns);
+  }
+}
+
+TickType_t xTaskGetTickCount(){
+  return (TickType_t)(clock_ns / 1000000ULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(){
+  return current;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task){
+  if (!task){
+    task = current;
+  }
+  return task ? task->stack_depth : 0;
+}
+
+// ============================= FreeRTOS queues =============================
+struct QueueDefinition {
+  UBaseType_t length;
+  UBaseType_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+// Polls cond once per tick until it holds or the wait runs out, other tasks run in between
+template <typename Cond>
+static bool waitFor(Cond cond, TickType_t ticks){
+  if (cond()){
+    return true;
+  }
+  if (ticks == 0 || !current){
+    return false;
+  }
+  uint64_t deadline = (ticks == portMAX_DELAY) ? UINT64_MAX : clock_ns + (uint64_t)ticks * 1000000ULL;
+  while (clock_ns < deadline){
+    simBlockNs(1000000ULL);
+    if (cond()){
+      return true;
+    }
+  }
+  return false;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size){
+  QueueDefinition *q = new QueueDefinition();
+  q->length = length;
+  q->item_size = item_size;
+  return q;
+}
+
+void vQueueDelete(QueueHandle_t queue){
+  delete queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait){
+  if (!waitFor([&]{ return queue->items.size() < queue->length; }, ticks_to_wait)){
+    return errQUEUE_FULL;
+  }
+  const uint8_t *p = (const uint8_t *)item;
+  queue->items.emplace_back(p, p + queue->item_size);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait){
+  return xQueueSend(queue, item, ticks_to_wait);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item){
+  queue->items.clear();
+  const uint8_t *p = (const uint8_t *)item;
+  queue->items.emplace_back(p, p + queue->item_size);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait){
+  if (!waitFor([&]{ return !queue->items.empty(); }, ticks_to_wait)){
+    return pdFALSE;
+  }
+  memcpy(buffer, queue->items.front().data(), queue->item_size);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait){
+  if (!waitFor([&]{ return !queue->items.empty(); }, ticks_to_wait)){
+    return pdFALSE;
+  }
+  memcpy(buffer, queue->items.front().data(), queue->item_size);
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue){
+  return queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue){
+  return queue->length - queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue){
+  queue->items.clear();
+  return pdPASS;
+}
+
+// ============================= FreeRTOS semaphores =============================
+SemaphoreHandle_t xSemaphoreCreateMutex(){
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  xSemaphoreGive(mutex);
+  return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait){
+  return xQueueReceive(semaphore, NULL, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore){
+  return xQueueSend(semaphore, NULL, 0);
+}
@@ -0,0 +1,59 @@
+/*
+
+Host simulator core
+
+Virtual clock, cooperative scheduler, cost model hooks for the mocks, scripted input and frame statistics
+Everything is deterministic: the same script always produces the same frames, stats and screenshots
+
+*/
+
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// ============================= Cost model =============================
+// Rough timings of the real hardware, charged to whichever task does the work
+#define SIM_SPI_HZ 40000000ULL            // TFT SPI clock (TFT_eSPI SPI_FREQUENCY)
+#define SIM_SPI_WINDOW_NS 3000ULL         // CASET/ RASET/ RAMWR + DC toggling per address window
+#define SIM_SD_BYTES_PER_SEC 2000000ULL   // SD_MMC in 1-bit mode
+#define SIM_SD_OP_NS 1000000ULL           // Per open/ close/ remove/ directory step
+#define SIM_SD_READ_NS 150000ULL          // Per read/ write call (command + sector latency)
+#define SIM_SD_SECTOR_BYTES 512ULL        // Writes from buffers the SDMMC DMA can't reach go out one sector per command
+#define SIM_PSRAM_BYTES_PER_SEC 40000000ULL  // memcpy out of PSRAM over the 40 MHz QSPI bus
+#define SIM_SENSOR_FRAME_NS 40000000ULL   // OV2640 240x240 RGB565 at 20 MHz XCLK (~25 fps)
+
+// ============================= Virtual clock =============================
+uint64_t simNowNs();
+
+uint64_t simNowUs();
+
+void simConsumeNs(uint64_t ns);         // Current context is busy (CPU or SPI bound), nothing else runs
+
+void simBlockNs(uint64_t ns);           // Current task waits (semaphore, DMA done), other tasks may run
+
+bool simInTask();
+
+const char *simCurrentTaskName();
+
+// ============================= Scheduler =============================
+void simRun(uint64_t end_ns);           // Dispatch tasks until end_ns or a quit
+
+void simQuit(int code);
+
+int simExitCode();
+
+// ============================= Script =============================
+bool simLoadScript(const std::string &path);
+
+int simButtonAdc();                     // ADC reading of the resistor ladder at the current time
+
+// ============================= Frames =============================
+void simSetOutputDir(const std::string &dir);
+
+const std::string &simOutputDir();
+
+void simScreenshot(const std::string &name);
+
+void simPrintSummary();
+
+bool simCheckBudget(uint64_t max_mean_bytes);
@@ -0,0 +1,73 @@
+/*
+
+MiniBerryOS host simulator
+
+Runs setup() and every FreeRTOS task from the firmware sources against the mocks in sim/mock,
+drives the buttons from a script and reports what each display frame cost on the SPI bus
+
+Usage: miniberry_sim [--script file] [--duration ms] [--out dir] [--sd dir] [--budget-bytes n]
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include "sim.h"
+#include "mock/FS.h"
+
+void setup();   // main.cpp
+
+static void usage(){
+  fprintf(stderr, "usage: miniberry_sim [--script file] [--duration ms] [--out dir] [--sd dir] [--budget-bytes n]\n");
+}
+
+int main(int argc, char **argv){
+  std::string script, out_dir = "sim_out", sd_dir = "sim_sd";
+  uint64_t duration_ms = 60000;
+  uint64_t budget = 0;
+
+  for (int i = 1; i < argc; i++){
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (!val){
+      usage();
+      return 2;
+    }
+    if (!strcmp(arg, "--script")){
+      script = val;
+    } else if (!strcmp(arg, "--duration")){
+      duration_ms = strtoull(val, NULL, 10);
+    } else if (!strcmp(arg, "--out")){
+      out_dir = val;
+    } else if (!strcmp(arg, "--sd")){
+      sd_dir = val;
+    } else if (!strcmp(arg, "--budget-bytes")){
+      budget = strtoull(val, NULL, 10);
+    } else{
+      usage();
+      return 2;
+    }
+    i++;
+  }
+
+  mkdir(out_dir.c_str(), 0755);
+  simSetOutputDir(out_dir);
+  simSetSdRoot(sd_dir);
+
+  if (!script.empty() && !simLoadScript(script)){
+    fprintf(stderr, "sim: cannot load script %s\n", script.c_str());
+    return 2;
+  }
+
+  setup();
+  simRun(duration_ms * 1000000ULL);
+  simScreenshot("final");
+  simPrintSummary();
+
+  if (budget && !simCheckBudget(budget)){
+    return 1;
+  }
+  return simExitCode();
+}
@@ -6,6 +6,20 @@
 #include "display.h"
 #include "helpers.h"
 #include "button_handlers.h"
+#include "compositor.h"
+#include "timeseries.h"
+#include "frame_handle.h"
+#include "image_codec.h"
+#include "file_index.h"
+#include "name_table.h"
+#include "sd_writer.h"
+#include "frame_ring.h"
+#include "image_filters.h"
+#include "motion_detect.h"
+#include "night_capture.h"
+#include "thumbnail.h"
+#include "viewer_cache.h"
+#include "sd_bench.h"
 
 
 void buttonTask(void* parameter){
@@ -38,33 +52,135 @@ void buttonTask(void* parameter){
   }
 }
 
+static bool switchCamera(const camera_config_t *config){
+  // Restarts the driver with a new pool, every fb must be back first. Holds the ring lock so the camera app
+  // closing never deletes the capture task halfway through
+
+  lockFrameRing();
+  esp_camera_deinit();
+  resetFrameHandles();
+  const esp_err_t err = esp_camera_init(config);
+  unlockFrameRing();
+  if (err != ESP_OK){
+    Serial.printf("Camera could not switch modes due to error 0x%x\n", err);
+  }
+  return err == ESP_OK;
+}
+
+static void captureStill(){
+  // Takes one frame at STILL_FRAME_SIZE into the frame ring. The preview pool is freed while the sensor is in
+  // the still mode, so a still costs no PSRAM while previewing. The preview is flashing meanwhile anyway
+
+  const uint32_t start_ms = millis();
+  drainFrames(frame_display_queue);
+  while (framesInFlight() && millis() - start_ms < 4 * CAPTURE_WAIT_MS){     // The display lets go once its DMA is done
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  if (framesInFlight()){
+    Serial.println("Preview frames still held, still not taken");
+    frame_ring_stats.dropped++;
+    return;
+  }
+
+  camera_config_t still_config = camera_config;
+  still_config.frame_size = STILL_FRAME_SIZE;
+  still_config.fb_count = 1;
+  if (switchCamera(&still_config)){
+    camera_fb_t *fb = NULL;
+    for (int i = 0; i <= STILL_SKIP_FRAMES; i++){
+      if (fb){
+        esp_camera_fb_return(fb);
+      }
+      fb = esp_camera_fb_get();
+    }
+    still_switch_ms = millis() - start_ms;
+    if (fb){
+      struct tm now = t;
+      pushRingStill(fb, mktime(&now));
+      esp_camera_fb_return(fb);
+    } else{
+      frame_ring_stats.dropped++;
+    }
+  } else{
+    frame_ring_stats.dropped++;
+  }
+
+  const uint32_t back_start_ms = millis();
+  switchCamera(&camera_config);
+  still_back_ms = millis() - back_start_ms;
+  Serial.printf("Still %dx%d in %lu ms, preview back after %lu ms\n", STILL_WIDTH, STILL_HEIGHT,
+                (unsigned long)still_switch_ms, (unsigned long)still_back_ms);
+}
+
 void frameCaptureTask(void* parameter){
   // Task that gets frame from the camera
   // Then sends frame to camera queue for display
-  // Sends to save queue if save flag is true
+  // Copies frames that are due (burst, timelapse, motion) into the frame ring for saveFrameToSDTask, single photos
+  // switch the sensor to the still mode for one frame (captureStill), night photos sum frames until they're done
+  // The display queue gets its own reference to the buffer, the driver gets it back when the last one is released
+  // Paced by the display: the next frame is only grabbed once the last one was taken out of the queue, so
+  // none is captured just to be replaced. Frames the ring wants are grabbed at sensor rate regardless
 
   for (;;){
 
-    camera_fb_t *fb = esp_camera_fb_get();            // Get frame buffer from camera
+    while (uxQueueMessagesWaiting(frame_display_queue) && !ringFramePending() && !nightCapturePending()){
+      uint8_t taken;
+      xQueueReceive(frame_taken_queue, &taken, pdMS_TO_TICKS(CAPTURE_WAIT_MS));
+    }
+
+    if (ringStillDue()){
+      captureStill();
+      continue;
+    }
+
+    camera_fb_t *fb = esp_camera_fb_get();            // Blocks until the sensor delivers the next frame
 
     //transposeImageInPlace(fb);                       
 
-    if (fb) {
-      // Send to display queue (always keep latest)
-      xQueueSend(frame_display_queue, &fb, 0);      // Dont block if queue is full (check what happens if you do xQueueOverwrite)
+    FrameHandle *frame = fb ? wrapFrame(fb) : NULL;
+
+    if (frame) {
+      // Motion starts its save with this frame, the one that showed it
+      if (capture_mode == CAPTURE_MOTION && detectMotion(frame->fb)){
+        requestRingFrames(MOTION_SAVE_FRAMES);
+        Serial.printf("Motion detected: %.1f%% of the preview changed, saving %d frames\n", motion_stats.changed_percent, MOTION_SAVE_FRAMES);
+      }
+
+      // Copy into the frame ring if a photo is due, never waits, a full ring drops the frame and counts it
+      if (ringFrameDue()){
+        struct tm now = t;
+        pushRingFrame(frame->fb, mktime(&now));
+      }
+
+      // Night photos average the unfiltered frames too, named after the first one
+      if (nightCapturePending()){
+        struct tm now = t;
+        if (accumulateNightFrame(frame->fb, mktime(&now))){
+          Serial.printf("Night photo of %d frames in %lu ms, shifted up to %d px, %lu us per frame\n", NIGHT_FRAMES,
+                        (unsigned long)night_stats.last_ms, night_stats.max_shift, (unsigned long)night_stats.cost_us);
+        }
+      }
+
+      // Filter in place once the ring has its unfiltered copy, nobody else holds the frame yet
+      applyFilterChain(camera_filter, (uint16_t *)frame->fb->buf, frame->fb->width, frame->fb->height);
 
-      // Send to save queue (only if flag is true)
-      if (save_next_frame){
-        xQueueSend(frame_save_queue, &fb, 0); // Non-blocking, skip if full
+      // Send to display queue (always keep latest, a frame the display didn't get to yet is released and counted)
+      if (uxQueueMessagesWaiting(frame_display_queue)){
+        preview_dropped++;
       }
+      sendFrame(frame_display_queue, frame, true);
+
+      releaseFrame(frame);                          // Drop our own reference, consumers hold theirs
+    }
+    else if (fb) {
+      Serial.println("No frame handle left!");
+      esp_camera_fb_return(fb);
     }
     else {
       Serial.println("Could not get frame!");   
     }
 
     //Serial.printf("frameCaptureTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));        
-
-    vTaskDelay(pdMS_TO_TICKS(33));                 // Cap frame captures at 30HZ
   }
 }
 
@@ -78,17 +194,10 @@ void systemDataTask(void *parameter) {
     info.cpu_freq = getCpuFrequencyMhz();
     info.uptime = millis() / 1000; // uptime in seconds
 
-    // Log Heap usage in kB
-    int used = (ESP.getHeapSize() - ESP.getFreeHeap()) / 1000;
-    if (used > max_heap){
-      max_heap = used;
-    }
-
-    if (heap_usage.size() > NUM_SYS_DATA_POINTS){
-      heap_usage.pop();                               // Remove oldest element
-    } else{
-      heap_usage.push(used);
-    }
+    // Log memory usage in kB, this task is the only producer of the system series
+    pushSeries(&sys_series[SERIES_HEAP], (ESP.getHeapSize() - ESP.getFreeHeap()) / 1000);
+    pushSeries(&sys_series[SERIES_PSRAM], (ESP.getPsramSize() - ESP.getFreePsram()) / 1000);
+    pushSeries(&sys_series[SERIES_LARGEST_BLOCK], ESP.getMaxAllocHeap() / 1000);
     
     // Send system info
     xQueueOverwrite(sys_info_queue, &info);
@@ -146,24 +255,46 @@ void ntpTimeTask(void *parameter){
 }
 
 void saveFrameToSDTask(void* parameter) { 
-  // Saves the frame buffer in frame_save_queue once it gets it
-  // If no frame was requested to be saved, queue would be empty
+  // Saves the frames frameCaptureTask puts in the frame ring, oldest first
+  // If no frame was requested to be saved, the ring would be empty
   // SD writes are time consuming, so it is important this happens independent of display task
+  // Frames are packed into an SD writer buffer (see image_codec.h) and sdWriterTask writes them behind us
+  // Runs for as long as the device is on, so a burst still drains after the camera app is closed
+
+  static uint32_t last_timestamp = 0;     // Frames within the same second get a _NN suffix instead of overwriting
+  static int repeat = 0;
     
   for (;;) {
 
-    camera_fb_t *fb;
+    RingFrame *frame = takeRingFrame(portMAX_DELAY);          // Nothing else to do until a frame comes
+
+    if (frame) {
 
-    if (xQueueReceive(frame_save_queue, &fb, 0)) {  
+      repeat = frame->timestamp == last_timestamp ? repeat + 1 : 0;
+      last_timestamp = frame->timestamp;
 
-      char f[32] = {0};
-      sprintf(f, "/%04d-%02d-%02d_%02d-%02d-%02d.raw",      // Save as .raw for raw RGB565 pixel values (easy to work with and display in file viewer)
-              t.tm_year + 1900,                          // Format filename as current date and time
-              t.tm_mon + 1,
-              t.tm_mday,
-              t.tm_hour,
-              t.tm_min,
-              t.tm_sec);
+      time_t timestamp = frame->timestamp;
+      struct tm taken;
+      localtime_r(&timestamp, &taken);
+
+      char f[MAX_FILENAME_LENGTH] = {0};
+      for (;;){
+        int len = snprintf(f, sizeof(f), "/%04d-%02d-%02d/%02d-%02d-%02d",    // Day directory, then capture time (see file_index.h)
+                          taken.tm_year + 1900,
+                          taken.tm_mon + 1,
+                          taken.tm_mday,
+                          taken.tm_hour,
+                          taken.tm_min,
+                          taken.tm_sec);
+        if (repeat){
+          len += snprintf(f + len, sizeof(f) - len, "_%02d", repeat);
+        }
+        snprintf(f + len, sizeof(f) - len, IMAGE_FILE_EXT);       // Lossless RGB565 with a header, the file viewer decodes it row by row
+        if (!isIndexedFile(f)){                 // A clock that isn't synced yet repeats names across boots
+          break;
+        }
+        repeat++;
+      }
 
       // This conversion causes a lot of issues. 
       // Using char arrays works, but converting to string or displaying string gives junk names
@@ -172,53 +303,152 @@ void saveFrameToSDTask(void* parameter) {
       //Serial.println(String(f));              worked
       //Serial.printf("Photo saved as filename: %s", filename);   shows junk
 
-      fs::File file = SD_MMC.open(f, FILE_WRITE);        // Create file in SD
+      // Only waits while both earlier saves (or the last still) are still being written, the ring holds the frame
+      const size_t file_cap = imageMaxFileSize(frame->width, frame->height) + THUMB_FILE_BYTES;
+      const bool still = file_cap > SD_WRITE_SLOT_BYTES;
+      uint8_t *buffer = still ? acquireStillSdBuffer(file_cap, portMAX_DELAY) : acquireSdBuffer(portMAX_DELAY);
+      const size_t buffer_cap = still ? file_cap : SD_WRITE_SLOT_BYTES;
+      const size_t image_len = buffer ? encodeImage(frame->pixels, frame->width, frame->height, frame->timestamp, buffer, buffer_cap - THUMB_FILE_BYTES) : 0;
+      const size_t thumb_len = image_len ? encodeThumbnail(frame->pixels, frame->width, frame->height, frame->timestamp, buffer + image_len, THUMB_FILE_BYTES) : 0;
 
-      if (file){
-        file.write(fb->buf, fb->len);                           // Write buffer to file
-        file.close();
+      if (image_len){
+        submitSdWrite(f, buffer, image_len, thumb_len, frame->captured_ms);   // Works with f, not with String(filename)
+      } else{
+        Serial.println("failed to pack frame for saving!");
+        if (buffer){
+          releaseSdBuffer(buffer);
+        }
+      }
+      releaseRingFrame(frame);                                // Submitted first, so the frame is always counted as pending
+    }
 
-        Serial.printf("Photo saved as filename: %s", f);        // Works with f, not with String(filename)
+    //Serial.printf("saveFrameToSDTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
+  }
+}
 
-        save_next_frame = false;
+void sdWriterTask(void* parameter){
+  // Writes the files saveFrameToSDTask submits, in order, and adds them to the file list
+  // Runs for as long as the device is on, so a write is never cut off by an app closing
 
+  for (;;){
+    SdWriteJob job;
+
+    if (waitSdWrite(&job)){
+      bool ok = writeStagedFile(&job);
+      if (ok){
+        lockIndexWrites();
+        ok = addIndexedFile(job.path);
+        unlockIndexWrites();
+      }
+      if (ok){
+        Serial.printf("Photo saved as filename: %s (%u bytes, %lu ms after capture, %.2f MB/s sustained)\n",
+                      job.path, (unsigned)job.len, (unsigned long)sd_writer_stats.last_latency_ms, sdWriteMBps());
+      } else{
+        Serial.printf("failed to write %s!\n", job.path);
+      }
+    }
+
+    //Serial.printf("sdWriterTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
+  }
+}
+
+void thumbnailTask(void* parameter){
+  // Writes sidecars the gallery found missing, one photo decode each
+  // Lowest priority, so backfilling a whole card never gets in the way of the display or a save
+
+  for (;;){
+    char filename[MAX_FILENAME_LENGTH];
 
+    if (waitThumbnailRequest(filename)){
+      if (backfillThumbnail(filename)){
+        Serial.printf("Thumbnail ready for %s\n", filename);
       } else{
-        Serial.println("failed to open file for writing!");
+        Serial.printf("Failed to make a thumbnail for %s\n", filename);
       }
-      esp_camera_fb_return(fb);                               // Return fb
     }
 
-    //Serial.printf("saveFrameToSDTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
+    //Serial.printf("thumbnailTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
+  }
+}
+
+void prefetchTask(void* parameter){
+  // Decodes the viewer's neighbours into the viewer cache whenever it names new ones
+  // Targets that change mid decode are dropped rather than finished
+
+  for (;;){
+    char first[MAX_FILENAME_LENGTH], second[MAX_FILENAME_LENGTH];
+
+    if (waitPrefetchTargets(first, second)){
+      prefetchImage(first);
+      prefetchImage(second);
+    }
 
-    vTaskDelay(pdMS_TO_TICKS(200));                         // Release cpu for other tasks and cap save rate at 5 times a second
+    //Serial.printf("prefetchTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
   }
 }
 
 void deleteFromSDTask(void* parameter){
   // Task that deletes files recieved from the queue when they arrive.
   // SD reads, writes and deletes are time consuming, so it is important this happens independent of display task
+  // A batch from the gallery arrives all at once: the queue is drained with the files removed back to back,
+  // and the index file on the card and the file list on screen are brought up to date once at the end
+  // The thumbnail goes first: cut off before the photo, the gallery only backfills a new one, the other way
+  // round a sidecar would be left behind for a photo that's gone
   for (;;){
     char filename[MAX_FILENAME_LENGTH];
 
-    if (xQueueReceive(file_delete_queue, &filename, 0)){
-
-      //Serial.println(filenames[file_index]);
-      Serial.println(filename);         // Now that we are sending char arrays and NOT STRINGS, it works
-
-      if (SD_MMC.remove(filename)){
-        Serial.printf("Successfully deleted file: %s\n", filename);
-        loadFileNames();        // Reload file names and counts after deleting file
+    if (!xQueueReceive(file_delete_queue, &filename, portMAX_DELAY)){
+      continue;
+    }
+    const uint32_t start = millis();
+    int deleted = 0, failed = 0;
+
+    do {
+      lockIndexWrites();                    // Leaving the SD app deletes this task, never halfway through a file
+      removeThumbnail(filename);
+      const bool removed = removeIndexedFile(filename);   // Drops it from filenames, no rescan
+      if (removed){
+        forgetCachedImage(filename);
+      }
+      unlockIndexWrites();
+      if (removed){
+        deleted++;
       }
       else{
         Serial.printf("Failed to delete file: %s\n", filename);
+        failed++;
       }
-    }
+      deletes_done++;                       // Progress for the gallery bar
+    } while (xQueueReceive(file_delete_queue, &filename, 0));
+
+    lockIndexWrites();
+    flushIndexRemovals(true);               // One append to the index on the card for the whole batch, or the rewrite it was due
+    unlockIndexWrites();
+    Serial.printf("Deleted %i files in %lu ms (%i failed)\n", deleted, (unsigned long)(millis() - start), failed);
+    prev_file_index = -1;                   // Redraw the file list without them
 
     //Serial.printf("deleteFromSDTask high watermark: %u\n", uxTaskGetStackHighWaterMark(NULL));  
+  }
+}
 
-    vTaskDelay(pdMS_TO_TICKS(100));                // Free cpu for other tasks (frame saves happen relatively slowly anyways)
+void sdBenchTask(void* parameter){
+  // Runs every step of the SD benchmark once, appends the results to the card and deletes itself
+  // Lowest priority, the display picks up each result as sd_bench_steps_done moves on
+  const uint32_t start = millis();
+
+  if (beginSdBench()){
+    for (int step = 0; step < SD_BENCH_STEPS; step++){
+      runSdBenchStep(step, &sd_bench_results[step]);
+      sd_bench_steps_done = step + 1;
+    }
+    endSdBench();
+    struct tm now = t;
+    saveSdBenchResults(sd_bench_results, SD_BENCH_STEPS, mktime(&now));
   }
+  Serial.printf("SD benchmark finished in %lu ms\n", (unsigned long)(millis() - start));
+
+  sdBenchTask_handle = NULL;
+  vTaskDelete(NULL);
 }
 
 void displayTask(void* parameter){
@@ -240,7 +470,7 @@ void displayTask(void* parameter){
       case MENU:                    // Display Menu Items
         
         if (!menu_init){            // Draw menu once, update highlight each time to increase performance
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
           drawMenu(main_menu, sizeof(main_menu) / sizeof(MenuItem));
           menu_init = true;
           
@@ -253,10 +483,17 @@ void displayTask(void* parameter){
       case CAMERA_FEED:             // Display camera feed with options
         
         if (!camera_init){    // Init camera once when entering camera feed
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
+          const uint32_t free_psram = ESP.getFreePsram();
           esp_err_t err = esp_camera_init(&camera_config);
           if (err != ESP_OK){
             Serial.printf("Camera could not initialize due to error 0x%x\n", err);
+          } else{
+            // A pool that could take stills as well would need CAMERA_FB_COUNT buffers at the still size
+            preview_pool_kb = (free_psram - ESP.getFreePsram()) / 1024;
+            const uint32_t still_pool_kb = CAMERA_FB_COUNT * STILL_WIDTH * STILL_HEIGHT * 2 / 1024;
+            Serial.printf("Preview pool: %lu kB of PSRAM, %lu kB less than a pool at %dx%d\n", (unsigned long)preview_pool_kb,
+                          (unsigned long)(still_pool_kb - preview_pool_kb), STILL_WIDTH, STILL_HEIGHT);
           }
           xTaskCreatePinnedToCore(
             frameCaptureTask,             // Task function
@@ -267,29 +504,27 @@ void displayTask(void* parameter){
             &frameCaptureTask_handle,     // Task handle
             1                             // Core ID
           );
-          xTaskCreatePinnedToCore(
-            saveFrameToSDTask,            // Task function
-            "saveFrameToSDTask",          // Task name
-            5000,                         // Stack size (bytes)
-            NULL,                         // Task parameters
-            1,                            // Priority
-            &saveFrameToSDTask_handle,    // Task handle
-            1                             // Core ID
-          );
           camera_init = true;
-          save_next_frame = false;
-          drawCameraButton();                         // Draw once at start to prevent flicker
+          frame_ring_stats = {};                      // Counts shown are for this session, pending ones are global
+          preview_dropped = 0;
+          still_switch_ms = 0;
+          drawCameraButton(true);                     // Draw once at start to prevent flicker
+          detachContent();                            // Frames are pushed straight to the tft
         }
         drawStatusBar();
         drawCameraFeed();                             // Draws frames to screen as they come, with option to save to SD (might add more DSP options)
+        drawCameraButton(false);                      // Only when the mode or a count changed
         handleButtonCamera();     
                            
         break;
 
       case SD_CARD:           // Display file viewer, or image in file 
 
-        if (!menu_init){      // Load filenames once when entering SD Card viewer (also loads after file gets deleted in delete task)
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+        if (!menu_init){      // filenames is already current, the save and delete tasks keep it in step with the card
+          clearContent(TFT_BLACK);
+          gallery_marking = false;
+          clearNames(&marked_files);
+          deletes_done = deletes_queued - uxQueueMessagesWaiting(file_delete_queue);    // A delete cut off by leaving the app isn't pending
           xTaskCreatePinnedToCore(
             deleteFromSDTask,             // Task function
             "deleteFromSDTask",           // Task name
@@ -299,13 +534,18 @@ void displayTask(void* parameter){
             &deleteFromSDTask_handle,     // Task handle
             1                             // Core ID
           );
-          loadFileNames();
-          printFileNames();
+          lockFileIndex();
+          day_index = max(numDays() - 1, 0);        // Opens on the day list at the newest day, SELECT shows its thumbnails
+          unlockFileIndex();
+          gallery_view = false;
           menu_init = true;
         }
 
         drawStatusBar();
-        if (!image_view){     // Draws file selector with filenames
+        if (!image_view && gallery_view){   // Thumbnail grid from the sidecars
+          drawGallery();
+        }
+        else if (!image_view){     // Draws the days with their photo counts
           drawFiles();
         }
         else{                 
@@ -315,21 +555,34 @@ void displayTask(void* parameter){
 
         break;
 
+      case SD_BENCH:                // SD card throughput and latency, runs in sdBenchTask on SELECT
+
+        if (!menu_init){
+          clearContent(TFT_BLACK);
+          drawSdBench();
+          menu_init = true;
+        }
+        drawStatusBar();
+        updateSdBench();
+        handleButtonSdBench();
+        break;
+
       case SYSTEM_DATA:             // Display system data like heap, psram, cpu usage (Will update to show data in a graph over total runtime)
 
-        if(!menu_init){
-          tft.fillRect(0, STATUS_BAR_HEIGHT, SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+        if(!menu_init){             // Draw title and graph once, then only what changed each second
+          clearContent(TFT_BLACK);
+          drawSystemData();
           menu_init = true;
         }
         drawStatusBar();
-        drawSystemData();
-        handleButtonSimple();
+        updateSystemData();
+        handleButtonSystemData();
         break;
 
         case WIFI:                  // Display WIFI connectivity info and other nearby wifi signals
 
         if(!menu_init){
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
           menu_init = true;
         }
         drawStatusBar();
@@ -341,7 +594,7 @@ void displayTask(void* parameter){
       case GAMES:                   // Display menu for all avaliable games
         
         if (!menu_init){            // Draw menu once, update highlight each time to increase performance
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
           drawMenu(games_menu, sizeof(games_menu) / sizeof(MenuItem));
           menu_init = true;
           
@@ -360,7 +613,8 @@ void displayTask(void* parameter){
         static TFT_eSprite bricks[NUM_BRICKS] = {TFT_eSprite(&tft), TFT_eSprite(&tft), TFT_eSprite(&tft),TFT_eSprite(&tft),TFT_eSprite(&tft),TFT_eSprite(&tft),TFT_eSprite(&tft),TFT_eSprite(&tft)};
 
         if(!menu_init){
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
+          detachContent();                          // Sprites are pushed straight to the tft
           initGame1(&paddle, &ball, bricks);
           menu_init = true;
         }
@@ -375,7 +629,8 @@ void displayTask(void* parameter){
       case GAME2:                               // Game 2
 
         if(!menu_init){
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
+          detachContent();
           menu_init = true;
         }
         drawStatusBar();
@@ -386,7 +641,8 @@ void displayTask(void* parameter){
       case GAME3:                               // Game 3
 
         if(!menu_init){
-          tft.fillRect(0,STATUS_BAR_HEIGHT,SCREEN_WIDTH, SCREEN_HEIGHT - STATUS_BAR_HEIGHT, TFT_BLACK);
+          clearContent(TFT_BLACK);
+          detachContent();
           menu_init = true;
         }
 
@@ -400,11 +656,25 @@ void displayTask(void* parameter){
         break;
     }
 
+    pushDirtyRects();             // Send whatever changed this frame to the display
+
     // Calculate frame rate for top status bar
     frames++;   // Increment frames after drawing
     if (now - before >= 1000){    // Calculate fps every second
       fps = frames / 1000.f * (now - before);
+      preview_fps = preview_frames * 1000.f / (now - before);
+      preview_latency_ms = preview_latency_frames ? preview_latency_us / 1000.f / preview_latency_frames : 0;
+      updateFilterCosts();
+#ifdef CAMERA_DEBUG_LOG
+      if (display_state == CAMERA_FEED){
+        Serial.printf("Preview fps: %.1f\tFrames in flight: %d/%d (max %d)\tLatency: %.1f ms\tDropped: %lu\tFilter: %.1f ms\n", preview_fps, framesInFlight(),
+                      CAMERA_FB_COUNT, maxFramesInFlight(), preview_latency_ms, (unsigned long)preview_dropped, filter_stage_ms[0] + filter_stage_ms[1]);
+      }
+#endif
       frames = 0;
+      preview_frames = 0;
+      preview_latency_us = 0;
+      preview_latency_frames = 0;
       before = now;
     }
 
@@ -14,8 +14,16 @@ void systemDataTask(void* parameter);
 
 void saveFrameToSDTask(void* parameter);
 
+void sdWriterTask(void* parameter);
+
+void thumbnailTask(void* parameter);
+
+void prefetchTask(void* parameter);
+
 void deleteFromSDTask(void* parameter);
 
+void sdBenchTask(void* parameter);
+
 void wifiDataTask(void *parameter);
 
 void ntpTimeTask(void *parameter);
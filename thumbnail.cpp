@@ -0,0 +1,184 @@
+#include <new>
+#include <SD_MMC.h>
+#include "thumbnail.h"
+#include "helpers.h"
+
+
+static QueueHandle_t thumb_queue = NULL;            // char[MAX_FILENAME_LENGTH] names waiting for a sidecar
+static volatile uint32_t backfilled = 0;
+
+// Scratch buffers in PSRAM, internal RAM is kept for the DMA strips and the SD staging buffer
+static SemaphoreHandle_t thumb_mutex = NULL;        // Guards thumb, the save and backfill tasks share it
+static uint8_t *thumb = NULL;                       // Scaled thumbnail pixels
+static uint8_t *file_bytes = NULL;                  // Backfilled sidecar on its way to the card
+static uint16_t *backfill_row = NULL;               // One decoded row of the photo being backfilled
+static ImageReader *backfill_reader = NULL;
+
+void initThumbnails(){
+  thumb_queue = xQueueCreate(THUMB_QUEUE_SIZE, MAX_FILENAME_LENGTH * sizeof(char));
+  thumb_mutex = xSemaphoreCreateMutex();
+  thumb = (uint8_t *)ps_malloc(THUMB_SIZE * THUMB_SIZE * 2);
+  file_bytes = (uint8_t *)ps_malloc(THUMB_FILE_BYTES);
+  backfill_row = (uint16_t *)ps_malloc(STILL_WIDTH * sizeof(uint16_t));
+  void *reader = ps_malloc(sizeof(ImageReader));
+  backfill_reader = reader ? new (reader) ImageReader() : NULL;    // Holds a File, so it's constructed in place
+  if (!thumb_queue || !thumb_mutex || !thumb || !file_bytes || !backfill_row || !backfill_reader){
+    Serial.println("Thumbnail buffer allocation failed!");
+    while(1) {}
+  }
+  if (!SD_MMC.exists(THUMB_DIR) && !SD_MMC.mkdir(THUMB_DIR)){
+    Serial.println("Failed to create thumbnail directory");     // Not fatal, the gallery shows placeholders
+  }
+  Serial.println("Thumbnails initialized");
+}
+
+void thumbPath(const char *name, char *path){
+  snprintf(path, THUMB_PATH_LENGTH, "%s%s", THUMB_DIR, name);
+}
+
+// ============================= Scaler =============================
+void initThumbScaler(ThumbScaler *scaler, int width, int height, uint8_t *out){
+  memset(scaler, 0, sizeof(ThumbScaler));
+  scaler->src_width = width;
+  scaler->src_height = height;
+  scaler->out = out;
+}
+
+void addThumbRow(ThumbScaler *scaler, const uint8_t *row){
+  // Sums the row into its band, and once the band is complete writes out its thumbnail row
+  const int w = scaler->src_width, h = scaler->src_height;
+
+  for (int x = 0; x < w; x++){
+    const uint16_t px = (row[2 * x] << 8) | row[2 * x + 1];
+    const int tx = x * THUMB_SIZE / w;
+    scaler->sums[0][tx] += px >> 11;
+    scaler->sums[1][tx] += (px >> 5) & 0x3F;
+    scaler->sums[2][tx] += px & 0x1F;
+  }
+
+  const int y = scaler->src_row++;
+  const int ty = y * THUMB_SIZE / h;
+  if (y + 1 < h && (y + 1) * THUMB_SIZE / h == ty){
+    return;                                         // More rows of this band to come
+  }
+
+  const int band_rows = y + 1 - (ty * h + THUMB_SIZE - 1) / THUMB_SIZE;    // First row of the band is the smallest with y * T / h == ty
+  uint8_t *out = scaler->out + ty * THUMB_SIZE * 2;
+  for (int tx = 0; tx < THUMB_SIZE; tx++){
+    const int band_cols = ((tx + 1) * w + THUMB_SIZE - 1) / THUMB_SIZE - (tx * w + THUMB_SIZE - 1) / THUMB_SIZE;
+    const uint32_t n = max(band_rows * band_cols, 1);
+    const uint16_t px = ((scaler->sums[0][tx] / n) << 11) | ((scaler->sums[1][tx] / n) << 5) | (scaler->sums[2][tx] / n);
+    out[2 * tx] = px >> 8;
+    out[2 * tx + 1] = px & 0xFF;
+    scaler->sums[0][tx] = scaler->sums[1][tx] = scaler->sums[2][tx] = 0;
+  }
+}
+
+size_t encodeThumbnail(const uint8_t *pixels, int width, int height, uint32_t timestamp, uint8_t *out, size_t out_cap){
+  // saveFrameToSDTask only, the scaled pixels go through the shared thumb buffer
+  ThumbScaler scaler;
+
+  if (width < THUMB_SIZE || height < THUMB_SIZE){
+    return 0;
+  }
+  xSemaphoreTake(thumb_mutex, portMAX_DELAY);
+  initThumbScaler(&scaler, width, height, thumb);
+  for (int y = 0; y < height; y++){
+    addThumbRow(&scaler, pixels + (size_t)y * width * 2);
+  }
+  const size_t len = encodeImage(thumb, THUMB_SIZE, THUMB_SIZE, timestamp, out, out_cap);
+  xSemaphoreGive(thumb_mutex);
+  return len;
+}
+
+// ============================= Sidecars =============================
+bool openThumbnail(ImageReader *reader, const char *name){
+  char path[THUMB_PATH_LENGTH];
+  thumbPath(name, path);
+
+  if (!isFileCached(path) && !SD_MMC.exists(path)){
+    return false;                                   // openImage() would take a missing .raw for a legacy frame
+  }
+  if (!openImage(reader, path)){
+    return false;
+  }
+  if (reader->header.width != THUMB_SIZE || reader->header.height != THUMB_SIZE){
+    closeImage(reader);
+    return false;
+  }
+  return true;
+}
+
+void requestThumbnail(const char *name){
+  char request[MAX_FILENAME_LENGTH] = {0};
+  strncpy(request, name, MAX_FILENAME_LENGTH - 1);
+  xQueueSend(thumb_queue, &request, 0);
+}
+
+bool waitThumbnailRequest(char *name){
+  return xQueueReceive(thumb_queue, name, portMAX_DELAY) == pdTRUE;
+}
+
+bool backfillThumbnail(const char *name){
+  // thumbnailTask only. Decodes the photo row by row into the scaler, the full frame is never held
+  // A save waits for the decode to finish with thumb, the mutex lends it this task's priority meanwhile
+  ImageReader &reader = *backfill_reader;
+  char path[THUMB_PATH_LENGTH];
+  thumbPath(name, path);
+  if (SD_MMC.exists(path)){
+    return true;                                    // Asked for twice, or saved since it was asked for
+  }
+
+  if (!openImage(&reader, name)){
+    return false;
+  }
+  const int w = reader.header.width, h = reader.header.height;
+  bool ok = w <= STILL_WIDTH && w >= THUMB_SIZE && h >= THUMB_SIZE;
+
+  ThumbScaler scaler;
+  xSemaphoreTake(thumb_mutex, portMAX_DELAY);
+  initThumbScaler(&scaler, w, h, thumb);
+  for (int y = 0; y < h && ok; y++){
+    ok = readImageRow(&reader, backfill_row);
+    if (ok){
+      addThumbRow(&scaler, (const uint8_t *)backfill_row);
+    }
+  }
+  closeImage(&reader);
+
+  const size_t len = ok ? encodeImage(thumb, THUMB_SIZE, THUMB_SIZE, reader.header.timestamp, file_bytes, THUMB_FILE_BYTES) : 0;
+  xSemaphoreGive(thumb_mutex);
+  if (!len){
+    return false;
+  }
+
+  fs::File file = makeParentDir(path) ? SD_MMC.open(path, FILE_WRITE) : fs::File();
+  ok = file && file.write(file_bytes, len) == len;
+  if (file){
+    file.close();
+  }
+  invalidateCachedFile(path);
+  if (!ok){
+    SD_MMC.remove(path);                            // A short sidecar would be read as a broken thumbnail
+    return false;
+  }
+  backfilled++;
+  return true;
+}
+
+void removeThumbnail(const char *name){
+  char path[THUMB_PATH_LENGTH];
+  thumbPath(name, path);
+  SD_MMC.remove(path);
+  invalidateCachedFile(path);
+
+  char *slash = strrchr(path, '/');
+  if (slash - path > (int)sizeof(THUMB_DIR) - 1){   // In a day directory, which goes with its last thumbnail
+    *slash = '\0';
+    SD_MMC.rmdir(path);                             // Fails and leaves it while it isn't empty
+  }
+}
+
+uint32_t thumbnailsBackfilled(){
+  return backfilled;
+}
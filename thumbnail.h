@@ -0,0 +1,54 @@
+/*
+
+Thumbnail sidecars for the SD gallery
+
+Every photo gets a THUMB_SIZE x THUMB_SIZE copy under THUMB_DIR with the same name, in the same .mbi format,
+so a gallery page reads sixteen small files instead of sixteen full frames. The save task makes the
+thumbnail from the frame it already has in memory and sdWriterTask writes it right after the photo
+
+Photos without a sidecar (from before thumbnails, or a write that failed) are backfilled on demand:
+the gallery queues the name and thumbnailTask, at the lowest priority, decodes the photo once and writes it.
+Thumbnails are a 4x4 box filter of the 240x240 frame, other sizes are averaged over the nearest blocks
+(a 640x480 still is squeezed into the square)
+
+*/
+
+#pragma once
+#include "globals.h"
+#include "image_codec.h"
+
+#define THUMB_SIZE 60                   // 4 across fill the screen width
+#define THUMB_DIR "/.thumbs"            // Hidden from the file list like the index
+#define THUMB_PATH_LENGTH (sizeof(THUMB_DIR) + MAX_FILENAME_LENGTH)
+#define THUMB_FILE_BYTES (IMAGE_HEADER_SIZE + THUMB_SIZE * THUMB_SIZE * 2)   // Most a thumbnail file can take
+#define THUMB_QUEUE_SIZE 16             // One gallery page of backfill requests
+
+struct ThumbScaler {
+  int src_width;
+  int src_height;
+  int src_row;                          // Source rows added so far
+  uint32_t sums[3][THUMB_SIZE];         // r, g, b of the band of source rows being averaged
+  uint8_t *out;                         // THUMB_SIZE * THUMB_SIZE pixels, MSB first like the frames
+};
+
+void initThumbnails();                                      // Creates THUMB_DIR and the backfill queue, after initSD()
+
+void thumbPath(const char *name, char *path);               // path holds THUMB_PATH_LENGTH
+
+void initThumbScaler(ThumbScaler *scaler, int width, int height, uint8_t *out);
+
+void addThumbRow(ThumbScaler *scaler, const uint8_t *row);  // Source rows in order, MSB first RGB565
+
+size_t encodeThumbnail(const uint8_t *pixels, int width, int height, uint32_t timestamp, uint8_t *out, size_t out_cap);   // Sidecar file into out, 0 if it doesn't fit
+
+bool openThumbnail(ImageReader *reader, const char *name);  // false if the sidecar is missing or not a thumbnail
+
+void requestThumbnail(const char *name);                    // Queue a backfill, dropped if the queue is full
+
+bool waitThumbnailRequest(char *name);                      // thumbnailTask only, blocks for the next name
+
+bool backfillThumbnail(const char *name);                   // Decode the photo and write its sidecar
+
+void removeThumbnail(const char *name);
+
+uint32_t thumbnailsBackfilled();                            // Changes whenever a backfill finished, so the gallery knows to retry
@@ -0,0 +1,134 @@
+#include "timeseries.h"
+
+
+TimeSeries sys_series[NUM_SERIES];
+
+static void initSeries(TimeSeries *series, const char *name, const char *unit){
+  series->name = name;
+  series->unit = unit;
+  series->min_front = series->min_back = 0;
+  series->max_front = series->max_back = 0;
+  series->min.store(0, std::memory_order_relaxed);
+  series->max.store(0, std::memory_order_relaxed);
+  series->range_seq.store(0, std::memory_order_relaxed);
+  series->head.store(0, std::memory_order_release);
+}
+
+void initTimeSeries(){
+  // Call before the producer task starts
+
+  initSeries(&sys_series[SERIES_HEAP], "Heap Usage", "kB");
+  initSeries(&sys_series[SERIES_PSRAM], "PSRAM Usage", "kB");
+  initSeries(&sys_series[SERIES_LARGEST_BLOCK], "Largest Free Block", "kB");
+  Serial.println("Time series initialized");
+}
+
+void pushSeries(TimeSeries *series, int value){
+  // Overwrites the oldest sample once the ring is full, nothing is ever dropped on the newest end
+
+  const uint32_t index = series->head.load(std::memory_order_relaxed);
+
+  // Min wedge: drop samples leaving the window from the front, and any larger ones from the back (they can't be the min anymore)
+  while (series->min_front != series->min_back && series->min_wedge[series->min_front % SERIES_CAPACITY].index + SERIES_CAPACITY <= index){
+    series->min_front++;
+  }
+  while (series->min_front != series->min_back && series->min_wedge[(series->min_back - 1) % SERIES_CAPACITY].value >= value){
+    series->min_back--;
+  }
+  series->min_wedge[series->min_back++ % SERIES_CAPACITY] = {index, value};
+
+  // Max wedge, mirrored
+  while (series->max_front != series->max_back && series->max_wedge[series->max_front % SERIES_CAPACITY].index + SERIES_CAPACITY <= index){
+    series->max_front++;
+  }
+  while (series->max_front != series->max_back && series->max_wedge[(series->max_back - 1) % SERIES_CAPACITY].value <= value){
+    series->max_back--;
+  }
+  series->max_wedge[series->max_back++ % SERIES_CAPACITY] = {index, value};
+
+  std::atomic_thread_fence(std::memory_order_release);   // head of the last push is out before its oldest slot is overwritten
+  series->samples[index % SERIES_CAPACITY] = value;
+
+  // min and max between two bumps of range_seq, a reader that sees it odd or changed reads again
+  const uint32_t seq = series->range_seq.load(std::memory_order_relaxed);
+  series->range_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  series->min.store(series->min_wedge[series->min_front % SERIES_CAPACITY].value, std::memory_order_relaxed);
+  series->max.store(series->max_wedge[series->max_front % SERIES_CAPACITY].value, std::memory_order_relaxed);
+  series->range_seq.store(seq + 2, std::memory_order_release);
+  series->head.store(index + 1, std::memory_order_release);       // Publish, the reader sees the sample from here on
+}
+
+void seriesMinMax(const TimeSeries *series, int *min, int *max){
+  uint32_t before, after;
+  do {
+    before = series->range_seq.load(std::memory_order_acquire);
+    *min = series->min.load(std::memory_order_relaxed);
+    *max = series->max.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = series->range_seq.load(std::memory_order_relaxed);
+  } while (before != after || before % 2);
+}
+
+int seriesMin(const TimeSeries *series){
+  int min, max;
+  seriesMinMax(series, &min, &max);
+  return min;
+}
+
+int seriesMax(const TimeSeries *series){
+  int min, max;
+  seriesMinMax(series, &min, &max);
+  return max;
+}
+
+int seriesLatest(const TimeSeries *series){
+  const uint32_t head = series->head.load(std::memory_order_acquire);
+  return head ? series->samples[(head - 1) % SERIES_CAPACITY] : 0;
+}
+
+TimeSeries *findSeries(const char *name){
+  for (int i = 0; i < NUM_SERIES; i++){
+    if (sys_series[i].name && !strcmp(sys_series[i].name, name)){
+      return &sys_series[i];
+    }
+  }
+  return NULL;
+}
+
+void getSeriesView(const TimeSeries *series, SeriesView *view){
+  // The oldest samples of a view can be overwritten if the producer pushes while it's being read,
+  // which is fine for drawing. readSeries() is the lossless way to follow a series
+
+  const uint32_t head = series->head.load(std::memory_order_acquire);
+  view->samples = series->samples;
+  view->count = min(head, (uint32_t)SERIES_CAPACITY);
+  view->start = head - view->count;
+}
+
+int seriesViewAt(const SeriesView *view, int i){
+  return view->samples[(view->start + i) % SERIES_CAPACITY];
+}
+
+bool readSeries(const TimeSeries *series, uint32_t *cursor, int *value){
+  // Consumer side, cursor is the next sample number to read. A reader that fell a whole ring behind skips to the
+  // oldest sample the next push won't overwrite, and head is checked again after the read, a slot the producer
+  // got to meanwhile is read again further on
+
+  for (;;){
+    const uint32_t head = series->head.load(std::memory_order_acquire);
+    if (*cursor == head){
+      return false;
+    }
+    if (head - *cursor >= SERIES_CAPACITY){
+      *cursor = head - SERIES_CAPACITY + 1;
+    }
+    *value = series->samples[*cursor % SERIES_CAPACITY];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (series->head.load(std::memory_order_relaxed) - *cursor < SERIES_CAPACITY){
+      break;                                                    // Sample cursor + SERIES_CAPACITY not started, the slot still held ours
+    }
+  }
+  (*cursor)++;
+  return true;
+}
@@ -0,0 +1,74 @@
+/*
+
+Fixed capacity time series
+
+One ring per series holding the last SERIES_CAPACITY samples, written by a single producer task and read by a
+single consumer task without locks. The producer publishes each sample by advancing head after writing it,
+so a reader that loads head first only sees complete samples. min and max are published together under a
+sequence count, a reader that overlaps a push reads them again, so both always come from the same push
+
+Running min and max over the window are kept with monotonic wedges (amortized O(1) per push, O(1) to read)
+
+*/
+
+#pragma once
+#include <atomic>
+#include "globals.h"
+
+#define SERIES_CAPACITY NUM_SYS_DATA_POINTS
+
+enum SeriesId {
+  SERIES_HEAP,                    // Heap in use (kB)
+  SERIES_PSRAM,                   // PSRAM in use (kB)
+  SERIES_LARGEST_BLOCK,           // Largest allocatable heap block (kB)
+  NUM_SERIES
+};
+
+struct WedgeEntry {
+  uint32_t index;                 // Sample number, drops out of the window once index + SERIES_CAPACITY <= head
+  int value;
+};
+
+struct TimeSeries {
+  const char *name;
+  const char *unit;
+  int samples[SERIES_CAPACITY];
+  std::atomic<uint32_t> head;     // Samples pushed since init, only the producer writes it
+  std::atomic<uint32_t> range_seq;   // Odd while the producer updates min and max
+  std::atomic<int> min;           // Over the samples still in the window
+  std::atomic<int> max;
+
+  // Producer only
+  WedgeEntry min_wedge[SERIES_CAPACITY];      // Increasing values, front is the window minimum
+  WedgeEntry max_wedge[SERIES_CAPACITY];      // Decreasing values, front is the window maximum
+  uint32_t min_front, min_back;
+  uint32_t max_front, max_back;
+};
+
+struct SeriesView {
+  const int *samples;             // Points into the ring, nothing is copied
+  uint32_t start;                 // Sample number of the oldest sample in the view
+  int count;
+};
+
+extern TimeSeries sys_series[NUM_SERIES];
+
+void initTimeSeries();                                          // Names and empties every system series
+
+void pushSeries(TimeSeries *series, int value);                 // Producer only
+
+void seriesMinMax(const TimeSeries *series, int *min, int *max); // Both from the same push, 0 while empty
+
+int seriesMin(const TimeSeries *series);
+
+int seriesMax(const TimeSeries *series);
+
+int seriesLatest(const TimeSeries *series);
+
+TimeSeries *findSeries(const char *name);                       // NULL if no series has that name
+
+void getSeriesView(const TimeSeries *series, SeriesView *view); // Oldest to newest snapshot of the window
+
+int seriesViewAt(const SeriesView *view, int i);                // i = 0 is the oldest sample
+
+bool readSeries(const TimeSeries *series, uint32_t *cursor, int *value);   // Next unread sample, false when caught up, never one from the next lap
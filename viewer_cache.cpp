@@ -0,0 +1,228 @@
+#include "viewer_cache.h"
+
+
+ViewerCacheStats viewer_cache_stats = {};
+
+static CachedImage slots[VIEWER_CACHE_SLOTS];
+static SemaphoreHandle_t cache_mutex = NULL;        // Guards the slot names, states and pins, not the pixels
+static QueueHandle_t targets_changed = NULL;        // One slot, overwritten, wakes prefetchTask
+static char targets[2][MAX_FILENAME_LENGTH];        // Neighbours of the photo on screen, "" for none
+static uint32_t use_clock = 0;
+
+void initViewerCache(){
+  cache_mutex = xSemaphoreCreateMutex();
+  targets_changed = xQueueCreate(1, sizeof(uint8_t));
+
+  bool ok = cache_mutex && targets_changed;
+  for (int i = 0; i < VIEWER_CACHE_SLOTS && ok; i++){
+    slots[i] = {};
+    slots[i].pixels = (uint16_t *)ps_malloc(IMAGE_WIDTH * IMAGE_HEIGHT * sizeof(uint16_t));
+    ok = slots[i].pixels != NULL;
+  }
+  if (!ok){
+    Serial.println("Failed to allocate viewer cache");
+    while(1) {}
+  }
+  Serial.println("Viewer cache initialized");
+}
+
+static CachedImage *matchSlot(const char *name){
+  for (int i = 0; i < VIEWER_CACHE_SLOTS; i++){
+    if (slots[i].state != CACHE_EMPTY && !strcmp(slots[i].name, name)){
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+static CachedImage *claimSlot(const char *name, bool pin){
+  // Call with the mutex held. An empty slot if there is one, else the least recently shown that is free to go
+  CachedImage *victim = NULL;
+  for (int i = 0; i < VIEWER_CACHE_SLOTS; i++){
+    CachedImage *s = &slots[i];
+    if (s->pinned || s->state == CACHE_LOADING){
+      continue;
+    }
+    if (!victim || s->state == CACHE_EMPTY || (victim->state != CACHE_EMPTY && s->last_used < victim->last_used)){
+      victim = s;
+    }
+    if (victim->state == CACHE_EMPTY){
+      break;
+    }
+  }
+  if (victim){
+    strncpy(victim->name, name, MAX_FILENAME_LENGTH - 1);
+    victim->name[MAX_FILENAME_LENGTH - 1] = '\0';
+    victim->width = 0;
+    victim->height = 0;
+    victim->shrink = 1;
+    victim->state = CACHE_LOADING;
+    victim->pinned = pin;
+    victim->last_used = ++use_clock;
+  }
+  return victim;
+}
+
+CachedImage *findCachedImage(const char *name){
+  bool waited = false;
+
+  for (;;){
+    xSemaphoreTake(cache_mutex, portMAX_DELAY);
+    CachedImage *slot = matchSlot(name);
+    const CachedImageState state = slot ? slot->state : CACHE_EMPTY;
+    if (state == CACHE_READY){
+      slot->pinned = true;
+      slot->last_used = ++use_clock;
+    }
+    xSemaphoreGive(cache_mutex);
+
+    if (state == CACHE_LOADING){                    // prefetchTask is on it, the rest of the file is quicker than all of it
+      waited = true;
+      vTaskDelay(pdMS_TO_TICKS(5));
+      continue;
+    }
+    if (state == CACHE_READY && !waited){
+      viewer_cache_stats.hits++;
+    } else{
+      viewer_cache_stats.misses++;
+    }
+    return state == CACHE_READY ? slot : NULL;
+  }
+}
+
+CachedImage *claimCachedImage(const char *name){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  CachedImage *slot = claimSlot(name, true);
+  xSemaphoreGive(cache_mutex);
+  return slot;
+}
+
+static int shrinkFactor(const ImageHeader *header){
+  return max((header->width + IMAGE_WIDTH - 1) / IMAGE_WIDTH, (header->height + IMAGE_HEIGHT - 1) / IMAGE_HEIGHT);
+}
+
+int cachedImageRows(const ImageHeader *header){
+  return min(header->height / shrinkFactor(header), IMAGE_HEIGHT);
+}
+
+static void shrinkRows(const uint16_t *src, int src_w, int factor, uint16_t *dst, int dst_w){
+  // Box average of factor x factor blocks into one row, pixels MSB first like the frames
+  const uint32_t n = factor * factor;
+  for (int x = 0; x < dst_w; x++){
+    uint32_t r = 0, g = 0, b = 0;
+    for (int y = 0; y < factor; y++){
+      const uint16_t *p = src + y * src_w + x * factor;
+      for (int i = 0; i < factor; i++){
+        const uint16_t px = (p[i] << 8) | (p[i] >> 8);
+        r += px >> 11;
+        g += (px >> 5) & 0x3F;
+        b += px & 0x1F;
+      }
+    }
+    const uint16_t px = ((r / n) << 11) | ((g / n) << 5) | (b / n);
+    dst[x] = (px << 8) | (px >> 8);
+  }
+}
+
+bool decodeCachedImage(CachedImage *slot, ImageReader *reader, int rows){
+  const int factor = shrinkFactor(&reader->header);
+  const int limit = cachedImageRows(&reader->header);
+  slot->width = reader->header.width / factor;
+  slot->shrink = factor;
+
+  if (factor == 1){
+    const int got = readImageRows(reader, slot->pixels + slot->height * slot->width, min(rows, limit - slot->height));
+    if (got < 0){
+      return false;
+    }
+    slot->height += got;
+    return true;
+  }
+
+  // Source rows are read into the end of the slot, past every shrunk row
+  uint16_t *src = slot->pixels + IMAGE_WIDTH * IMAGE_HEIGHT - factor * reader->header.width;
+  if (slot->pixels + slot->width * limit > src){
+    return false;
+  }
+  for (int i = 0; i < rows && slot->height < limit; i++){
+    if (readImageRows(reader, src, factor) != factor){
+      return false;
+    }
+    shrinkRows(src, reader->header.width, factor, slot->pixels + slot->height * slot->width, slot->width);
+    slot->height++;
+  }
+  return true;
+}
+
+void finishCachedImage(CachedImage *slot, bool ok){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  slot->state = ok && slot->name[0] ? CACHE_READY : CACHE_EMPTY;     // A name cleared by forgetCachedImage meanwhile stays dead
+  if (!ok){
+    slot->pinned = false;
+  }
+  xSemaphoreGive(cache_mutex);
+}
+
+void unpinCachedImage(CachedImage *slot){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  slot->pinned = false;
+  xSemaphoreGive(cache_mutex);
+}
+
+void forgetCachedImage(const char *name){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  CachedImage *slot = matchSlot(name);
+  if (slot){
+    slot->name[0] = '\0';
+    if (slot->state == CACHE_READY){
+      slot->state = CACHE_EMPTY;
+    }
+  }
+  xSemaphoreGive(cache_mutex);
+}
+
+void setPrefetchTargets(const char *prev_name, const char *next_name){
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  snprintf(targets[0], MAX_FILENAME_LENGTH, "%s", next_name);     // Next first, browsing mostly goes forwards
+  snprintf(targets[1], MAX_FILENAME_LENGTH, "%s", prev_name);
+  xSemaphoreGive(cache_mutex);
+
+  const uint8_t signal = 1;
+  xQueueOverwrite(targets_changed, &signal);
+}
+
+bool waitPrefetchTargets(char *first, char *second){
+  uint8_t signal;
+  if (xQueueReceive(targets_changed, &signal, portMAX_DELAY) != pdTRUE){
+    return false;
+  }
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  memcpy(first, targets[0], MAX_FILENAME_LENGTH);
+  memcpy(second, targets[1], MAX_FILENAME_LENGTH);
+  xSemaphoreGive(cache_mutex);
+  return true;
+}
+
+bool prefetchImage(const char *name){
+  // Skips names that stopped being targets while an earlier one was decoding
+  static ImageReader reader;                        // Decoder state and its SD chunk, too big for the task stack
+
+  xSemaphoreTake(cache_mutex, portMAX_DELAY);
+  const bool wanted = name[0] && (!strcmp(name, targets[0]) || !strcmp(name, targets[1]));
+  CachedImage *slot = wanted && !matchSlot(name) ? claimSlot(name, false) : NULL;
+  xSemaphoreGive(cache_mutex);
+  if (!slot){
+    return false;
+  }
+
+  bool ok = openImage(&reader, name);
+  if (ok){
+    ok = decodeCachedImage(slot, &reader, IMAGE_HEIGHT);
+    closeImage(&reader);
+  }
+  finishCachedImage(slot, ok);
+  if (ok){
+    viewer_cache_stats.prefetched++;
+  }
+  return ok;
+}
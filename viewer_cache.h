@@ -0,0 +1,65 @@
+/*
+
+Decoded photo cache for the image viewer
+
+VIEWER_CACHE_SLOTS whole frames, decoded and ready to push, live in PSRAM. The viewer pins the photo on
+screen and names its two neighbours as prefetch targets, prefetchTask decodes whichever targets aren't
+cached yet into the least recently shown slots. UP/ DOWN in the viewer then find the next photo already in
+memory, and showing it is one push over SPI instead of an SD read and a decode
+
+Slots are keyed by file name, so deletes and new photos shifting the list don't confuse them. A lookup
+that finds its photo still being prefetched waits for it rather than reading the file a second time
+
+Stills bigger than the screen are shrunk by a whole factor as they decode (a box average, 640x480 comes in
+at 213x160), the source rows go through the unused end of the slot. The viewer zooms those from the file
+
+*/
+
+#pragma once
+#include "globals.h"
+#include "image_codec.h"
+
+#define VIEWER_CACHE_SLOTS 3            // The photo on screen and one either side, 3 x 115 kB
+
+enum CachedImageState { CACHE_EMPTY, CACHE_LOADING, CACHE_READY };
+
+struct CachedImage {
+  char name[MAX_FILENAME_LENGTH];
+  uint16_t *pixels;                     // IMAGE_WIDTH x IMAGE_HEIGHT, rows of width pixels back to back
+  uint16_t width;
+  uint16_t height;                      // Rows decoded, at most IMAGE_HEIGHT (after shrinking)
+  uint8_t shrink;                       // Photo pixels per cached pixel either way, 1 unless a still was shrunk
+  CachedImageState state;
+  bool pinned;                          // On screen, never picked to be overwritten
+  uint32_t last_used;
+};
+
+struct ViewerCacheStats {
+  uint32_t hits;                        // Photo was in memory when the viewer asked
+  uint32_t misses;                      // Read from the SD while the viewer waited (or waited on a prefetch)
+  uint32_t prefetched;
+};
+
+extern ViewerCacheStats viewer_cache_stats;
+
+void initViewerCache();                                     // Allocates the slots, hangs if PSRAM is missing
+
+CachedImage *findCachedImage(const char *name);             // Pinned READY slot and a hit, NULL and a miss if it has to be read
+
+CachedImage *claimCachedImage(const char *name);            // Pinned slot to decode name into, the caller fills it then calls finishCachedImage
+
+int cachedImageRows(const ImageHeader *header);             // Rows the photo takes in a slot once shrunk to fit
+
+bool decodeCachedImage(CachedImage *slot, ImageReader *reader, int rows);   // Next rows of an open image into the slot, false on a bad file
+
+void finishCachedImage(CachedImage *slot, bool ok);         // READY, or EMPTY if the decode failed
+
+void unpinCachedImage(CachedImage *slot);                   // Off screen, may be reused
+
+void forgetCachedImage(const char *name);                   // After the file was deleted
+
+void setPrefetchTargets(const char *prev_name, const char *next_name);     // "" for none, replaces the last targets
+
+bool waitPrefetchTargets(char *first, char *second);        // prefetchTask only, blocks until the targets change, next photo comes first
+
+bool prefetchImage(const char *name);                       // prefetchTask only, decodes name unless it's cached or loading